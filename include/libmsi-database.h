@@ -20,6 +20,7 @@
 #define _LIBMSI_DATABASE_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "libmsi-types.h"
 
@@ -41,11 +42,104 @@ struct _LibmsiDatabaseClass
 
 GType libmsi_database_get_type (void) G_GNUC_CONST;
 
+#define LIBMSI_TYPE_DATABASE_STATS       (libmsi_database_stats_get_type ())
+
+typedef struct _LibmsiTableStats LibmsiTableStats;
+typedef struct _LibmsiDatabaseStats LibmsiDatabaseStats;
+
+/**
+ * LibmsiTableStats:
+ * @name: the table name
+ * @row_count: number of rows loaded
+ * @row_bytes: bytes held by the table and its row data
+ * @index_bytes: bytes held by the column hash indexes
+ *
+ * Memory used by a table loaded in a #LibmsiDatabase.
+ */
+struct _LibmsiTableStats
+{
+    gchar *name;
+    guint row_count;
+    guint64 row_bytes;
+    guint64 index_bytes;
+};
+
+/**
+ * LibmsiDatabaseStats:
+ * @n_tables: number of loaded tables
+ * @tables: (array length=n_tables): the loaded tables
+ * @string_pool_bytes: bytes held by the string table
+ * @string_count: number of strings in the string table
+ * @stream_bytes: bytes of stream data buffered in memory
+ * @image_bytes: size of the in-memory database file, if any
+ * @table_loads: number of tables read from storage
+ * @index_builds: number of column hash indexes built
+ * @query_parses: number of SQL queries parsed
+ * @commits: number of successful commits
+ *
+ * Memory use and activity counters of a #LibmsiDatabase, as returned
+ * by libmsi_database_get_stats().
+ */
+struct _LibmsiDatabaseStats
+{
+    guint n_tables;
+    LibmsiTableStats *tables;
+    guint64 string_pool_bytes;
+    guint string_count;
+    guint64 stream_bytes;
+    guint64 image_bytes;
+    guint64 table_loads;
+    guint64 index_builds;
+    guint64 query_parses;
+    guint64 commits;
+};
+
+GType libmsi_database_stats_get_type (void) G_GNUC_CONST;
+
+/**
+ * LibmsiProgressFunc:
+ * @db: the #LibmsiDatabase
+ * @operation: the running #LibmsiProgressOperation
+ * @bytes: bytes processed so far by @operation
+ * @rows: rows processed so far by @operation
+ * @user_data: user data passed to libmsi_database_set_progress_callback()
+ *
+ * Reports the progress of a long-running database operation.
+ */
+typedef void (*LibmsiProgressFunc) (LibmsiDatabase *db,
+                                    LibmsiProgressOperation operation,
+                                    guint64 bytes,
+                                    guint64 rows,
+                                    gpointer user_data);
+
 
 LibmsiDatabase *    libmsi_database_new                 (const gchar *path,
                                                          guint flags,
                                                          const char *persist,
                                                          GError **error);
+void                libmsi_database_new_async           (const gchar *path,
+                                                         guint flags,
+                                                         const char *persist,
+                                                         GCancellable *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer user_data);
+LibmsiDatabase *    libmsi_database_new_finish          (GAsyncResult *result,
+                                                         GError **error);
+LibmsiDatabase *    libmsi_database_new_from_bytes      (GBytes *bytes,
+                                                         guint flags,
+                                                         GOutputStream *output,
+                                                         GError **error);
+LibmsiDatabase *    libmsi_database_new_from_stream     (GInputStream *stream,
+                                                         guint flags,
+                                                         GOutputStream *output,
+                                                         GCancellable *cancellable,
+                                                         GError **error);
+LibmsiDatabase *    libmsi_database_open_snapshot       (const gchar *path,
+                                                         const gchar *snapshot,
+                                                         GError **error);
+gboolean            libmsi_database_save_snapshot       (LibmsiDatabase *db,
+                                                         const char *path,
+                                                         GError **error);
 
 gboolean            libmsi_database_is_readonly         (LibmsiDatabase *db);
 LibmsiRecord *      libmsi_database_get_primary_keys    (LibmsiDatabase *db,
@@ -54,22 +148,63 @@ LibmsiRecord *      libmsi_database_get_primary_keys    (LibmsiDatabase *db,
 gboolean            libmsi_database_apply_transform     (LibmsiDatabase *db,
                                                          const char *file,
                                                          GError **error);
+gboolean            libmsi_database_generate_transform  (LibmsiDatabase *db,
+                                                         LibmsiDatabase *reference,
+                                                         const char *path,
+                                                         GError **error);
 gboolean            libmsi_database_export              (LibmsiDatabase *db,
                                                          const char *table,
                                                          int fd,
                                                          GError **error);
+gboolean            libmsi_database_export_all          (LibmsiDatabase *db,
+                                                         const char *dir,
+                                                         guint n_threads,
+                                                         GError **error);
 gboolean            libmsi_database_import              (LibmsiDatabase *db,
                                                          const char *path,
                                                          GError **error);
+gboolean            libmsi_database_import_files        (LibmsiDatabase *db,
+                                                         const char **paths,
+                                                         guint n_threads,
+                                                         GError **error);
 gboolean            libmsi_database_is_table_persistent (LibmsiDatabase *db,
                                                          const char *table,
                                                          GError **error);
+gboolean            libmsi_database_execute_script      (LibmsiDatabase *db,
+                                                         const char *script,
+                                                         GError **error);
+gboolean            libmsi_database_insert_records      (LibmsiDatabase *db,
+                                                         const char *table,
+                                                         const char **columns,
+                                                         LibmsiRecord **records,
+                                                         guint n_records,
+                                                         GError **error);
 gboolean            libmsi_database_merge               (LibmsiDatabase *db,
                                                          LibmsiDatabase *merge,
                                                          const char *table,
                                                          GError **error);
 gboolean            libmsi_database_commit              (LibmsiDatabase *db,
                                                          GError **error);
+void                libmsi_database_commit_async        (LibmsiDatabase *db,
+                                                         GCancellable *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer user_data);
+gboolean            libmsi_database_commit_finish       (LibmsiDatabase *db,
+                                                         GAsyncResult *result,
+                                                         GError **error);
+void                libmsi_database_set_progress_callback
+                                                        (LibmsiDatabase *db,
+                                                         LibmsiProgressFunc func,
+                                                         gpointer user_data,
+                                                         GDestroyNotify notify);
+void                libmsi_database_set_cancellable     (LibmsiDatabase *db,
+                                                         GCancellable *cancellable);
+
+LibmsiDatabaseStats *
+                    libmsi_database_get_stats           (LibmsiDatabase *db);
+LibmsiDatabaseStats *
+                    libmsi_database_stats_copy          (const LibmsiDatabaseStats *stats);
+void                libmsi_database_stats_free          (LibmsiDatabaseStats *stats);
 
 G_END_DECLS
 
@@ -60,6 +60,9 @@ gchar *           libmsi_record_get_string         (const LibmsiRecord *record,
 gboolean          libmsi_record_load_stream        (LibmsiRecord *record,
                                                     guint field,
                                                     const gchar *filename);
+gboolean          libmsi_record_load_stream_lazy   (LibmsiRecord *record,
+                                                    guint field,
+                                                    const gchar *filename);
 gboolean          libmsi_record_set_stream         (LibmsiRecord *record,
                                                     guint field,
                                                     GInputStream *input,
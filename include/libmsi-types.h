@@ -54,7 +54,8 @@ typedef enum LibmsiResultError
     LIBMSI_RESULT_FUNCTION_FAILED,
     LIBMSI_RESULT_INVALID_TABLE,
     LIBMSI_RESULT_DATATYPE_MISMATCH,
-    LIBMSI_RESULT_INVALID_DATATYPE
+    LIBMSI_RESULT_INVALID_DATATYPE,
+    LIBMSI_RESULT_READ_FAULT
 } LibmsiResultError;
 
 typedef enum LibmsiPropertyType
@@ -118,6 +119,18 @@ typedef enum LibmsiDBError
     LIBMSI_DB_ERROR_BADLOCALIZEATTRIB
 } LibmsiDBError;
 
+typedef enum LibmsiProgressOperation
+{
+    LIBMSI_PROGRESS_OPERATION_COMMIT,
+    LIBMSI_PROGRESS_OPERATION_IMPORT,
+    LIBMSI_PROGRESS_OPERATION_EXPORT,
+    LIBMSI_PROGRESS_OPERATION_MERGE,
+    LIBMSI_PROGRESS_OPERATION_APPLY_TRANSFORM,
+    LIBMSI_PROGRESS_OPERATION_GENERATE_TRANSFORM,
+    LIBMSI_PROGRESS_OPERATION_EXECUTE_SCRIPT,
+    LIBMSI_PROGRESS_OPERATION_INSERT_RECORDS
+} LibmsiProgressOperation;
+
 typedef enum LibmsiProperty
 {
     LIBMSI_PROPERTY_DICTIONARY = 0,
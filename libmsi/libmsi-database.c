@@ -19,10 +19,12 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <glib/gstdio.h>
 
 #include "libmsi-enums.h"
 #include "libmsi-database.h"
@@ -31,6 +33,7 @@
 #include "libmsi.h"
 #include "msipriv.h"
 #include "query.h"
+#include "sql-parser.h"
 
 enum
 {
@@ -39,9 +42,20 @@ enum
     PROP_PATH,
     PROP_FLAGS,
     PROP_OUTPATH,
+    PROP_BYTES,
+    PROP_OUTPUT_STREAM,
+    PROP_SNAPSHOT,
 };
 
-G_DEFINE_TYPE (LibmsiDatabase, libmsi_database, G_TYPE_OBJECT);
+static void libmsi_database_initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (LibmsiDatabase, libmsi_database, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                libmsi_database_initable_iface_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, NULL));
+
+G_DEFINE_BOXED_TYPE (LibmsiDatabaseStats, libmsi_database_stats,
+                     libmsi_database_stats_copy, libmsi_database_stats_free)
 
 const guint8 clsid_msi_transform[16] = { 0x82, 0x10, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0,0x00, 0x00,0x00,0x00,0x00,0x00,0x46 };
 const guint8 clsid_msi_database[16] = { 0x84, 0x10, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0,0x00, 0x00,0x00,0x00,0x00,0x00,0x46 };
@@ -126,7 +140,16 @@ libmsi_database_finalize (GObject *object)
     free_cached_tables (self);
     free_transforms (self);
 
+    if (self->progress_notify)
+        self->progress_notify (self->progress_data);
+    g_clear_object (&self->cancellable);
+    g_clear_object (&self->output);
+    if (self->bytes)
+        g_bytes_unref (self->bytes);
     g_free (self->path);
+    g_free (self->snapshot_path);
+    if (self->snapshot)
+        g_mapped_file_unref (self->snapshot);
 
     G_OBJECT_CLASS (libmsi_database_parent_class)->finalize (object);
 }
@@ -149,6 +172,18 @@ libmsi_database_set_property (GObject *object, guint prop_id, const GValue *valu
         g_return_if_fail (self->outpath == NULL);
         self->outpath = g_value_dup_string (value);
         break;
+    case PROP_BYTES:
+        g_return_if_fail (self->bytes == NULL);
+        self->bytes = g_value_dup_boxed (value);
+        break;
+    case PROP_OUTPUT_STREAM:
+        g_return_if_fail (self->output == NULL);
+        self->output = g_value_dup_object (value);
+        break;
+    case PROP_SNAPSHOT:
+        g_return_if_fail (self->snapshot_path == NULL);
+        self->snapshot_path = g_value_dup_string (value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -171,6 +206,15 @@ libmsi_database_get_property (GObject *object, guint prop_id, GValue *value, GPa
     case PROP_OUTPATH:
         g_value_set_string (value, self->outpath);
         break;
+    case PROP_BYTES:
+        g_value_set_boxed (value, self->bytes);
+        break;
+    case PROP_OUTPUT_STREAM:
+        g_value_set_object (value, self->output);
+        break;
+    case PROP_SNAPSHOT:
+        g_value_set_string (value, self->snapshot_path);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -201,6 +245,22 @@ libmsi_database_class_init (LibmsiDatabaseClass *klass)
         g_param_spec_string ("outpath", "outpath", "outpath", NULL,
                              G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE |
                              G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_BYTES,
+        g_param_spec_boxed ("bytes", "bytes", "bytes", G_TYPE_BYTES,
+                            G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE |
+                            G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_OUTPUT_STREAM,
+        g_param_spec_object ("output-stream", "output-stream", "output-stream",
+                             G_TYPE_OUTPUT_STREAM,
+                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE |
+                             G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SNAPSHOT,
+        g_param_spec_string ("snapshot", "snapshot", "snapshot", NULL,
+                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE |
+                             G_PARAM_STATIC_STRINGS));
 }
 
 unsigned msi_open_storage( LibmsiDatabase *db, const char *stname )
@@ -573,8 +633,53 @@ void append_storage_to_db( LibmsiDatabase *db, GsfInfile *stg )
 #endif
 }
 
+/* the committed image becomes the new input of an in-memory database,
+ * and is handed to its output stream if there is one; the bytes keep
+ * the memory output alive rather than copying its buffer */
+static LibmsiResult msi_commit_memory_output( LibmsiDatabase *db )
+{
+    GsfOutputMemory *mem = GSF_OUTPUT_MEMORY(db->outmem);
+    gsf_off_t size = gsf_output_size( db->outmem );
+    GSeekable *seekable;
+    GBytes *bytes;
+
+    bytes = g_bytes_new_with_free_func( gsf_output_memory_get_bytes( mem ), size,
+                                        g_object_unref, g_object_ref( db->outmem ) );
+    if (db->bytes)
+        g_bytes_unref( db->bytes );
+    db->bytes = bytes;
+
+    if (!db->output)
+        return LIBMSI_RESULT_SUCCESS;
+
+    /* each commit replaces the image written by the one before */
+    if (db->output_written)
+    {
+        seekable = G_IS_SEEKABLE( db->output ) ? G_SEEKABLE( db->output ) : NULL;
+        if (!seekable || !g_seekable_can_truncate( seekable ) ||
+            !g_seekable_seek( seekable, 0, G_SEEK_SET, db->cancellable, NULL ) ||
+            !g_seekable_truncate( seekable, 0, db->cancellable, NULL ))
+        {
+            g_warning("output stream can't be rewound for another commit\n");
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+        }
+    }
+
+    if (!g_output_stream_write_all( db->output, g_bytes_get_data( bytes, NULL ),
+                                    size, NULL, db->cancellable, NULL ))
+    {
+        g_warning("failed to write database to output stream\n");
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+    db->output_written = true;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 LibmsiResult _libmsi_database_close(LibmsiDatabase *db, bool committed)
 {
+    LibmsiResult ret = LIBMSI_RESULT_SUCCESS;
+
     TRACE("%p %d\n", db, committed);
 
     if ( db->strings )
@@ -595,9 +700,17 @@ LibmsiResult _libmsi_database_close(LibmsiDatabase *db, bool committed)
         g_object_unref(G_OBJECT(db->outfile));
         db->outfile = NULL;
     }
+    g_clear_object( &db->outsink );
     free_streams( db );
     free_storages( db );
 
+    if (db->outmem) {
+        if (committed)
+            ret = msi_commit_memory_output( db );
+        g_object_unref(G_OBJECT(db->outmem));
+        db->outmem = NULL;
+    }
+
     if (db->outpath) {
         if (!committed) {
             unlink( db->outpath );
@@ -612,7 +725,7 @@ LibmsiResult _libmsi_database_close(LibmsiDatabase *db, bool committed)
         }
     }
     db->outpath = NULL;
-    return LIBMSI_RESULT_SUCCESS;
+    return ret;
 }
 
 LibmsiResult _libmsi_database_start_transaction(LibmsiDatabase *db)
@@ -626,6 +739,17 @@ LibmsiResult _libmsi_database_start_transaction(LibmsiDatabase *db)
     if (db->flags & LIBMSI_DB_FLAGS_READONLY)
         return LIBMSI_RESULT_SUCCESS;
 
+    /* a database without a path lives in memory */
+    if (!db->path)
+    {
+        TRACE("%p in memory\n", db);
+
+        db->outmem = gsf_output_memory_new();
+        out = db->outmem;
+        g_object_ref(G_OBJECT(out));
+        goto create;
+    }
+
     db->rename_outpath = false;
     if( !db->outpath )
     {
@@ -646,6 +770,10 @@ LibmsiResult _libmsi_database_start_transaction(LibmsiDatabase *db)
         g_warning("open file failed for %s\n", debugstr_a(db->outpath));
         return LIBMSI_RESULT_OPEN_FAILED;
     }
+    /* kept to abandon the file; closing it renames it over outpath */
+    db->outsink = g_object_ref(out);
+
+create:
     stg = gsf_outfile_msole_new(out);
     g_object_unref(G_OBJECT(out));
     if (!stg)
@@ -671,6 +799,7 @@ end:
         if (db->outfile)
             g_object_unref(G_OBJECT(db->outfile));
         db->outfile = NULL;
+        g_clear_object(&db->outsink);
     }
     if (stg)
         g_object_unref(G_OBJECT(stg));
@@ -678,17 +807,132 @@ end:
     return ret;
 }
 
-static char *msi_read_text_archive(const char *path, unsigned *len)
+/* text archives are read a chunk at a time and handed out line by line */
+#define IMPORT_CHUNK    65536
+#define IMPORT_BATCH    1024
+
+typedef struct {
+    FILE *file;
+    char *buf;
+    size_t size;
+    size_t start;
+    size_t end;
+    guint64 bytes;
+    bool eof;
+    unsigned error;             /* why the lines ran out early */
+} IMPORTREADER;
+
+static bool msi_import_reader_open(IMPORTREADER *rd, const char *path)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->file = g_fopen(path, "rb");
+    if (!rd->file)
+        return false;
+
+    rd->size = 2 * IMPORT_CHUNK;
+    rd->buf = msi_alloc(rd->size);
+    return rd->buf != NULL;
+}
+
+static void msi_import_reader_close(IMPORTREADER *rd)
+{
+    if (rd->file)
+        fclose(rd->file);
+    msi_free(rd->buf);
+}
+
+/* returns the next line, NUL-terminated in place, or NULL at the end
+ * of the file or on error, which is left in rd->error; the line stays
+ * valid until the next call */
+static char *msi_import_read_line(IMPORTREADER *rd, unsigned *len)
+{
+    char *line, *nl;
+    size_t n;
+
+    if (rd->error != LIBMSI_RESULT_SUCCESS)
+        return NULL;
+
+    for (;;)
+    {
+        nl = memchr(rd->buf + rd->start, '\n', rd->end - rd->start);
+        if (nl || rd->eof)
+            break;
+
+        /* keep the partial line, and room for a chunk and a NUL after it */
+        memmove(rd->buf, rd->buf + rd->start, rd->end - rd->start);
+        rd->end -= rd->start;
+        rd->start = 0;
+        if (rd->size - rd->end <= IMPORT_CHUNK)
+        {
+            char *buf = msi_realloc(rd->buf, rd->size * 2);
+            if (!buf)
+            {
+                rd->error = LIBMSI_RESULT_OUTOFMEMORY;
+                return NULL;
+            }
+            rd->buf = buf;
+            rd->size *= 2;
+        }
+
+        n = fread(rd->buf + rd->end, 1, IMPORT_CHUNK, rd->file);
+        rd->end += n;
+        rd->bytes += n;
+        if (n < IMPORT_CHUNK)
+        {
+            if (ferror(rd->file))
+            {
+                rd->error = LIBMSI_RESULT_READ_FAULT;
+                return NULL;
+            }
+            rd->eof = true;
+
+            /* nulls at the end of the file are padding */
+            while (rd->end > rd->start && !rd->buf[rd->end - 1])
+                rd->end--;
+        }
+    }
+
+    if (rd->start == rd->end)
+        return NULL;
+
+    line = rd->buf + rd->start;
+    if (!nl)
+        nl = rd->buf + rd->end;
+    *nl = 0;
+    *len = nl - line;
+    rd->start = MIN((size_t)(nl - rd->buf) + 1, rd->end);
+    return line;
+}
+
+/* blank lines are swallowed by the line break before them */
+static bool msi_import_blank_line(const char *line, unsigned len)
+{
+    while (len && line[len - 1] == '\r')
+        len--;
+    return !len;
+}
+
+/* the header lines outlive the read buffer */
+static char *msi_import_read_header(IMPORTREADER *rd, bool first)
 {
-    char *data;
-    size_t nread;
+    unsigned len = 0;
+    char *line, *copy;
+
+    do
+        line = msi_import_read_line(rd, &len);
+    while (line && !first && msi_import_blank_line(line, len));
+
+    if (rd->error != LIBMSI_RESULT_SUCCESS)
+        return NULL;
 
-    if (!g_file_get_contents(path, &data, &nread, NULL))
+    copy = msi_alloc(len + 1);
+    if (!copy)
         return NULL;
 
-    while (!data[nread - 1]) nread--;
-    *len = nread;
-    return data;
+    if (line)
+        memcpy(copy, line, len);
+    copy[len] = 0;
+    return copy;
 }
 
 static void msi_parse_line(char **line, char ***entries, unsigned *num_entries, unsigned *len)
@@ -989,7 +1233,10 @@ static unsigned construct_record(unsigned num_columns, char **types,
                     r = _libmsi_record_load_stream_from_file(*rec, i + 1, file);
                     g_free (file);
                     if (r != LIBMSI_RESULT_SUCCESS)
+                    {
+                        g_object_unref(*rec);
                         return LIBMSI_RESULT_FUNCTION_FAILED;
+                    }
                 }
                 break;
             default:
@@ -1002,151 +1249,303 @@ static unsigned construct_record(unsigned num_columns, char **types,
     return LIBMSI_RESULT_SUCCESS;
 }
 
-static unsigned msi_add_records_to_table(LibmsiDatabase *db, char **columns, char **types,
-                                     char **labels, char ***records,
-                                     int num_columns, int num_records)
+static unsigned msi_import_parse_row(char *line, unsigned len, char **fields,
+                                     char **types, const char *name,
+                                     unsigned num_columns, LibmsiRecord **rec)
 {
-    unsigned r, num_rows, num_cols;
-    int i;
-    LibmsiView *view;
-    LibmsiRecord *rec;
+    unsigned r, i, num_entries;
+    char **entries;
 
-    r = table_view_create(db, labels[0], &view);
-    if (r != LIBMSI_RESULT_SUCCESS)
-        return r;
+    msi_parse_line(&line, &entries, &num_entries, &len);
+    if (!entries)
+        return LIBMSI_RESULT_OUTOFMEMORY;
 
-    r = view->ops->get_dimensions( view, &num_rows, &num_cols );
-    if (r != LIBMSI_RESULT_SUCCESS)
-        return r;
+    /* missing trailing fields are empty */
+    for (i = 0; i < num_columns; i++)
+        fields[i] = i < num_entries ? entries[i] : (char *)"";
 
-    while (num_rows > 0)
-    {
-        r = view->ops->delete_row(view, --num_rows);
-        if (r != LIBMSI_RESULT_SUCCESS)
-            goto done;
-    }
+    r = construct_record(num_columns, types, fields, name, rec);
+    msi_free(entries);
+    return r;
+}
+
+static unsigned msi_import_flush(LibmsiDatabase *db, LibmsiView *view, IMPORTREADER *rd,
+                                 LibmsiRecord **batch, unsigned *count, guint64 *bytes)
+{
+    unsigned r, i;
+
+    r = msi_table_append_rows(view, batch, *count, false);
+    if (r == LIBMSI_RESULT_SUCCESS &&
+        !msi_progress_update(db, rd->bytes - *bytes, *count))
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+
+    for (i = 0; i < *count; i++)
+        g_object_unref(batch[i]);
+    *count = 0;
+    *bytes = rd->bytes;
+    return r;
+}
 
-    for (i = 0; i < num_records; i++)
+/* rows go straight into the table, a batch at a time, and the table
+ * is sorted once at the end rather than for every row; if any of it
+ * fails, the table is left empty, as msi_import_open_table made it */
+static unsigned msi_add_records_to_table(LibmsiDatabase *db, LibmsiView *view,
+                                         IMPORTREADER *rd, char **types,
+                                         const char *name, unsigned num_columns)
+{
+    unsigned r = LIBMSI_RESULT_SUCCESS, i, len, count = 0, mark;
+    LibmsiRecord *batch[IMPORT_BATCH];
+    guint64 bytes = 0;
+    char **fields;
+    char *line;
+
+    fields = msi_alloc(num_columns * sizeof(char *));
+    if (!fields)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    mark = msi_string_table_begin_undo(db->strings);
+
+    while ((line = msi_import_read_line(rd, &len)))
     {
-        r = construct_record(num_columns, types, records[i], labels[0], &rec);
-        if (r != LIBMSI_RESULT_SUCCESS)
-            goto done;
+        if (msi_import_blank_line(line, len))
+            continue;
 
-        r = view->ops->insert_row(view, rec, -1, false);
+        r = msi_import_parse_row(line, len, fields, types, name, num_columns, &batch[count]);
         if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+
+        if (++count == IMPORT_BATCH)
         {
-            g_object_unref(rec);
-            goto done;
+            r = msi_import_flush(db, view, rd, batch, &count, &bytes);
+            if (r != LIBMSI_RESULT_SUCCESS)
+                break;
         }
-
-        g_object_unref(rec);
     }
 
-done:
-    msi_free(view);
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = rd->error;
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_import_flush(db, view, rd, batch, &count, &bytes);
+    else
+        for (i = 0; i < count; i++)
+            g_object_unref(batch[i]);
+
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_table_sort_rows(view, 0);
+    else
+        msi_table_discard_rows(view, 0);
+    msi_string_table_end_undo(db->strings, mark, r != LIBMSI_RESULT_SUCCESS);
+    msi_free(fields);
     return r;
 }
 
-static unsigned _libmsi_database_import(LibmsiDatabase *db, const char *path)
+typedef struct {
+    char **lines;
+    char ***records;
+    unsigned num_records;
+} IMPORTSUMINFO;
+
+static void msi_import_free_suminfo(IMPORTSUMINFO *si)
+{
+    unsigned i;
+
+    for (i = 0; i < si->num_records; i++)
+    {
+        msi_free(si->records[i]);
+        msi_free(si->lines[i]);
+    }
+    msi_free(si->records);
+    msi_free(si->lines);
+    memset(si, 0, sizeof(*si));
+}
+
+/* the summary information is small, and wants all of its rows at once */
+static unsigned msi_import_read_suminfo(IMPORTREADER *rd, IMPORTSUMINFO *si)
 {
-    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
-    unsigned len, i;
-    unsigned num_labels = 0;
-    unsigned num_types = 0;
-    unsigned num_columns = 0;
-    unsigned num_records = 0;
-    char **columns = NULL;
-    char **types = NULL;
-    char **labels = NULL;
-    char *ptr;
-    char *data = NULL;
-    char ***records = NULL;
     char ***temp_records;
+    char **temp_lines;
+    unsigned len;
+    char *line;
 
-    static const char suminfo[] = "_SummaryInformation";
-    static const char forcecodepage[] = "_ForceCodepage";
+    while ((line = msi_import_read_line(rd, &len)))
+    {
+        if (msi_import_blank_line(line, len))
+            continue;
 
-    TRACE("%p %s\n", db, debugstr_a(path));
+        temp_records = msi_realloc(si->records, (si->num_records + 1) * sizeof(char **));
+        if (!temp_records)
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        si->records = temp_records;
 
-    data = msi_read_text_archive( path, &len );
-    if (!data)
-        goto done;
+        temp_lines = msi_realloc(si->lines, (si->num_records + 1) * sizeof(char *));
+        if (!temp_lines)
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        si->lines = temp_lines;
 
-    ptr = data;
-    msi_parse_line( &ptr, &columns, &num_columns, &len );
-    msi_parse_line( &ptr, &types, &num_types, &len );
-    msi_parse_line( &ptr, &labels, &num_labels, &len );
+        si->lines[si->num_records] = msi_alloc(len + 1);
+        if (!si->lines[si->num_records])
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        memcpy(si->lines[si->num_records], line, len + 1);
 
-    if (num_columns == 1 && !columns[0][0] && num_labels == 1 && !labels[0][0] &&
-        num_types == 2 && !strcmp( types[1], forcecodepage ))
-    {
-        r = msi_set_string_table_codepage( db->strings, atoi( types[0] ) );
-        goto done;
+        line = si->lines[si->num_records];
+        msi_parse_line(&line, &si->records[si->num_records], NULL, &len);
+        si->num_records++;
     }
 
-    if (num_columns != num_types)
+    return rd->error;
+}
+
+static unsigned msi_import_suminfo(LibmsiDatabase *db, IMPORTSUMINFO *si, unsigned num_columns)
+{
+    if (msi_add_suminfo(db, si->records, si->num_records, num_columns) != LIBMSI_RESULT_SUCCESS)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+typedef enum {
+    IMPORT_TABLE,
+    IMPORT_CODEPAGE,
+    IMPORT_SUMINFO,
+} IMPORTKIND;
+
+typedef struct {
+    char *lines[3];
+    char **columns;
+    char **types;
+    char **labels;
+    unsigned num_columns;
+    unsigned num_types;
+    unsigned num_labels;
+    IMPORTKIND kind;
+} IMPORTHEADER;
+
+static void msi_import_free_header(IMPORTHEADER *hdr)
+{
+    unsigned i;
+
+    for (i = 0; i < 3; i++)
+        msi_free(hdr->lines[i]);
+    msi_free(hdr->columns);
+    msi_free(hdr->types);
+    msi_free(hdr->labels);
+    memset(hdr, 0, sizeof(*hdr));
+}
+
+/* the three header lines: column names, column types, then the table
+ * name and its primary keys */
+static unsigned msi_import_parse_header(IMPORTREADER *rd, IMPORTHEADER *hdr)
+{
+    unsigned len, i;
+    char *ptr;
+
+    static const char suminfo[] = "_SummaryInformation";
+    static const char forcecodepage[] = "_ForceCodepage";
+
+    memset(hdr, 0, sizeof(*hdr));
+    for (i = 0; i < 3; i++)
     {
-        r = LIBMSI_RESULT_FUNCTION_FAILED;
-        goto done;
+        hdr->lines[i] = msi_import_read_header( rd, i == 0 );
+        if (!hdr->lines[i])
+            return rd->error != LIBMSI_RESULT_SUCCESS ? rd->error : LIBMSI_RESULT_OUTOFMEMORY;
     }
 
-    records = msi_alloc(sizeof(char **));
-    if (!records)
+    ptr = hdr->lines[0];
+    len = strlen( ptr );
+    msi_parse_line( &ptr, &hdr->columns, &hdr->num_columns, &len );
+    ptr = hdr->lines[1];
+    len = strlen( ptr );
+    msi_parse_line( &ptr, &hdr->types, &hdr->num_types, &len );
+    ptr = hdr->lines[2];
+    len = strlen( ptr );
+    msi_parse_line( &ptr, &hdr->labels, &hdr->num_labels, &len );
+    if (!hdr->columns || !hdr->types || !hdr->labels)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    if (hdr->num_columns == 1 && !hdr->columns[0][0] &&
+        hdr->num_labels == 1 && !hdr->labels[0][0] &&
+        hdr->num_types == 2 && !strcmp( hdr->types[1], forcecodepage ))
     {
-        r = LIBMSI_RESULT_OUTOFMEMORY;
-        goto done;
+        hdr->kind = IMPORT_CODEPAGE;
+        return LIBMSI_RESULT_SUCCESS;
     }
 
-    /* read in the table records */
-    while (len)
-    {
-        msi_parse_line( &ptr, &records[num_records], NULL, &len );
+    if (hdr->num_columns != hdr->num_types)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
 
-        num_records++;
-        temp_records = msi_realloc(records, (num_records + 1) * sizeof(char **));
-        if (!temp_records)
-        {
-            r = LIBMSI_RESULT_OUTOFMEMORY;
-            goto done;
-        }
-        records = temp_records;
-    }
+    hdr->kind = strcmp( hdr->labels[0], suminfo ) ? IMPORT_TABLE : IMPORT_SUMINFO;
+    return LIBMSI_RESULT_SUCCESS;
+}
 
-    if (!strcmp(labels[0], suminfo))
+/* creates the table if needed, and empties it */
+static unsigned msi_import_open_table(LibmsiDatabase *db, IMPORTHEADER *hdr, LibmsiView **view)
+{
+    unsigned r, num_rows, num_cols;
+
+    if (!table_view_exists(db, hdr->labels[0]))
     {
-        r = msi_add_suminfo( db, records, num_records, num_columns );
+        r = msi_add_table_to_db( db, hdr->columns, hdr->types, hdr->labels,
+                                 hdr->num_labels, hdr->num_columns );
         if (r != LIBMSI_RESULT_SUCCESS)
-        {
-            r = LIBMSI_RESULT_FUNCTION_FAILED;
-            goto done;
-        }
+            return LIBMSI_RESULT_FUNCTION_FAILED;
     }
-    else
-    {
-        if (!table_view_exists(db, labels[0]))
-        {
-            r = msi_add_table_to_db( db, columns, types, labels, num_labels, num_columns );
-            if (r != LIBMSI_RESULT_SUCCESS)
-            {
-                r = LIBMSI_RESULT_FUNCTION_FAILED;
-                goto done;
-            }
-        }
 
-        r = msi_add_records_to_table( db, columns, types, labels, records, num_columns, num_records);
+    r = table_view_create(db, hdr->labels[0], view);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    r = (*view)->ops->get_dimensions( *view, &num_rows, &num_cols );
+    while (r == LIBMSI_RESULT_SUCCESS && num_rows > 0)
+        r = (*view)->ops->delete_row(*view, --num_rows);
+
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        (*view)->ops->delete(*view);
+        *view = NULL;
     }
+    return r;
+}
 
-done:
-    msi_free(data);
-    msi_free(columns);
-    msi_free(types);
-    msi_free(labels);
+static unsigned _libmsi_database_import(LibmsiDatabase *db, const char *path)
+{
+    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+    IMPORTSUMINFO si = { NULL, NULL, 0 };
+    IMPORTHEADER hdr;
+    IMPORTREADER rd;
+    LibmsiView *view;
+
+    TRACE("%p %s\n", db, debugstr_a(path));
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (!msi_import_reader_open( &rd, path ))
+        goto done;
 
-    for (i = 0; i < num_records; i++)
-        msi_free(records[i]);
+    r = msi_import_parse_header( &rd, &hdr );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
 
-    msi_free(records);
+    switch (hdr.kind)
+    {
+    case IMPORT_CODEPAGE:
+        r = msi_set_string_table_codepage( db->strings, atoi( hdr.types[0] ) );
+        break;
+    case IMPORT_SUMINFO:
+        r = msi_import_read_suminfo( &rd, &si );
+        if (r == LIBMSI_RESULT_SUCCESS)
+            r = msi_import_suminfo( db, &si, hdr.num_columns );
+        break;
+    case IMPORT_TABLE:
+        r = msi_import_open_table( db, &hdr, &view );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+        r = msi_add_records_to_table( db, view, &rd, hdr.types, hdr.labels[0], hdr.num_columns );
+        view->ops->delete(view);
+        break;
+    }
 
+done:
+    msi_import_reader_close(&rd);
+    msi_import_free_header(&hdr);
+    msi_import_free_suminfo(&si);
     return r;
 }
 
@@ -1174,33 +1573,318 @@ libmsi_database_import (LibmsiDatabase *db,
     g_return_val_if_fail (!error || *error == NULL, FALSE);
 
     g_object_ref(db);
+    msi_progress_begin(db, LIBMSI_PROGRESS_OPERATION_IMPORT);
     r = _libmsi_database_import(db, path);
     g_object_unref(db);
 
-    if (r != LIBMSI_RESULT_SUCCESS)
+    if (r != LIBMSI_RESULT_SUCCESS &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
         g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
 
     return r == LIBMSI_RESULT_SUCCESS;
 }
 
-static gboolean
-msi_export_stream (GsfInput *gsfin, GFile *table_dir, gchar **str,
-                   GError **error)
+/* a file parsed on a worker, waiting to be applied to the database */
+typedef struct {
+    const char *path;
+    IMPORTHEADER hdr;
+    IMPORTSUMINFO si;
+    LibmsiRecord **records;
+    unsigned num_records;
+    guint64 bytes;
+    bool parsed;
+    LibmsiResult r;
+} IMPORTSTAGE;
+
+typedef struct {
+    LibmsiDatabase *db;
+    IMPORTSTAGE *stages;
+    unsigned num_stages;
+    gint next;
+    GAsyncQueue *done;
+} IMPORTPOOL;
+
+static void msi_import_free_stage(IMPORTSTAGE *stage)
 {
-    GError *err = NULL;
-    GFile *file = NULL;
-    GInputStream *in = NULL;
-    GOutputStream *out = NULL;
-    gssize spliced = -1;
+    unsigned i;
 
-    if (!table_dir)
-        goto end;
+    for (i = 0; i < stage->num_records; i++)
+        g_object_unref(stage->records[i]);
+    msi_free(stage->records);
+    stage->records = NULL;
+    stage->num_records = 0;
+    msi_import_free_header(&stage->hdr);
+    msi_import_free_suminfo(&stage->si);
+}
 
-    if (!g_file_make_directory_with_parents (table_dir, NULL, &err) &&
-        !g_error_matches (err, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
-        g_propagate_error (error, err);
-        goto end;
-    }
+/* only the text and the files it names are touched here, never the
+ * database */
+static unsigned msi_import_parse_rows(IMPORTSTAGE *stage, IMPORTREADER *rd)
+{
+    unsigned r = LIBMSI_RESULT_SUCCESS, len, size = 0;
+    unsigned num_columns = stage->hdr.num_columns;
+    LibmsiRecord **records;
+    char **fields;
+    char *line;
+
+    fields = msi_alloc(num_columns * sizeof(char *));
+    if (!fields)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    while ((line = msi_import_read_line(rd, &len)))
+    {
+        if (msi_import_blank_line(line, len))
+            continue;
+
+        if (stage->num_records == size)
+        {
+            size = size ? size * 2 : IMPORT_BATCH;
+            records = msi_realloc(stage->records, size * sizeof(LibmsiRecord *));
+            if (!records)
+            {
+                r = LIBMSI_RESULT_OUTOFMEMORY;
+                break;
+            }
+            stage->records = records;
+        }
+
+        r = msi_import_parse_row(line, len, fields, stage->hdr.types,
+                                 stage->hdr.labels[0], num_columns,
+                                 &stage->records[stage->num_records]);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+        stage->num_records++;
+    }
+
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = rd->error;
+    msi_free(fields);
+    return r;
+}
+
+static unsigned msi_import_parse_stage(LibmsiDatabase *db, IMPORTSTAGE *stage)
+{
+    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+    IMPORTREADER rd;
+
+    if (g_cancellable_is_cancelled(db->cancellable))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if (!msi_import_reader_open(&rd, stage->path))
+        goto done;
+
+    r = msi_import_parse_header(&rd, &stage->hdr);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    if (stage->hdr.kind == IMPORT_SUMINFO)
+        r = msi_import_read_suminfo(&rd, &stage->si);
+    else if (stage->hdr.kind == IMPORT_TABLE)
+        r = msi_import_parse_rows(stage, &rd);
+
+done:
+    stage->bytes = rd.bytes;
+    msi_import_reader_close(&rd);
+    return r;
+}
+
+static gpointer msi_import_worker(gpointer data)
+{
+    IMPORTPOOL *pool = data;
+    IMPORTSTAGE *stage;
+    gint i;
+
+    while ((i = g_atomic_int_add (&pool->next, 1)) < (gint)pool->num_stages) {
+        stage = &pool->stages[i];
+        stage->r = msi_import_parse_stage (pool->db, stage);
+        g_async_queue_push (pool->done, stage);
+    }
+
+    return NULL;
+}
+
+/* the staged rows are appended a batch at a time, as for a single
+ * import, so progress moves as steadily */
+static unsigned msi_import_apply_stage(LibmsiDatabase *db, IMPORTSTAGE *stage)
+{
+    LibmsiView *view;
+    unsigned r, i, count, mark;
+
+    switch (stage->hdr.kind)
+    {
+    case IMPORT_CODEPAGE:
+        r = msi_set_string_table_codepage(db->strings, atoi(stage->hdr.types[0]));
+        break;
+    case IMPORT_SUMINFO:
+        r = msi_import_suminfo(db, &stage->si, stage->hdr.num_columns);
+        break;
+    case IMPORT_TABLE:
+        r = msi_import_open_table(db, &stage->hdr, &view);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+
+        mark = msi_string_table_begin_undo(db->strings);
+        for (i = 0; r == LIBMSI_RESULT_SUCCESS && i < stage->num_records; i += count)
+        {
+            count = MIN(IMPORT_BATCH, stage->num_records - i);
+            r = msi_table_append_rows(view, stage->records + i, count, false);
+            if (r == LIBMSI_RESULT_SUCCESS && !msi_progress_update(db, 0, count))
+                r = LIBMSI_RESULT_FUNCTION_FAILED;
+        }
+
+        /* as for a single import, a failed file leaves the table empty */
+        if (r == LIBMSI_RESULT_SUCCESS)
+            r = msi_table_sort_rows(view, 0);
+        else
+            msi_table_discard_rows(view, 0);
+        msi_string_table_end_undo(db->strings, mark, r != LIBMSI_RESULT_SUCCESS);
+        view->ops->delete(view);
+        break;
+    default:
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+        break;
+    }
+
+    if (r == LIBMSI_RESULT_SUCCESS && !msi_progress_update(db, stage->bytes, 0))
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+    return r;
+}
+
+static unsigned _libmsi_database_import_files(LibmsiDatabase *db, const char **paths,
+                                              unsigned n_threads, GError **error)
+{
+    GThread **threads = NULL;
+    IMPORTSTAGE *stage;
+    IMPORTPOOL pool;
+    unsigned r = LIBMSI_RESULT_SUCCESS, i, applied = 0;
+
+    TRACE("%p %u\n", db, n_threads);
+
+    memset (&pool, 0, sizeof(pool));
+    pool.db = db;
+    while (paths[pool.num_stages])
+        pool.num_stages++;
+    if (!pool.num_stages)
+        return LIBMSI_RESULT_SUCCESS;
+
+    pool.stages = msi_alloc_zero (pool.num_stages * sizeof(IMPORTSTAGE));
+    if (!pool.stages)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+    for (i = 0; i < pool.num_stages; i++)
+        pool.stages[i].path = paths[i];
+    pool.done = g_async_queue_new ();
+
+    if (!n_threads)
+        n_threads = g_get_num_processors ();
+    n_threads = MIN (n_threads, pool.num_stages);
+
+    threads = msi_alloc (n_threads * sizeof(GThread *));
+    if (!threads) {
+        r = LIBMSI_RESULT_OUTOFMEMORY;
+        goto end;
+    }
+    for (i = 0; i < n_threads; i++)
+        threads[i] = g_thread_new ("libmsi-import", msi_import_worker, &pool);
+
+    /* the files are applied in the order given as soon as they and
+     * everything before them are parsed, so a later file for the same
+     * table still replaces an earlier one */
+    while (applied < pool.num_stages) {
+        stage = g_async_queue_pop (pool.done);
+        stage->parsed = true;
+
+        while (applied < pool.num_stages && pool.stages[applied].parsed) {
+            stage = &pool.stages[applied];
+            r = stage->r;
+            if (r == LIBMSI_RESULT_SUCCESS)
+                r = msi_import_apply_stage (db, stage);
+            msi_import_free_stage (stage);
+            if (r != LIBMSI_RESULT_SUCCESS)
+                break;
+            applied++;
+        }
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+    }
+
+    if (r != LIBMSI_RESULT_SUCCESS) {
+        /* leave the rest of the files alone */
+        g_atomic_int_set (&pool.next, pool.num_stages);
+        if (!g_cancellable_is_cancelled (db->cancellable))
+            g_set_error (error, LIBMSI_RESULT_ERROR, r,
+                         "failed to import %s", pool.stages[applied].path);
+    }
+
+    for (i = 0; i < n_threads; i++)
+        g_thread_join (threads[i]);
+
+end:
+    for (i = 0; i < pool.num_stages; i++)
+        msi_import_free_stage (&pool.stages[i]);
+    msi_free (threads);
+    msi_free (pool.stages);
+    g_async_queue_unref (pool.done);
+    return r;
+}
+
+/**
+ * libmsi_database_import_files:
+ * @db: a %LibmsiDatabase
+ * @paths: (array zero-terminated=1): %NULL-terminated list of table files
+ * @n_threads: the number of worker threads, or 0 for one per processor
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Imports each of @paths as libmsi_database_import() would.  The
+ * files are read and their rows built by a pool of @n_threads
+ * workers, while the calling thread adds them to the database in the
+ * order given.  Importing stops at the first file that fails.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_import_files (LibmsiDatabase *db,
+                              const char **paths,
+                              guint n_threads,
+                              GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %u\n", db, n_threads);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (paths, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_IMPORT);
+    r = _libmsi_database_import_files (db, paths, n_threads, error);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+static gboolean
+msi_export_stream (GsfInput *gsfin, GFile *table_dir, gchar **str,
+                   GError **error)
+{
+    GError *err = NULL;
+    GFile *file = NULL;
+    GInputStream *in = NULL;
+    GOutputStream *out = NULL;
+    gssize spliced = -1;
+
+    if (!table_dir)
+        goto end;
+
+    if (!g_file_make_directory_with_parents (table_dir, NULL, &err) &&
+        !g_error_matches (err, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+        g_propagate_error (error, err);
+        goto end;
+    }
 
     *str = g_strdup (g_object_get_data (G_OBJECT (gsfin), "stname"));
     file = g_file_get_child (table_dir, *str);
@@ -1219,221 +1903,1290 @@ end:
 
     return spliced != -1;
 
-}
-static unsigned msi_export_record(int fd, LibmsiRecord *row,
-                                  unsigned start, GFile *table_dir,
-                                  GError **error)
-{
-    GsfInput *in = NULL;
-    unsigned i, count;
-    unsigned success = LIBMSI_RESULT_FUNCTION_FAILED;
+}
+/* export output is gathered in a buffer and written in large blocks */
+#define EXPORT_BUFFER_SIZE 65536
+
+typedef struct {
+    int fd;
+    size_t len;
+    guint64 bytes;
+    guint64 rows;
+    bool failed;
+    GMutex *lock;
+    char data[EXPORT_BUFFER_SIZE];
+} EXPORTBUFFER;
+
+static EXPORTBUFFER *msi_export_buffer_new(int fd, GMutex *lock)
+{
+    EXPORTBUFFER *out = msi_alloc (sizeof(EXPORTBUFFER));
+
+    if (!out)
+        return NULL;
+
+    out->fd = fd;
+    out->len = 0;
+    out->bytes = 0;
+    out->rows = 0;
+    out->failed = false;
+    out->lock = lock;
+    return out;
+}
+
+static bool full_write(int fd, const char *buf, size_t sz)
+{
+    while (sz > 0) {
+        ssize_t rc = write (fd, buf, sz);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += rc;
+        sz -= rc;
+    }
+    return true;
+}
+
+static bool msi_export_flush(EXPORTBUFFER *out)
+{
+    if (!out->failed && out->len && !full_write (out->fd, out->data, out->len))
+        out->failed = true;
+    out->len = 0;
+    return !out->failed;
+}
+
+static bool msi_export_write(EXPORTBUFFER *out, const char *data, size_t sz)
+{
+    if (out->len + sz > sizeof(out->data) && !msi_export_flush (out))
+        return false;
+
+    out->bytes += sz;
+    if (sz >= sizeof(out->data)) {
+        if (!full_write (out->fd, data, sz))
+            out->failed = true;
+        return !out->failed;
+    }
+
+    memcpy (out->data + out->len, data, sz);
+    out->len += sz;
+    return true;
+}
+
+static unsigned msi_export_record(EXPORTBUFFER *out, LibmsiRecord *row,
+                                  unsigned start, GError **error)
+{
+    unsigned i, count;
+    unsigned success = LIBMSI_RESULT_FUNCTION_FAILED;
+    char *str;
+
+    count = libmsi_record_get_field_count (row);
+    for (i = start; i <= count; i++) {
+        str = libmsi_record_get_string (row, i);
+        if (!str)
+            goto end;
+
+        if (!msi_export_write (out, str, strlen (str))) {
+            g_free (str);
+            goto end;
+        }
+        g_free (str);
+
+        if (!msi_export_write (out, i < count ? "\t" : "\r\n", i < count ? 1 : 2))
+            goto end;
+    }
+
+    success = LIBMSI_RESULT_SUCCESS;
+
+end:
+    return success;
+}
+
+/* streams are read through the storage, which is shared with the
+ * other export workers when there is a lock */
+static bool msi_export_row_stream(LibmsiView *view, unsigned row, unsigned col,
+                                  EXPORTBUFFER *out, GFile *table_dir,
+                                  GError **error)
+{
+    GsfInput *stm = NULL;
+    char *str = NULL;
+    bool ok = true;
+
+    if (out->lock)
+        g_mutex_lock (out->lock);
+    if (view->ops->fetch_stream (view, row, col, &stm) == LIBMSI_RESULT_SUCCESS && stm) {
+        ok = msi_export_stream (stm, table_dir, &str, error);
+        g_object_unref (stm);
+    }
+    if (out->lock)
+        g_mutex_unlock (out->lock);
+
+    if (ok && str)
+        ok = msi_export_write (out, str, strlen (str));
+    g_free (str);
+    return ok;
+}
+
+/* the rows are read straight from the view, with the column types
+ * looked up once, rather than building a record for every row.  The
+ * query must already be executed; only the view, the loaded table
+ * data and the string table are read, so this may run on a worker */
+static unsigned msi_export_rows(LibmsiDatabase *db, LibmsiQuery *query,
+                                EXPORTBUFFER *out, GFile *table_dir,
+                                GError **error)
+{
+    LibmsiView *view = query->view;
+    unsigned r, i, row, num_rows, num_cols, val, *types = NULL;
+    guint64 bytes;
+    char num[16];
+    char *str;
+
+    r = view->ops->get_dimensions (view, &num_rows, &num_cols);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    types = msi_alloc (num_cols * sizeof(unsigned));
+    if (!types) {
+        r = LIBMSI_RESULT_OUTOFMEMORY;
+        goto end;
+    }
+    for (i = 0; i < num_cols; i++) {
+        r = view->ops->get_column_info (view, i + 1, NULL, &types[i], NULL, NULL);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto end;
+    }
+
+    r = LIBMSI_RESULT_FUNCTION_FAILED;
+    for (row = 0; row < num_rows; row++) {
+        bytes = out->bytes;
+        for (i = 0; i < num_cols; i++) {
+            if (MSITYPE_IS_BINARY (types[i])) {
+                if (!msi_export_row_stream (view, row, i + 1, out, table_dir, error))
+                    goto end;
+            } else {
+                if (view->ops->fetch_int (view, row, i + 1, &val) != LIBMSI_RESULT_SUCCESS)
+                    goto end;
+
+                if (!val)
+                    ;
+                else if (types[i] & MSITYPE_STRING) {
+                    str = (char *)msi_string_lookup_id (db->strings, val);
+                    if (str && !msi_export_write (out, str, strlen (str)))
+                        goto end;
+                } else {
+                    if ((types[i] & MSI_DATASIZEMASK) == 2)
+                        sprintf (num, "%d", (int)(val - (1<<15)));
+                    else
+                        sprintf (num, "%d", (int)(val - (1U<<31)));
+                    if (!msi_export_write (out, num, strlen (num)))
+                        goto end;
+                }
+            }
+
+            if (!msi_export_write (out, i + 1 < num_cols ? "\t" : "\r\n", i + 1 < num_cols ? 1 : 2))
+                goto end;
+        }
+
+        out->rows++;
+        if (out->lock) {
+            /* workers leave the progress reports to the calling thread */
+            if (g_cancellable_is_cancelled (db->cancellable))
+                goto end;
+        } else if (!msi_progress_update (db, out->bytes - bytes, 1))
+            goto end;
+    }
+    r = LIBMSI_RESULT_SUCCESS;
+
+end:
+    msi_free (types);
+    return r;
+}
+
+static LibmsiResult msi_export_forcecodepage( EXPORTBUFFER *out, unsigned codepage )
+{
+    static const char fmt[] = "\r\n\r\n%u\t_ForceCodepage\r\n";
+    char data[sizeof(fmt) + 10];
+    unsigned sz;
+
+    sprintf( data, fmt, codepage );
+
+    sz = strlen(data) + 1;
+    if (!msi_export_write( out, data, sz ))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static LibmsiResult msi_export_summaryinfo (LibmsiDatabase *db, EXPORTBUFFER *out, GError **error)
+{
+    static const char header[] =
+        "PropertyId\tValue\r\ni2\tl255\r\n_SummaryInformation\tPropertyId\r\n";
+    LibmsiResult result = LIBMSI_RESULT_FUNCTION_FAILED;
+    LibmsiSummaryInfo *si = libmsi_summary_info_new (db, 0, error);
+    gchar *str = NULL;
+    int i;
+
+    if (!si)
+        goto end;
+
+    if (!msi_export_write (out, header, strlen (header)))
+        goto end;
+
+    for (i = 0; i < MSI_MAX_PROPS; i++)
+        if (si->property[i].vt != OLEVT_EMPTY) {
+            gchar *val = summary_info_as_string (si, i);
+            if (!val)
+                goto end;
+            str = g_strdup_printf ("%d\t%s\r\n", i, val);
+            if (!msi_export_write (out, str, strlen (str)))
+                goto end;
+            g_free (str);
+            str = NULL;
+        }
+
+    result = LIBMSI_RESULT_SUCCESS;
+
+end:
+    g_free (str);
+    if (si)
+        g_object_unref (si);
+    return result;
+}
+
+/* writes rows 1 to 3 and leaves the query executed, ready for
+ * msi_export_rows() */
+static LibmsiResult msi_export_header(LibmsiDatabase *db, const char *table,
+                                      EXPORTBUFFER *out, LibmsiQuery **pquery,
+                                      GError **error)
+{
+    static const char query[] = "select * from %s";
+    LibmsiRecord *rec = NULL;
+    LibmsiQuery *view = NULL;
+    LibmsiResult r;
+
+    r = _libmsi_query_open( db, &view, query, table );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    /* write out row 1, the column names */
+    r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_NAMES, &rec);
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        msi_export_record( out, rec, 1, error);
+        g_object_unref(rec);
+    }
+
+    /* write out row 2, the column types */
+    r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_TYPES, &rec);
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        msi_export_record( out, rec, 1, error);
+        g_object_unref(rec);
+    }
+
+    /* write out row 3, the table name + keys */
+    r = _libmsi_database_get_primary_keys( db, table, &rec );
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        libmsi_record_set_string( rec, 0, table );
+        msi_export_record( out, rec, 0, error);
+        g_object_unref(rec);
+    }
+
+    r = _libmsi_query_execute (view, NULL);
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        g_object_unref (view);
+        return r;
+    }
+
+    *pquery = view;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static void msi_export_close(LibmsiQuery *query)
+{
+    GError *err = NULL;
+
+    libmsi_query_close (query, &err);
+    if (err) {
+        g_critical ("%s", err->message);
+        g_clear_error (&err);
+    }
+    g_object_unref (query);
+}
+
+static LibmsiResult msi_export_table(LibmsiDatabase *db, const char *table,
+                                     EXPORTBUFFER *out, GFile *table_dir,
+                                     GError **error)
+{
+    LibmsiQuery *view = NULL;
+    LibmsiResult r;
+
+    if (!strcmp(table, "_ForceCodepage")) {
+        unsigned codepage = msi_get_string_table_codepage (db->strings);
+        return msi_export_forcecodepage (out, codepage);
+    } else if (!strcmp (table, "_SummaryInformation")) {
+        return msi_export_summaryinfo (db, out, error);
+    }
+
+    r = msi_export_header (db, table, out, &view, error);
+    if (r == LIBMSI_RESULT_SUCCESS)
+    {
+        /* write out row 4 onwards, the data */
+        r = msi_export_rows (db, view, out, table_dir, error);
+        msi_export_close (view);
+    }
+
+    return r;
+}
+
+static LibmsiResult _libmsi_database_export(LibmsiDatabase *db, const char *table,
+                                        int fd, GError **error)
+{
+    EXPORTBUFFER *out;
+    GFile *table_dir;
+    LibmsiResult r;
+
+    TRACE("%p %s %d\n", db, debugstr_a(table), fd );
+
+    out = msi_export_buffer_new (fd, NULL);
+    if (!out)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    table_dir = g_file_new_for_path (table);
+    r = msi_export_table (db, table, out, table_dir, error);
+    if (!msi_export_flush (out) && r == LIBMSI_RESULT_SUCCESS)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+
+    g_object_unref (table_dir);
+    msi_free (out);
+    return r;
+}
+
+/**
+ * libmsi_database_export:
+ * @db: a %LibmsiDatabase
+ * @table: a table name
+ * @fd: a file descriptor
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Writes a file containing the table data as tab separated ASCII.
+ * The format is as follows:
+ *
+ * row1 : colname1 <tab> colname2 <tab> .... colnameN <cr> <lf>
+ * row2 : coltype1 <tab> coltype2 <tab> .... coltypeN <cr> <lf>
+ * row3 : tablename <tab> key1 <tab> key2 <tab> ... keyM <cr> <lf>
+ *
+ * Followed by the data, starting at row 1 with one row per line
+ *
+ * row4 : data <tab> data <tab> data <tab> ... data <cr> <lf>
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_export (LibmsiDatabase *db,
+                        const char *table,
+                        int fd,
+                        GError **error)
+{
+    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+
+    TRACE("%p %s %d\n", db, table, fd);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (table, FALSE);
+    g_return_val_if_fail (fd >= 0, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_EXPORT);
+    r = _libmsi_database_export (db, table, fd, error);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+typedef struct {
+    char *table;
+    int fd;
+    EXPORTBUFFER *out;
+    LibmsiQuery *query;
+    GFile *table_dir;
+    LibmsiResult r;
+    GError *error;
+} EXPORTJOB;
+
+typedef struct {
+    LibmsiDatabase *db;
+    const char *dir;
+    EXPORTJOB *jobs;
+    unsigned num_jobs;
+    unsigned size;
+    gint next;
+    GMutex lock;
+    GAsyncQueue *done;
+    GError *error;
+} EXPORTPOOL;
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static EXPORTJOB *msi_export_job_new(EXPORTPOOL *pool, const char *table,
+                                     GError **error)
+{
+    EXPORTJOB *job;
+    char *path, *name;
+
+    if (pool->num_jobs == pool->size) {
+        unsigned size = pool->size ? pool->size * 2 : 64;
+        EXPORTJOB *jobs = msi_realloc (pool->jobs, size * sizeof(EXPORTJOB));
+
+        if (!jobs)
+            return NULL;
+        pool->jobs = jobs;
+        pool->size = size;
+    }
+
+    job = &pool->jobs[pool->num_jobs];
+    memset (job, 0, sizeof(EXPORTJOB));
+    job->fd = -1;
+    job->table = strdup (table);
+    if (!job->table)
+        return NULL;
+    pool->num_jobs++;
+
+    name = g_strconcat (table, ".idt", NULL);
+    path = g_build_filename (pool->dir, name, NULL);
+    job->fd = g_open (path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (job->fd < 0)
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                     "%s: %s", path, g_strerror (errno));
+    g_free (name);
+    g_free (path);
+    if (job->fd < 0)
+        return NULL;
+
+    job->out = msi_export_buffer_new (job->fd, &pool->lock);
+    if (!job->out)
+        return NULL;
+
+    path = g_build_filename (pool->dir, table, NULL);
+    job->table_dir = g_file_new_for_path (path);
+    g_free (path);
+    return job;
+}
+
+/* everything that creates or caches state (the query, the loaded
+ * table and the primary keys) happens here on the calling thread, so
+ * the workers only ever read the table data and the string table */
+static unsigned msi_export_queue_table(LibmsiRecord *rec, void *param)
+{
+    EXPORTPOOL *pool = param;
+    const char *table = _libmsi_record_get_string_raw (rec, 1);
+    EXPORTJOB *job;
+    unsigned r;
+
+    job = msi_export_job_new (pool, table, &pool->error);
+    if (!job)
+        return pool->error ? LIBMSI_RESULT_OPEN_FAILED : LIBMSI_RESULT_OUTOFMEMORY;
+
+    r = msi_export_header (pool->db, table, job->out, &job->query, &pool->error);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    return msi_progress_update (pool->db, 0, 0) ? LIBMSI_RESULT_SUCCESS
+                                                : LIBMSI_RESULT_FUNCTION_FAILED;
+}
+
+static gpointer msi_export_worker(gpointer data)
+{
+    EXPORTPOOL *pool = data;
+    EXPORTJOB *job;
+    gint i;
+
+    while ((i = g_atomic_int_add (&pool->next, 1)) < (gint)pool->num_jobs) {
+        job = &pool->jobs[i];
+        job->r = msi_export_rows (pool->db, job->query, job->out,
+                                  job->table_dir, &job->error);
+        if (!msi_export_flush (job->out) && job->r == LIBMSI_RESULT_SUCCESS)
+            job->r = LIBMSI_RESULT_FUNCTION_FAILED;
+        g_async_queue_push (pool->done, job);
+    }
+
+    return NULL;
+}
+
+/* the special tables are read through the storage, before any worker
+ * is started */
+static unsigned msi_export_special(EXPORTPOOL *pool, const char *table)
+{
+    EXPORTJOB *job;
+    unsigned r;
+
+    job = msi_export_job_new (pool, table, &pool->error);
+    if (!job)
+        return pool->error ? LIBMSI_RESULT_OPEN_FAILED : LIBMSI_RESULT_OUTOFMEMORY;
+
+    r = msi_export_table (pool->db, table, job->out, NULL, &pool->error);
+    if (!msi_export_flush (job->out) && r == LIBMSI_RESULT_SUCCESS)
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+    if (r == LIBMSI_RESULT_SUCCESS && !msi_progress_update (pool->db, job->out->bytes, 0))
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+
+    /* done with it, leave it out of the worker queue */
+    close (job->fd);
+    msi_free (job->out);
+    g_object_unref (job->table_dir);
+    msi_free (job->table);
+    pool->num_jobs--;
+    return r;
+}
+
+static unsigned _libmsi_database_export_all(LibmsiDatabase *db, const char *dir,
+                                            unsigned n_threads, GError **error)
+{
+    LibmsiQuery *tables = NULL;
+    GThread **threads = NULL;
+    EXPORTPOOL pool;
+    EXPORTJOB *job;
+    unsigned r, i;
+
+    TRACE("%p %s %u\n", db, debugstr_a(dir), n_threads);
+
+    if (g_mkdir_with_parents (dir, 0777) < 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                     "%s: %s", dir, g_strerror (errno));
+        return LIBMSI_RESULT_OPEN_FAILED;
+    }
+
+    memset (&pool, 0, sizeof(pool));
+    pool.db = db;
+    pool.dir = dir;
+    g_mutex_init (&pool.lock);
+    pool.done = g_async_queue_new ();
+
+    r = msi_export_special (&pool, "_SummaryInformation");
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_export_special (&pool, "_ForceCodepage");
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    r = _libmsi_query_open (db, &tables, "SELECT `Name` FROM `_Tables`");
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+    r = _libmsi_query_iterate_records (tables, NULL, msi_export_queue_table, &pool);
+    g_object_unref (tables);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    if (!n_threads)
+        n_threads = g_get_num_processors ();
+    n_threads = MIN (n_threads, pool.num_jobs);
+
+    threads = msi_alloc (n_threads * sizeof(GThread *));
+    if (!threads && n_threads) {
+        r = LIBMSI_RESULT_OUTOFMEMORY;
+        goto end;
+    }
+    for (i = 0; i < n_threads; i++)
+        threads[i] = g_thread_new ("libmsi-export", msi_export_worker, &pool);
+
+    /* progress is reported from the calling thread, a table at a time */
+    for (i = 0; i < pool.num_jobs; i++) {
+        job = g_async_queue_pop (pool.done);
+        msi_progress_update (db, job->out->bytes, job->out->rows);
+    }
+
+    for (i = 0; i < n_threads; i++)
+        g_thread_join (threads[i]);
+    msi_free (threads);
+
+    for (i = 0; i < pool.num_jobs; i++) {
+        job = &pool.jobs[i];
+        if (job->r == LIBMSI_RESULT_SUCCESS)
+            continue;
+        r = job->r;
+        if (job->error) {
+            g_propagate_error (error, job->error);
+            job->error = NULL;
+        }
+        break;
+    }
+
+end:
+    /* a table's error, when there is one, was reported first */
+    if (pool.error && !(error && *error))
+        g_propagate_error (error, pool.error);
+    else
+        g_clear_error (&pool.error);
+    for (i = 0; i < pool.num_jobs; i++) {
+        job = &pool.jobs[i];
+        if (job->query)
+            msi_export_close (job->query);
+        if (job->fd >= 0)
+            close (job->fd);
+        if (job->table_dir)
+            g_object_unref (job->table_dir);
+        g_clear_error (&job->error);
+        msi_free (job->out);
+        msi_free (job->table);
+    }
+    msi_free (pool.jobs);
+    g_async_queue_unref (pool.done);
+    g_mutex_clear (&pool.lock);
+    return r;
+}
+
+/**
+ * libmsi_database_export_all:
+ * @db: a %LibmsiDatabase
+ * @dir: the directory to write to, created if needed
+ * @n_threads: the number of worker threads, or 0 for one per processor
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Writes every table of @db, along with _SummaryInformation and
+ * _ForceCodepage, to @dir as "TABLE.idt" in the format of
+ * libmsi_database_export().  The streams of a table are written to
+ * the "TABLE" subdirectory of @dir.
+ *
+ * The tables are prepared on the calling thread and their rows are
+ * then written by a pool of @n_threads workers.  Progress is reported
+ * from the calling thread once each table is done.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_export_all (LibmsiDatabase *db,
+                            const char *dir,
+                            guint n_threads,
+                            GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %s %u\n", db, dir, n_threads);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (dir, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_EXPORT);
+    r = _libmsi_database_export_all (db, dir, n_threads, error);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+/* a script is tokenized once, up front, and split into statements at
+ * semicolons or at the keyword that starts the next statement */
+#define SCRIPT_SEMICOLON -1
+
+typedef struct {
+    int type;
+    const char *str;
+    unsigned len;
+    unsigned line;
+} SCRIPTTOKEN;
+
+typedef struct {
+    bool is_string;
+    const char *str;
+    unsigned len;
+    int ival;
+} SCRIPTPARAM;
+
+typedef struct {
+    LibmsiQuery *query;
+    unsigned uses;
+} SCRIPTPLAN;
+
+typedef struct {
+    int type;
+    unsigned line;
+    char *text;
+    char *key;
+    SCRIPTPARAM *params;
+    unsigned num_params;
+    SCRIPTPLAN *plan;
+} SCRIPTSTMT;
+
+static bool msi_script_starts_statement(int type)
+{
+    switch (type)
+    {
+    case TK_ALTER: case TK_CREATE: case TK_DELETE: case TK_DROP:
+    case TK_INSERT: case TK_SELECT: case TK_UPDATE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static unsigned msi_script_tokenize(const char *script, SCRIPTTOKEN **tokens,
+                                    unsigned *num_tokens)
+{
+    unsigned size = 0, line = 1;
+    const char *p = script;
+    SCRIPTTOKEN *tok;
+    int type, skip, len;
+
+    *tokens = NULL;
+    *num_tokens = 0;
+    while (*p)
+    {
+        skip = 0;
+        if (*p == ';')
+        {
+            type = SCRIPT_SEMICOLON;
+            len = 1;
+        }
+        else if (*p == '\r')
+        {
+            type = TK_SPACE;
+            len = 1;
+        }
+        else
+        {
+            len = sql_get_token(p, &type, &skip);
+            if (len <= 0)
+            {
+                type = TK_ILLEGAL;
+                len = strlen(p);
+            }
+        }
+
+        if (type != TK_SPACE)
+        {
+            if (*num_tokens == size)
+            {
+                size = size ? size * 2 : 256;
+                tok = msi_realloc(*tokens, size * sizeof(SCRIPTTOKEN));
+                if (!tok)
+                    return LIBMSI_RESULT_OUTOFMEMORY;
+                *tokens = tok;
+            }
+
+            tok = &(*tokens)[(*num_tokens)++];
+            tok->type = type;
+            tok->str = p;
+            tok->len = len;
+            tok->line = line;
+        }
+
+        for (len += skip; len > 0 && *p; len--)
+            if (*p++ == '\n')
+                line++;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* the literals of an INSERT's values and an UPDATE's assignments
+ * become markers, where they mean exactly what the literal would;
+ * everywhere else they stay part of the statement */
+static bool msi_script_parameterize(SCRIPTSTMT *stmt, const SCRIPTTOKEN *tok,
+                                    unsigned count, GString *key)
+{
+    unsigned i, j, val, depth = 0;
+    bool in_values = false;
+    SCRIPTPARAM *param;
+    bool negative;
+
+    if (tok[0].type != TK_INSERT && tok[0].type != TK_UPDATE)
+        return false;
+
+    stmt->params = msi_alloc(count * sizeof(SCRIPTPARAM));
+    if (!stmt->params)
+        return false;
+
+    for (i = 0; i < count; i++)
+    {
+        if (tok[i].type == TK_WILDCARD)
+            return false;
+
+        if (tok[0].type == TK_INSERT && tok[i].type == TK_VALUES)
+            in_values = true;
+        else if (tok[0].type == TK_UPDATE && tok[i].type == TK_SET)
+            in_values = true;
+        else if (tok[0].type == TK_UPDATE && tok[i].type == TK_WHERE)
+            in_values = false;
+        else if (in_values && tok[i].type == TK_LP)
+            depth++;
+        else if (in_values && tok[i].type == TK_RP && tok[0].type == TK_INSERT && !--depth)
+            in_values = false;
+        else if (in_values && (tok[i].type == TK_STRING || tok[i].type == TK_INTEGER ||
+                               (tok[i].type == TK_MINUS && i + 1 < count &&
+                                tok[i + 1].type == TK_INTEGER)))
+        {
+            param = &stmt->params[stmt->num_params++];
+            param->is_string = tok[i].type == TK_STRING;
+            if (param->is_string)
+            {
+                if (tok[i].len < 2 || tok[i].str[tok[i].len - 1] != '\'')
+                    return false;
+                param->str = tok[i].str + 1;
+                param->len = tok[i].len - 2;
+            }
+            else
+            {
+                negative = tok[i].type == TK_MINUS;
+                if (negative)
+                    i++;
+
+                for (j = val = 0; j < tok[i].len; j++)
+                {
+                    if (!g_ascii_isdigit(tok[i].str[j]))
+                        return false;
+                    val = val * 10 + (tok[i].str[j] - '0');
+                }
+                param->ival = negative ? -(int)val : (int)val;
+            }
+
+            g_string_append(key, "? ");
+            continue;
+        }
+
+        g_string_append_len(key, tok[i].str, tok[i].len);
+        g_string_append_c(key, ' ');
+    }
+
+    return true;
+}
+
+static void msi_script_add_statement(SCRIPTSTMT *stmt, const SCRIPTTOKEN *tok,
+                                     unsigned count, GHashTable *plans)
+{
+    SCRIPTPLAN *plan;
+    GString *str;
+    unsigned i;
+
+    memset(stmt, 0, sizeof(*stmt));
+    stmt->type = tok[0].type;
+    stmt->line = tok[0].line;
+
+    str = g_string_new(NULL);
+    for (i = 0; i < count; i++)
+    {
+        g_string_append_len(str, tok[i].str, tok[i].len);
+        g_string_append_c(str, ' ');
+    }
+    stmt->text = g_string_free(str, FALSE);
+
+    str = g_string_new(NULL);
+    if (!msi_script_parameterize(stmt, tok, count, str))
+    {
+        g_string_free(str, TRUE);
+        msi_free(stmt->params);
+        stmt->params = NULL;
+        stmt->num_params = 0;
+        return;
+    }
+
+    stmt->key = g_string_free(str, FALSE);
+    plan = g_hash_table_lookup(plans, stmt->key);
+    if (!plan)
+    {
+        plan = g_new0(SCRIPTPLAN, 1);
+        g_hash_table_insert(plans, g_strdup(stmt->key), plan);
+    }
+    plan->uses++;
+    stmt->plan = plan;
+}
+
+static void msi_script_free_plan(gpointer data)
+{
+    SCRIPTPLAN *plan = data;
+
+    if (plan->query)
+        g_object_unref(plan->query);
+    g_free(plan);
+}
+
+static void msi_script_forget_plan(gpointer key, gpointer value, gpointer user_data)
+{
+    SCRIPTPLAN *plan = value;
+
+    g_clear_object(&plan->query);
+}
+
+static LibmsiRecord *msi_script_params(const SCRIPTSTMT *stmt)
+{
+    LibmsiRecord *rec;
+    unsigned i;
+    char *str;
+
+    rec = libmsi_record_new(stmt->num_params);
+    for (i = 0; i < stmt->num_params; i++)
+    {
+        if (!stmt->params[i].is_string)
+        {
+            libmsi_record_set_int(rec, i + 1, stmt->params[i].ival);
+            continue;
+        }
+
+        str = g_strndup(stmt->params[i].str, stmt->params[i].len);
+        libmsi_record_set_string(rec, i + 1, str);
+        g_free(str);
+    }
+
+    return rec;
+}
+
+static unsigned msi_script_execute(LibmsiDatabase *db, SCRIPTSTMT *stmt, GHashTable *plans)
+{
+    LibmsiQuery *query;
+    LibmsiRecord *rec = NULL;
+    GError *err = NULL;
+    unsigned r;
+
+    /* a shape seen only once is not worth a plan of its own */
+    if (stmt->plan && stmt->plan->uses > 1)
+    {
+        if (!stmt->plan->query)
+        {
+            stmt->plan->query = libmsi_query_new(db, stmt->key, &err);
+            if (!stmt->plan->query)
+                goto failed;
+        }
+        query = g_object_ref(stmt->plan->query);
+        if (stmt->num_params)
+            rec = msi_script_params(stmt);
+    }
+    else
+    {
+        query = libmsi_query_new(db, stmt->text, &err);
+        if (!query)
+            goto failed;
+
+        /* the plans may refer to tables that are about to change */
+        if (stmt->type == TK_CREATE || stmt->type == TK_ALTER || stmt->type == TK_DROP)
+            g_hash_table_foreach(plans, msi_script_forget_plan, NULL);
+    }
+
+    r = _libmsi_query_execute(query, rec);
+    libmsi_query_close(query, NULL);
+    g_object_unref(query);
+    if (rec)
+        g_object_unref(rec);
+    return r;
+
+failed:
+    r = err ? err->code : LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+    g_clear_error(&err);
+    return r;
+}
+
+static unsigned _libmsi_database_execute_script(LibmsiDatabase *db, const char *script,
+                                                GError **error)
+{
+    SCRIPTSTMT *stmts = NULL;
+    SCRIPTTOKEN *tokens;
+    GHashTable *plans;
+    struct list saved;
+    unsigned r, i, start, num_tokens, num_stmts = 0, mark;
+
+    TRACE("%p %s\n", db, debugstr_a(script));
+
+    r = msi_script_tokenize(script, &tokens, &num_tokens);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    stmts = msi_alloc(MAX(num_tokens, 1) * sizeof(SCRIPTSTMT));
+    if (!stmts)
+    {
+        r = LIBMSI_RESULT_OUTOFMEMORY;
+        goto end;
+    }
 
-    count = libmsi_record_get_field_count (row);
-    for (i = start; i <= count; i++) {
-        char *str;
+    plans = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, msi_script_free_plan);
+    for (i = start = 0; i <= num_tokens; i++)
+    {
+        if (i < num_tokens && tokens[i].type != SCRIPT_SEMICOLON &&
+            (i == start || !msi_script_starts_statement(tokens[i].type)))
+            continue;
 
-        _libmsi_record_get_gsf_input (row, i, &in);
-        if (in) {
-            if (!msi_export_stream (in, table_dir, &str, error))
-                goto end;
-            g_object_unref (in);
-            in = NULL;
-        } else {
-            str = libmsi_record_get_string (row, i);
-            if (!str)
-                goto end;
-        }
+        if (i > start)
+            msi_script_add_statement(&stmts[num_stmts++], tokens + start, i - start, plans);
+        start = i < num_tokens && tokens[i].type == SCRIPT_SEMICOLON ? i + 1 : i;
+    }
 
-        /* TODO full_write */
-        if (write (fd, str, strlen (str)) != strlen (str)) {
-            g_free (str);
-            goto end;
-        }
+    /* a failing script leaves the tables as they were before it */
+    r = msi_save_cached_tables(db, &saved);
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        g_hash_table_unref(plans);
+        goto end;
+    }
+    mark = msi_string_table_begin_undo(db->strings);
 
-        g_free (str);
+    for (i = 0; i < num_stmts; i++)
+    {
+        r = msi_script_execute(db, &stmts[i], plans);
+        if (r == LIBMSI_RESULT_SUCCESS && !msi_progress_update(db, strlen(stmts[i].text), 1))
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+        if (r == LIBMSI_RESULT_SUCCESS)
+            continue;
 
-        const char *sep = (i < count) ? "\t" : "\r\n";
-        if (write (fd, sep, strlen (sep)) != strlen (sep))
-            goto end;
+        if (!g_cancellable_is_cancelled(db->cancellable))
+            g_set_error(error, LIBMSI_RESULT_ERROR, r, "statement %u, line %u: %s",
+                        i + 1, stmts[i].line, stmts[i].text);
+        break;
     }
+    g_hash_table_unref(plans);
 
-    success = LIBMSI_RESULT_SUCCESS;
+    if (r != LIBMSI_RESULT_SUCCESS)
+        msi_restore_cached_tables(db, &saved);
+    msi_free_saved_tables(&saved);
+    msi_string_table_end_undo(db->strings, mark, r != LIBMSI_RESULT_SUCCESS);
 
 end:
-    if (in)
-        g_object_unref (in);
-
-    return success;
+    for (i = 0; i < num_stmts; i++)
+    {
+        g_free(stmts[i].text);
+        g_free(stmts[i].key);
+        msi_free(stmts[i].params);
+    }
+    msi_free(stmts);
+    msi_free(tokens);
+    return r;
 }
 
-typedef struct _ExportRow {
-    int fd;
-    GFile *table_dir;
-    GError **error;
-} ExportRow;
-
-static unsigned msi_export_row( LibmsiRecord *row, void *arg )
+/**
+ * libmsi_database_execute_script:
+ * @db: a %LibmsiDatabase
+ * @script: SQL statements
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Runs each statement of @script in turn.  Statements are separated
+ * by semicolons, or end where the keyword starting the next one
+ * begins.
+ *
+ * The script is tokenized once.  INSERT and UPDATE statements that
+ * differ only in their values share a single parsed query.  All the
+ * statements go into the same pending transaction of @db, which is
+ * not committed.  Execution stops at the first statement that fails;
+ * the error message gives its number, its line and its text, and the
+ * tables of @db are left as they were before the call.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_execute_script (LibmsiDatabase *db,
+                                const char *script,
+                                GError **error)
 {
-    ExportRow *export = arg;
+    unsigned r;
+
+    TRACE("%p %s\n", db, debugstr_a(script));
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (script, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_EXECUTE_SCRIPT);
+    r = _libmsi_database_execute_script (db, script, error);
+    g_object_unref(db);
 
-    return msi_export_record (export->fd, row, 1,
-                              export->table_dir, export->error);
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
 }
 
-static LibmsiResult msi_export_forcecodepage( int fd, unsigned codepage )
+/* the table column of each of @columns, 1-based */
+static unsigned msi_insert_map_columns(LibmsiView *view, const char *table,
+                                       const char **columns, unsigned *map,
+                                       unsigned num_cols, GError **error)
 {
-    static const char fmt[] = "\r\n\r\n%u\t_ForceCodepage\r\n";
-    char data[sizeof(fmt) + 10];
-    unsigned sz;
+    unsigned r, i, j;
+    const char *name;
 
-    sprintf( data, fmt, codepage );
+    for (i = 0; columns[i]; i++)
+    {
+        for (j = 1; j <= num_cols; j++)
+        {
+            r = view->ops->get_column_info(view, j, &name, NULL, NULL, NULL);
+            if (r != LIBMSI_RESULT_SUCCESS)
+                return r;
+            if (!strcmp(name, columns[i]))
+                break;
+        }
 
-    sz = strlen(data) + 1;
-    if (write( fd, data, sz ) != sz)
-        return LIBMSI_RESULT_FUNCTION_FAILED;
+        if (j > num_cols)
+        {
+            g_set_error(error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_BAD_QUERY_SYNTAX,
+                        "table %s has no column %s", table, columns[i]);
+            return LIBMSI_RESULT_BAD_QUERY_SYNTAX;
+        }
+        map[i] = j;
+    }
 
     return LIBMSI_RESULT_SUCCESS;
 }
 
-static LibmsiResult msi_export_summaryinfo (LibmsiDatabase *db, int fd, GError **error)
+static unsigned _libmsi_database_insert_records(LibmsiDatabase *db, const char *table,
+                                                const char **columns,
+                                                LibmsiRecord **records, unsigned n_records,
+                                                GError **error)
 {
-    static const char header[] =
-        "PropertyId\tValue\r\ni2\tl255\r\n_SummaryInformation\tPropertyId\r\n";
-    LibmsiResult result = LIBMSI_RESULT_FUNCTION_FAILED;
-    LibmsiSummaryInfo *si = libmsi_summary_info_new (db, 0, error);
-    gchar *str = NULL;
-    gssize sz;
-    int i;
-
-    if (!si)
-        goto end;
+    LibmsiRecord **arranged = NULL;
+    LibmsiView *view;
+    unsigned *map = NULL;
+    unsigned r, i, j, num_rows, num_cols, num_fields, mark;
+    bool in_order;
 
-    sz = strlen (header);
-    if (write (fd, header, sz) != sz)
-        goto end;
+    TRACE("%p %s %u\n", db, debugstr_a(table), n_records);
 
-    for (i = 0; i < MSI_MAX_PROPS; i++)
-        if (si->property[i].vt != OLEVT_EMPTY) {
-            gchar *val = summary_info_as_string (si, i);
-            if (!val)
-                goto end;
-            str = g_strdup_printf ("%d\t%s\r\n", i, val);
-            sz = strlen (str);
-            if (write (fd, str, sz) != sz)
-                goto end;
-            g_free (str);
-            str = NULL;
-        }
+    if (!table_view_exists(db, table))
+    {
+        g_set_error(error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_TABLE,
+                    "table %s does not exist", table);
+        return LIBMSI_RESULT_INVALID_TABLE;
+    }
 
-    result = LIBMSI_RESULT_SUCCESS;
+    r = table_view_create(db, table, &view);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
 
-end:
-    g_free (str);
-    if (si)
-        g_object_unref (si);
-    return result;
-}
+    r = view->ops->get_dimensions(view, &num_rows, &num_cols);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
 
-static LibmsiResult _libmsi_database_export(LibmsiDatabase *db, const char *table,
-                                        int fd, GError **error)
-{
-    static const char query[] = "select * from %s";
-    LibmsiRecord *rec = NULL;
-    LibmsiQuery *view = NULL;
-    LibmsiResult r;
+    num_fields = num_cols;
+    in_order = true;
+    if (columns)
+    {
+        num_fields = g_strv_length((char **)columns);
+        map = msi_alloc(MAX(num_fields, 1) * sizeof(unsigned));
+        if (!map)
+        {
+            r = LIBMSI_RESULT_OUTOFMEMORY;
+            goto end;
+        }
 
-    TRACE("%p %s %d\n", db, debugstr_a(table), fd );
+        r = msi_insert_map_columns(view, table, columns, map, num_cols, error);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto end;
 
-    if (!strcmp(table, "_ForceCodepage")) {
-        unsigned codepage = msi_get_string_table_codepage (db->strings);
-        return msi_export_forcecodepage (fd, codepage);
-    } else if (!strcmp (table, "_SummaryInformation")) {
-        return msi_export_summaryinfo (db, fd, error);
+        in_order = num_fields == num_cols;
+        for (i = 0; in_order && i < num_fields; i++)
+            in_order = map[i] == i + 1;
     }
 
-    r = _libmsi_query_open( db, &view, query, table );
-    if (r == LIBMSI_RESULT_SUCCESS)
+    for (i = 0; i < n_records; i++)
     {
-        /* write out row 1, the column names */
-        r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_NAMES, &rec);
-        if (r == LIBMSI_RESULT_SUCCESS)
+        if (libmsi_record_get_field_count(records[i]) != num_fields)
         {
-            msi_export_record( fd, rec, 1, NULL, error);
-            g_object_unref(rec);
+            r = LIBMSI_RESULT_INVALID_PARAMETER;
+            g_set_error(error, LIBMSI_RESULT_ERROR, r,
+                        "record %u has %u fields instead of %u", i,
+                        libmsi_record_get_field_count(records[i]), num_fields);
+            goto end;
         }
+    }
 
-        /* write out row 2, the column types */
-        r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_TYPES, &rec);
-        if (r == LIBMSI_RESULT_SUCCESS)
+    /* columns left out are NULL, as with INSERT */
+    if (!in_order)
+    {
+        arranged = msi_alloc_zero(MAX(n_records, 1) * sizeof(LibmsiRecord *));
+        if (!arranged)
         {
-            msi_export_record( fd, rec, 1, NULL, error);
-            g_object_unref(rec);
+            r = LIBMSI_RESULT_OUTOFMEMORY;
+            goto end;
         }
 
-        /* write out row 3, the table name + keys */
-        r = _libmsi_database_get_primary_keys( db, table, &rec );
-        if (r == LIBMSI_RESULT_SUCCESS)
+        for (i = 0; i < n_records; i++)
         {
-            libmsi_record_set_string( rec, 0, table );
-            msi_export_record( fd, rec, 0, NULL, error);
-            g_object_unref(rec);
+            arranged[i] = libmsi_record_new(num_cols);
+            for (j = 0; j < num_fields; j++)
+                _libmsi_record_copy_field(records[i], j + 1, arranged[i], map[j]);
         }
+        records = arranged;
+    }
 
-        /* write out row 4 onwards, the data */
-        ExportRow export = {
-            .fd = fd,
-            .table_dir = g_file_new_for_path (table),
-            .error = error
-        };
-        r = _libmsi_query_iterate_records( view, 0, msi_export_row, &export);
-
-        g_object_unref (export.table_dir);
-        g_object_unref (view);
+    /* one append, which refuses duplicate keys before storing a thing,
+     * and one sort; cancelling afterwards would leave the rows in */
+    if (g_cancellable_is_cancelled(db->cancellable))
+    {
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+        goto end;
     }
 
+    mark = msi_string_table_begin_undo(db->strings);
+    r = msi_table_append_rows(view, records, n_records, false);
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_table_sort_rows(view, num_rows);
+    msi_string_table_end_undo(db->strings, mark, r != LIBMSI_RESULT_SUCCESS);
+    if (r == LIBMSI_RESULT_SUCCESS)
+        msi_progress_update(db, 0, n_records);
+
+end:
+    if (arranged)
+    {
+        for (i = 0; i < n_records; i++)
+            g_object_unref(arranged[i]);
+        msi_free(arranged);
+    }
+    msi_free(map);
+    view->ops->delete(view);
     return r;
 }
 
 /**
- * libmsi_database_export:
+ * libmsi_database_insert_records:
  * @db: a %LibmsiDatabase
- * @table: a table name
- * @fd: a file descriptor
+ * @table: the name of an existing table
+ * @columns: (array zero-terminated=1) (allow-none): the column of each
+ * record field, or %NULL for all the columns of @table in order
+ * @records: (array length=n_records): the rows to add
+ * @n_records: the number of @records
  * @error: (allow-none): #GError to set on error, or %NULL
  *
- * Writes a file containing the table data as tab separated ASCII.
- * The format is as follows:
- *
- * row1 : colname1 <tab> colname2 <tab> .... colnameN <cr> <lf>
- * row2 : coltype1 <tab> coltype2 <tab> .... coltypeN <cr> <lf>
- * row3 : tablename <tab> key1 <tab> key2 <tab> ... keyM <cr> <lf>
- *
- * Followed by the data, starting at row 1 with one row per line
+ * Adds @records to @table, as an INSERT query run on each of them
+ * would, but without going through SQL.  Field n of every record goes
+ * in the n-th of @columns; the columns not given are left NULL.
  *
- * row4 : data <tab> data <tab> data <tab> ... data <cr> <lf>
+ * The rows are appended and the table is sorted once.  If a primary
+ * key is already in the table, or is given twice, no row is added.
  *
  * Returns: %TRUE on success
  **/
 gboolean
-libmsi_database_export (LibmsiDatabase *db,
-                        const char *table,
-                        int fd,
-                        GError **error)
+libmsi_database_insert_records (LibmsiDatabase *db,
+                                const char *table,
+                                const char **columns,
+                                LibmsiRecord **records,
+                                guint n_records,
+                                GError **error)
 {
-    unsigned r = LIBMSI_RESULT_OUTOFMEMORY;
+    unsigned r;
 
-    TRACE("%p %s %d\n", db, table, fd);
+    TRACE("%p %s %u\n", db, debugstr_a(table), n_records);
 
     g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
     g_return_val_if_fail (table, FALSE);
-    g_return_val_if_fail (fd >= 0, FALSE);
+    g_return_val_if_fail (records || !n_records, FALSE);
     g_return_val_if_fail (!error || *error == NULL, FALSE);
 
     g_object_ref(db);
-    r = _libmsi_database_export (db, table, fd, error);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_INSERT_RECORDS);
+    r = _libmsi_database_insert_records (db, table, columns, records, n_records, error);
     g_object_unref(db);
 
-    if (r != LIBMSI_RESULT_SUCCESS && error && !*error)
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
         g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
 
     return r == LIBMSI_RESULT_SUCCESS;
@@ -1451,6 +3204,7 @@ typedef struct _tagMERGETABLE
     unsigned numtypes;
     char **labels;
     unsigned numlabels;
+    unsigned numrows;
 } MERGETABLE;
 
 typedef struct _tagMERGEROW
@@ -1464,7 +3218,9 @@ typedef struct _tagMERGEDATA
     LibmsiDatabase *db;
     LibmsiDatabase *merge;
     MERGETABLE *curtable;
-    LibmsiQuery *curview;
+    GHashTable *dbrows;
+    unsigned *keycols;
+    unsigned numkeys;
     struct list *tabledata;
 } MERGEDATA;
 
@@ -1577,64 +3333,38 @@ done:
     return r;
 }
 
-static char *get_key_value(LibmsiQuery *view, const char *key, LibmsiRecord *rec)
+/* the primary key of a row, as a byte string usable as a hash key;
+ * field types are tagged so that 1 and '1' stay distinct */
+static GBytes *merge_row_key(LibmsiRecord *rec, const unsigned *keycols, unsigned numkeys)
 {
-    LibmsiRecord *colnames;
-    char *str;
-    unsigned r, i = 0;
-    int cmp;
-
-    r = _libmsi_query_get_column_info(view, LIBMSI_COL_INFO_NAMES, &colnames);
-    if (r != LIBMSI_RESULT_SUCCESS)
-        return NULL;
+    GString *key = g_string_sized_new(64);
+    const char *str;
+    unsigned i;
+    gsize len;
 
-    do
+    for (i = 0; i < numkeys; i++)
     {
-        str = msi_dup_record_field(colnames, ++i);
-        cmp = strcmp( key, str );
-        msi_free(str);
-    } while (cmp);
-
-    g_object_unref(colnames);
-
-    if (_libmsi_record_get_string_raw(rec, i))  /* check record field is a string */
-        /* quote string record fields */
-        str = g_strdup_printf ("'%s'", _libmsi_record_get_string_raw (rec, i));
-    else
-        str = libmsi_record_get_string (rec, i);
+        if (libmsi_record_is_null(rec, keycols[i]))
+            g_string_append_c(key, 'n');
+        else if ((str = _libmsi_record_get_string_raw(rec, keycols[i])))
+            g_string_append_printf(key, "s%s", str);
+        else
+            g_string_append_printf(key, "i%d", libmsi_record_get_int(rec, keycols[i]));
+        g_string_append_c(key, '\0');
+    }
 
-    return str;
+    len = key->len;
+    return g_bytes_new_take(g_string_free(key, FALSE), len);
 }
 
-static char *create_diff_row_query(LibmsiDatabase *merge, LibmsiQuery *view,
-                                    char *table, LibmsiRecord *rec)
+static unsigned merge_index_row(LibmsiRecord *rec, void *param)
 {
-    GString *query;
-    char *val;
-    const char *key;
-    LibmsiRecord *keys;
-    unsigned r, i, count;
-
-    r = _libmsi_database_get_primary_keys(merge, table, &keys);
-    if (r != LIBMSI_RESULT_SUCCESS)
-        return NULL;
-
-    query = g_string_sized_new(256);
-    g_string_printf (query, "SELECT * FROM %s WHERE ", table);
-    count = libmsi_record_get_field_count(keys);
-    for (i = 1; i <= count; i++)
-    {
-        key = _libmsi_record_get_string_raw(keys, i);
-        val = get_key_value(view, key, rec);
-
-        if (i == count)
-            g_string_append_printf (query, "`%s` = %s", key, val);
-        else
-            g_string_append_printf (query, "`%s` = %s AND ", key, val);
-    }
+    MERGEDATA *data = param;
 
-    g_object_unref(keys);
-    return  g_string_free (query, FALSE);
+    g_hash_table_replace(data->dbrows,
+                         merge_row_key(rec, data->keycols, data->numkeys),
+                         g_object_ref(rec));
+    return LIBMSI_RESULT_SUCCESS;
 }
 
 static unsigned merge_diff_row(LibmsiRecord *rec, void *param)
@@ -1642,63 +3372,41 @@ static unsigned merge_diff_row(LibmsiRecord *rec, void *param)
     MERGEDATA *data = param;
     MERGETABLE *table = data->curtable;
     MERGEROW *mergerow;
-    LibmsiQuery *dbview = NULL;
     LibmsiRecord *row = NULL;
-    char *query = NULL;
-    unsigned r = LIBMSI_RESULT_SUCCESS;
-    GError *err = NULL;
-
-    if (table_view_exists(data->db, table->name))
-    {
-        query = create_diff_row_query(data->merge, data->curview, table->name, rec);
-        if (!query)
-            return LIBMSI_RESULT_OUTOFMEMORY;
+    GBytes *key;
 
-        dbview = libmsi_query_new(data->db, query, &err);
-        if (err)
-            goto done;
+    if (!msi_progress_update(data->db, 0, 0))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
 
-        r = _libmsi_query_execute(dbview, NULL);
-        if (r != LIBMSI_RESULT_SUCCESS)
-            goto done;
+    if (data->dbrows)
+    {
+        key = merge_row_key(rec, data->keycols, data->numkeys);
+        row = g_hash_table_lookup(data->dbrows, key);
+        g_bytes_unref(key);
 
-        r = _libmsi_query_fetch(dbview, &row);
-        if (r == LIBMSI_RESULT_SUCCESS && !_libmsi_record_compare(rec, row))
+        if (row)
         {
-            table->numconflicts++;
-            goto done;
+            /* identical rows are already there, different ones conflict */
+            if (!_libmsi_record_compare(rec, row))
+                table->numconflicts++;
+            return LIBMSI_RESULT_SUCCESS;
         }
-        else if (r != NO_MORE_ITEMS)
-            goto done;
-
-        r = LIBMSI_RESULT_SUCCESS;
     }
 
     mergerow = msi_alloc(sizeof(MERGEROW));
     if (!mergerow)
-    {
-        r = LIBMSI_RESULT_OUTOFMEMORY;
-        goto done;
-    }
+        return LIBMSI_RESULT_OUTOFMEMORY;
 
     mergerow->data = _libmsi_record_clone(rec);
     if (!mergerow->data)
     {
-        r = LIBMSI_RESULT_OUTOFMEMORY;
         msi_free(mergerow);
-        goto done;
+        return LIBMSI_RESULT_OUTOFMEMORY;
     }
 
     list_add_tail(&table->rows, &mergerow->entry);
-
-done:
-    if (err)
-        g_critical("%s", err->message);
-    g_clear_error(&err);
-    msi_free(query);
-    g_object_unref(row);
-    g_object_unref(dbview);
-    return r;
+    table->numrows++;
+    return LIBMSI_RESULT_SUCCESS;
 }
 
 static unsigned msi_get_table_labels(LibmsiDatabase *db, const char *table, char ***labels, unsigned *numlabels)
@@ -1796,7 +3504,7 @@ static void merge_free_rows(MERGETABLE *table)
         MERGEROW *row = LIST_ENTRY(item, MERGEROW, entry);
 
         list_remove(&row->entry);
-        g_object_unref(row);
+        g_object_unref(row->data);
         msi_free(row);
     }
 }
@@ -1882,10 +3590,38 @@ err:
     return r;
 }
 
+/* map the primary keys of the merged table to its column numbers */
+static unsigned merge_key_columns(MERGETABLE *table, unsigned **keycols, unsigned *numkeys)
+{
+    unsigned i, j;
+
+    *numkeys = table->numlabels - 1;
+    *keycols = msi_alloc(*numkeys * sizeof(unsigned));
+    if (!*keycols)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
+    for (i = 0; i < *numkeys; i++)
+    {
+        for (j = 0; j < table->numcolumns; j++)
+            if (!strcmp(table->labels[i + 1], table->columns[j]))
+                break;
+
+        if (j == table->numcolumns)
+        {
+            msi_free(*keycols);
+            *keycols = NULL;
+            return LIBMSI_RESULT_DATATYPE_MISMATCH;
+        }
+        (*keycols)[i] = j + 1;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 static unsigned merge_diff_tables(LibmsiRecord *rec, void *param)
 {
     MERGEDATA *data = param;
-    MERGETABLE *table;
+    MERGETABLE *table = NULL;
     LibmsiQuery *dbview = NULL;
     LibmsiQuery *mergeview = NULL;
     const char *name;
@@ -1914,22 +3650,42 @@ static unsigned merge_diff_tables(LibmsiRecord *rec, void *param)
             goto done;
     }
 
-    r = msi_get_merge_table(data->merge, name, &table);
-    if (r != LIBMSI_RESULT_SUCCESS)
-        goto done;
-
+    r = msi_get_merge_table(data->merge, name, &table);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    r = merge_key_columns(table, &data->keycols, &data->numkeys);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    /* index the existing rows by primary key once, instead of
+     * querying the database for every merged row */
+    if (dbview)
+    {
+        data->dbrows = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                             (GDestroyNotify)g_bytes_unref,
+                                             g_object_unref);
+        r = _libmsi_query_iterate_records(dbview, NULL, merge_index_row, data);
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto done;
+    }
+
     data->curtable = table;
-    data->curview = mergeview;
     r = _libmsi_query_iterate_records(mergeview, NULL, merge_diff_row, data);
     if (r != LIBMSI_RESULT_SUCCESS)
-    {
-        free_merge_table(table);
         goto done;
-    }
 
     list_add_tail(data->tabledata, &table->entry);
+    table = NULL;
 
 done:
+    if (table)
+        free_merge_table(table);
+    if (data->dbrows)
+        g_hash_table_destroy(data->dbrows);
+    data->dbrows = NULL;
+    msi_free(data->keycols);
+    data->keycols = NULL;
     g_object_unref(dbview);
     g_object_unref(mergeview);
     return r;
@@ -1949,6 +3705,10 @@ static unsigned gather_merge_data(LibmsiDatabase *db, LibmsiDatabase *merge,
 
     data.db = db;
     data.merge = merge;
+    data.curtable = NULL;
+    data.dbrows = NULL;
+    data.keycols = NULL;
+    data.numkeys = 0;
     data.tabledata = tabledata;
     r = _libmsi_query_iterate_records(view, NULL, merge_diff_tables, &data);
     g_object_unref(view);
@@ -1957,9 +3717,9 @@ static unsigned gather_merge_data(LibmsiDatabase *db, LibmsiDatabase *merge,
 
 static unsigned merge_table(LibmsiDatabase *db, MERGETABLE *table)
 {
-    unsigned r;
+    LibmsiRecord **recs;
     MERGEROW *row;
-    LibmsiView *tv;
+    unsigned r, n = 0;
 
     if (!table_view_exists(db, table->name))
     {
@@ -1969,18 +3729,23 @@ static unsigned merge_table(LibmsiDatabase *db, MERGETABLE *table)
            return LIBMSI_RESULT_FUNCTION_FAILED;
     }
 
+    if (!table->numrows)
+        return LIBMSI_RESULT_SUCCESS;
+
+    recs = msi_alloc(table->numrows * sizeof(LibmsiRecord *));
+    if (!recs)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+
     LIST_FOR_EACH_ENTRY(row, &table->rows, MERGEROW, entry)
-    {
-        r = table_view_create(db, table->name, &tv);
-        if (r != LIBMSI_RESULT_SUCCESS)
-            return r;
+        recs[n++] = row->data;
 
-        r = tv->ops->insert_row(tv, row->data, -1, false);
-        tv->ops->delete(tv);
+    r = msi_table_insert_rows(db, table->name, recs, n, false);
+    msi_free(recs);
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
 
-        if (r != LIBMSI_RESULT_SUCCESS)
-            return r;
-    }
+    if (!msi_progress_update(db, 0, n))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -2049,6 +3814,7 @@ libmsi_database_merge (LibmsiDatabase *db,
 
     g_object_ref(db);
     g_object_ref(merge);
+    msi_progress_begin(db, LIBMSI_PROGRESS_OPERATION_MERGE);
     r = gather_merge_data(db, merge, &tabledata);
     if (r != LIBMSI_RESULT_SUCCESS)
         goto done;
@@ -2084,7 +3850,8 @@ libmsi_database_merge (LibmsiDatabase *db,
         r = LIBMSI_RESULT_FUNCTION_FAILED;
 
 done:
-    if (r != LIBMSI_RESULT_SUCCESS)
+    if (r != LIBMSI_RESULT_SUCCESS &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
         g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
     g_object_unref(db);
     g_object_unref(merge);
@@ -2148,6 +3915,21 @@ static void cache_infile_structure( LibmsiDatabase *db )
     }
 }
 
+static GsfInput *msi_input_new_from_bytes( GBytes *bytes )
+{
+    gsize size;
+    const guint8 *data = g_bytes_get_data( bytes, &size );
+    GsfInput *in;
+
+    in = gsf_input_memory_new( data, size, FALSE );
+    if (in)
+        /* keep the data alive as long as any stream refers to it */
+        g_object_set_data_full( G_OBJECT(in), "libmsi-bytes",
+                                g_bytes_ref( bytes ),
+                                (GDestroyNotify)g_bytes_unref );
+    return in;
+}
+
 LibmsiResult _libmsi_database_open(LibmsiDatabase *db)
 {
     GsfInput *in;
@@ -2157,7 +3939,10 @@ LibmsiResult _libmsi_database_open(LibmsiDatabase *db)
 
     TRACE("%p %s\n", db, db->path);
 
-    in = gsf_input_stdio_new(db->path, NULL);
+    if (db->bytes)
+        in = msi_input_new_from_bytes( db->bytes );
+    else
+        in = gsf_input_stdio_new(db->path, NULL);
     if (!in)
     {
         g_warning("open file failed for %s\n", debugstr_a(db->path));
@@ -2213,6 +3998,269 @@ end:
     return ret;
 }
 
+/*
+ * A snapshot holds a database as it is in memory once opened, so that
+ * it can be mapped back without parsing the storage, decoding the
+ * string pool or transposing the tables:
+ *
+ *   the magic, format version and string reference width
+ *   the size, modification time and SHA-256 hash of the source file
+ *   the offsets of the table, string and stream sections, and the size
+ *
+ * The sections are written by msi_table_save_snapshot(),
+ * msi_string_table_save_snapshot() and msi_streams_save_snapshot().
+ */
+#define SNAPSHOT_MAGIC "LIBMSI\x1aS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SOURCE 16
+#define SNAPSHOT_SOURCE_SIZE 48
+#define SNAPSHOT_HEADER_SIZE 96
+
+static unsigned msi_snapshot_source( const char *path, uint8_t *id, GError **error )
+{
+    GMappedFile *file;
+    GChecksum *checksum;
+    GStatBuf st;
+    gsize len = 32;
+    guint64 val;
+
+    if (g_stat( path, &st ) < 0)
+    {
+        g_set_error( error, G_IO_ERROR, g_io_error_from_errno( errno ),
+                     "%s: %s", path, g_strerror( errno ) );
+        return LIBMSI_RESULT_OPEN_FAILED;
+    }
+
+    file = g_mapped_file_new( path, FALSE, error );
+    if (!file)
+        return LIBMSI_RESULT_OPEN_FAILED;
+
+    val = GUINT64_TO_LE( st.st_size );
+    memcpy( id, &val, sizeof(val) );
+    val = GUINT64_TO_LE( st.st_mtime );
+    memcpy( id + 8, &val, sizeof(val) );
+
+    checksum = g_checksum_new( G_CHECKSUM_SHA256 );
+    g_checksum_update( checksum, (const guchar *)g_mapped_file_get_contents( file ),
+                       g_mapped_file_get_length( file ) );
+    g_checksum_get_digest( checksum, id + 16, &len );
+    g_checksum_free( checksum );
+    g_mapped_file_unref( file );
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/*
+ * The snapshot of the streams keeps their data next to each other:
+ *
+ *   the stream count, as a 64-bit value
+ *   per stream, the 64-bit offsets of its name and data, and its size
+ *   the names and the data
+ */
+static unsigned msi_streams_save_snapshot( LibmsiDatabase *db, GByteArray *out )
+{
+    LibmsiStream *stream;
+    GsfInput *in;
+    gsize start = out->len, pos;
+    gsf_off_t size;
+    guint count;
+
+    count = list_count( &db->streams );
+    msi_snapshot_put64( out, count );
+    pos = out->len;
+    g_byte_array_set_size( out, out->len + count * 24 );
+
+    LIST_FOR_EACH_ENTRY( stream, &db->streams, LibmsiStream, entry )
+    {
+        msi_snapshot_set64( out, pos, out->len - start );
+        g_byte_array_append( out, (const uint8_t *)stream->name, strlen( stream->name ) + 1 );
+
+        in = gsf_input_dup( stream->stm, NULL );
+        if (!in)
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+        size = gsf_input_size( in );
+        msi_snapshot_set64( out, pos + 8, out->len - start );
+        msi_snapshot_set64( out, pos + 16, size );
+
+        g_byte_array_set_size( out, out->len + size );
+        gsf_input_seek( in, 0, G_SEEK_SET );
+        if (size && !gsf_input_read( in, size, out->data + out->len - size ))
+        {
+            g_warning("failed to read stream %s\n", debugstr_a(stream->name));
+            g_object_unref( in );
+            return LIBMSI_RESULT_FUNCTION_FAILED;
+        }
+        g_object_unref( in );
+        pos += 24;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* the streams read from the mapping, and keep it alive */
+static unsigned msi_streams_open_snapshot( LibmsiDatabase *db, const uint8_t *data, gsize size )
+{
+    guint64 count, i, name_offset, offset, len;
+    const char *name;
+    GsfInput *stm;
+    unsigned r;
+
+    if (size < 8)
+        return LIBMSI_RESULT_INVALID_DATA;
+
+    count = msi_snapshot_get64( data );
+    if (count > (size - 8) / 24)
+        return LIBMSI_RESULT_INVALID_DATA;
+
+    for (i = 0; i < count; i++)
+    {
+        name_offset = msi_snapshot_get64( data + 8 + i * 24 );
+        offset = msi_snapshot_get64( data + 8 + i * 24 + 8 );
+        len = msi_snapshot_get64( data + 8 + i * 24 + 16 );
+
+        name = msi_snapshot_name( data, size, name_offset );
+        if (!name || offset > size || len > size - offset)
+            return LIBMSI_RESULT_INVALID_DATA;
+
+        stm = gsf_input_memory_new( data + offset, len, FALSE );
+        if (!stm)
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        g_object_set_data_full( G_OBJECT(stm), "libmsi-snapshot",
+                                g_mapped_file_ref( db->snapshot ),
+                                (GDestroyNotify)g_mapped_file_unref );
+        r = msi_alloc_stream( db, name, stm );
+        g_object_unref( stm );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned _libmsi_database_save_snapshot( LibmsiDatabase *db, const char *path,
+                                                GError **error )
+{
+    GByteArray *out;
+    unsigned r;
+
+    TRACE("%p %s\n", db, debugstr_a(path));
+
+    if (!db->path || db->bytes || db->snapshot)
+    {
+        g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_PARAMETER,
+                     "the database was not opened from a file" );
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+    }
+    if (msi_tables_modified( db ) || msi_string_table_is_modified( db->strings ) ||
+        !list_empty( &db->transforms ))
+    {
+        g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_ACCESS_DENIED,
+                     "the database has changes that are not in %s", db->path );
+        return LIBMSI_RESULT_ACCESS_DENIED;
+    }
+    if (!list_empty( &db->storages ))
+    {
+        g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_CALL_NOT_IMPLEMENTED,
+                     "snapshots of databases with storages are not supported" );
+        return LIBMSI_RESULT_CALL_NOT_IMPLEMENTED;
+    }
+
+    out = g_byte_array_sized_new( SNAPSHOT_HEADER_SIZE );
+    g_byte_array_set_size( out, SNAPSHOT_HEADER_SIZE );
+    memset( out->data, 0, SNAPSHOT_HEADER_SIZE );
+    memcpy( out->data, SNAPSHOT_MAGIC, 8 );
+    msi_snapshot_set32( out, 8, SNAPSHOT_VERSION );
+    msi_snapshot_set32( out, 12, db->bytes_per_strref );
+
+    r = msi_snapshot_source( db->path, out->data + SNAPSHOT_SOURCE, error );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    msi_snapshot_set64( out, 64, out->len );
+    r = msi_table_save_snapshot( db, out );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    msi_snapshot_align( out );
+    msi_snapshot_set64( out, 72, out->len );
+    msi_string_table_save_snapshot( db->strings, out );
+
+    msi_snapshot_align( out );
+    msi_snapshot_set64( out, 80, out->len );
+    r = msi_streams_save_snapshot( db, out );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+    msi_snapshot_set64( out, 88, out->len );
+
+    if (!g_file_set_contents( path, (const char *)out->data, out->len, error ))
+        r = LIBMSI_RESULT_OPEN_FAILED;
+
+end:
+    g_byte_array_unref( out );
+    return r;
+}
+
+static unsigned _libmsi_database_open_snapshot( LibmsiDatabase *db, GError **error )
+{
+    uint8_t source[SNAPSHOT_SOURCE_SIZE];
+    guint64 tables, strings, streams;
+    const uint8_t *data;
+    GStatBuf st;
+    gsize size;
+    unsigned r;
+
+    TRACE("%p %s %s\n", db, debugstr_a(db->snapshot_path), debugstr_a(db->path));
+
+    db->snapshot = g_mapped_file_new( db->snapshot_path, TRUE, error );
+    if (!db->snapshot)
+        return LIBMSI_RESULT_OPEN_FAILED;
+
+    data = (const uint8_t *)g_mapped_file_get_contents( db->snapshot );
+    size = g_mapped_file_get_length( db->snapshot );
+    if (size < SNAPSHOT_HEADER_SIZE || memcmp( data, SNAPSHOT_MAGIC, 8 ) ||
+        msi_snapshot_get32( data + 8 ) != SNAPSHOT_VERSION)
+    {
+        g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_DATA,
+                     "%s is not a database snapshot", db->snapshot_path );
+        return LIBMSI_RESULT_INVALID_DATA;
+    }
+
+    /* the size and time are checked before hashing the whole file */
+    if (g_stat( db->path, &st ) < 0 ||
+        (guint64)st.st_size != msi_snapshot_get64( data + SNAPSHOT_SOURCE ) ||
+        (guint64)st.st_mtime != msi_snapshot_get64( data + SNAPSHOT_SOURCE + 8 ) ||
+        msi_snapshot_source( db->path, source, NULL ) != LIBMSI_RESULT_SUCCESS ||
+        memcmp( source, data + SNAPSHOT_SOURCE, SNAPSHOT_SOURCE_SIZE ))
+    {
+        g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_DATA,
+                     "snapshot %s is out of date with %s", db->snapshot_path, db->path );
+        return LIBMSI_RESULT_INVALID_DATA;
+    }
+
+    tables = msi_snapshot_get64( data + 64 );
+    strings = msi_snapshot_get64( data + 72 );
+    streams = msi_snapshot_get64( data + 80 );
+    if (msi_snapshot_get64( data + 88 ) != size || tables < SNAPSHOT_HEADER_SIZE ||
+        tables > strings || strings > streams || streams > size)
+        goto corrupt;
+
+    db->bytes_per_strref = msi_snapshot_get32( data + 12 );
+    db->strings = msi_string_table_open_snapshot( data + strings, streams - strings );
+    if (!db->strings)
+        goto corrupt;
+
+    r = msi_table_open_snapshot( db, data + tables, strings - tables );
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_streams_open_snapshot( db, data + streams, size - streams );
+    if (r == LIBMSI_RESULT_INVALID_DATA || r == LIBMSI_RESULT_FUNCTION_FAILED)
+        goto corrupt;
+    return r;
+
+corrupt:
+    g_set_error( error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_DATA,
+                 "snapshot %s is corrupt", db->snapshot_path );
+    return LIBMSI_RESULT_INVALID_DATA;
+}
+
 unsigned _libmsi_database_apply_transform( LibmsiDatabase *db,
                  const char *szTransformFile )
 {
@@ -2231,58 +4279,325 @@ unsigned _libmsi_database_apply_transform( LibmsiDatabase *db,
     stg = gsf_infile_msole_new( in, NULL );
     g_object_unref(G_OBJECT(in));
 
-    if( !gsf_infile_msole_get_class_id (GSF_INFILE_MSOLE(stg), uuid))
-    {
-        g_warning("FIXME: Failed to stat storage\n");
-        goto end;
-    }
+    if( !gsf_infile_msole_get_class_id (GSF_INFILE_MSOLE(stg), uuid))
+    {
+        g_warning("FIXME: Failed to stat storage\n");
+        goto end;
+    }
+
+    if ( memcmp( uuid, clsid_msi_transform, 16 ) != 0 )
+        goto end;
+
+    if (TRACE_ON && stg)
+        enum_stream_names( stg );
+
+    ret = msi_table_apply_transform( db, stg );
+
+end:
+    g_object_unref(G_OBJECT(stg));
+
+    return ret;
+}
+
+/**
+ * libmsi_database_apply_transform:
+ * @db: a %LibmsiDatabase
+ * @file: an MST transform file path
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * FIXME
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_apply_transform (LibmsiDatabase *db,
+                                 const char *file,
+                                 GError **error)
+{
+    unsigned r;
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (file, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_APPLY_TRANSFORM);
+    r = _libmsi_database_apply_transform (db, file);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned _libmsi_database_generate_transform( LibmsiDatabase *db,
+                 LibmsiDatabase *ref, const char *path )
+{
+    unsigned ret;
+    GsfOutput *out;
+    GsfOutfile *stg;
+
+    TRACE("%p %p %s\n", db, ref, debugstr_a(path));
+
+    out = gsf_output_stdio_new(path, NULL);
+    if (!out)
+    {
+        g_warning("open file failed for transform %s\n", debugstr_a(path));
+        return LIBMSI_RESULT_OPEN_FAILED;
+    }
+
+    stg = gsf_outfile_msole_new(out);
+    g_object_unref(G_OBJECT(out));
+    if (!stg)
+        return LIBMSI_RESULT_OPEN_FAILED;
+
+    if (!gsf_outfile_msole_set_class_id(GSF_OUTFILE_MSOLE(stg), clsid_msi_transform))
+        ret = LIBMSI_RESULT_FUNCTION_FAILED;
+    else
+        ret = msi_table_generate_transform( db, ref, stg );
+
+    if (!gsf_output_close(GSF_OUTPUT(stg)) && ret == LIBMSI_RESULT_SUCCESS)
+        ret = LIBMSI_RESULT_FUNCTION_FAILED;
+    g_object_unref(G_OBJECT(stg));
+
+    if (ret != LIBMSI_RESULT_SUCCESS)
+        unlink( path );
+    return ret;
+}
+
+/**
+ * libmsi_database_generate_transform:
+ * @db: a %LibmsiDatabase
+ * @reference: the %LibmsiDatabase the transform applies to
+ * @path: the MST transform file to write
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Write a transform that turns @reference into @db: applying it to
+ * @reference with libmsi_database_apply_transform() gives the tables
+ * and rows of @db.  Columns may be added at the end of a table, but
+ * not removed or retyped.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_generate_transform (LibmsiDatabase *db,
+                                    LibmsiDatabase *reference,
+                                    const char *path,
+                                    GError **error)
+{
+    unsigned r;
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (reference), FALSE);
+    g_return_val_if_fail (path, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    g_object_ref(reference);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_GENERATE_TRANSFORM);
+    r = _libmsi_database_generate_transform (db, reference, path);
+    g_object_unref(reference);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, "failed to generate transform %s", path);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+void msi_progress_begin( LibmsiDatabase *db, LibmsiProgressOperation op )
+{
+    db->progress_operation = op;
+    db->progress_bytes = 0;
+    db->progress_rows = 0;
+}
+
+/* accumulates the work done by the current operation and reports it;
+ * returns false when the operation should stop because it was cancelled */
+bool msi_progress_update( LibmsiDatabase *db, guint64 bytes, guint64 rows )
+{
+    db->progress_bytes += bytes;
+    db->progress_rows += rows;
+
+    if (db->progress_func && (bytes || rows))
+        db->progress_func (db, db->progress_operation,
+                           db->progress_bytes, db->progress_rows,
+                           db->progress_data);
+
+    return !g_cancellable_is_cancelled (db->cancellable);
+}
+
+/**
+ * libmsi_database_set_progress_callback:
+ * @db: a #LibmsiDatabase
+ * @func: (allow-none) (scope notified): a #LibmsiProgressFunc, or %NULL
+ * @user_data: (closure): the data to pass to @func
+ * @notify: (allow-none): function to free @user_data, or %NULL
+ *
+ * Set a function to be called as commit, import, export, merge and
+ * transform operations make progress.  Any previously set callback
+ * is replaced.
+ **/
+void
+libmsi_database_set_progress_callback (LibmsiDatabase *db,
+                                       LibmsiProgressFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify)
+{
+    g_return_if_fail (LIBMSI_IS_DATABASE (db));
+
+    if (db->progress_notify)
+        db->progress_notify (db->progress_data);
+
+    db->progress_func = func;
+    db->progress_data = user_data;
+    db->progress_notify = notify;
+}
+
+/**
+ * libmsi_database_set_cancellable:
+ * @db: a #LibmsiDatabase
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ *
+ * Set a #GCancellable checked by long running operations on @db.
+ * When it is triggered, the operation stops as soon as possible and
+ * fails with %G_IO_ERROR_CANCELLED.  A cancelled commit leaves the
+ * file on disk untouched, and @db as it was, so the commit can be
+ * tried again.
+ **/
+void
+libmsi_database_set_cancellable (LibmsiDatabase *db,
+                                 GCancellable *cancellable)
+{
+    g_return_if_fail (LIBMSI_IS_DATABASE (db));
+    g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+    if (cancellable)
+        g_object_ref (cancellable);
+    g_clear_object (&db->cancellable);
+    db->cancellable = cancellable;
+}
+
+/**
+ * libmsi_database_get_stats:
+ * @db: a #LibmsiDatabase
+ *
+ * Report the memory held by @db, table by table, and how much work
+ * was done since it was opened.
+ *
+ * Returns: (transfer full): a new #LibmsiDatabaseStats, free it with
+ * libmsi_database_stats_free()
+ **/
+LibmsiDatabaseStats *
+libmsi_database_get_stats (LibmsiDatabase *db)
+{
+    LibmsiDatabaseStats *stats;
+    LibmsiStream *stream;
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), NULL);
 
-    if ( memcmp( uuid, clsid_msi_transform, 16 ) != 0 )
-        goto end;
+    stats = g_new0 (LibmsiDatabaseStats, 1);
+    msi_get_table_stats (db, &stats->tables, &stats->n_tables);
+    if (db->strings)
+        msi_string_table_get_stats (db->strings, &stats->string_pool_bytes,
+                                    &stats->string_count);
+
+    /* streams read from the file are not buffered, written ones are */
+    LIST_FOR_EACH_ENTRY (stream, &db->streams, LibmsiStream, entry)
+        if (GSF_IS_INPUT_MEMORY (stream->stm) &&
+            !g_object_get_data (G_OBJECT (stream->stm), "libmsi-snapshot"))
+            stats->stream_bytes += gsf_input_size (stream->stm);
+
+    if (db->bytes)
+        stats->image_bytes = g_bytes_get_size (db->bytes);
+    if (db->snapshot)
+        stats->image_bytes += g_mapped_file_get_length (db->snapshot);
+    if (db->outmem)
+        stats->image_bytes += gsf_output_size (db->outmem);
+
+    stats->table_loads = db->n_table_loads;
+    stats->index_builds = db->n_index_builds;
+    stats->query_parses = db->n_query_parses;
+    stats->commits = db->n_commits;
+
+    return stats;
+}
 
-    if (TRACE_ON && stg)
-        enum_stream_names( stg );
+/**
+ * libmsi_database_stats_copy:
+ * @stats: a #LibmsiDatabaseStats
+ *
+ * Returns: (transfer full): a copy of @stats
+ **/
+LibmsiDatabaseStats *
+libmsi_database_stats_copy (const LibmsiDatabaseStats *stats)
+{
+    LibmsiDatabaseStats *copy;
+    guint i;
 
-    ret = msi_table_apply_transform( db, stg );
+    g_return_val_if_fail (stats != NULL, NULL);
 
-end:
-    g_object_unref(G_OBJECT(stg));
+    copy = g_memdup (stats, sizeof (*stats));
+    copy->tables = g_memdup (stats->tables,
+                             stats->n_tables * sizeof (LibmsiTableStats));
+    for (i = 0; i < stats->n_tables; i++)
+        copy->tables[i].name = g_strdup (stats->tables[i].name);
 
-    return ret;
+    return copy;
 }
 
 /**
- * libmsi_database_apply_transform:
- * @db: a %LibmsiDatabase
- * @file: an MST transform file path
- * @error: (allow-none): #GError to set on error, or %NULL
+ * libmsi_database_stats_free:
+ * @stats: a #LibmsiDatabaseStats
  *
- * FIXME
- *
- * Returns: %TRUE on success
+ * Free @stats and the table statistics it holds.
  **/
-gboolean
-libmsi_database_apply_transform (LibmsiDatabase *db,
-                                 const char *file,
-                                 GError **error)
+void
+libmsi_database_stats_free (LibmsiDatabaseStats *stats)
 {
-    unsigned r;
+    guint i;
 
-    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
-    g_return_val_if_fail (file, FALSE);
-    g_return_val_if_fail (!error || *error == NULL, FALSE);
+    if (!stats)
+        return;
 
-    g_object_ref(db);
-    r = _libmsi_database_apply_transform (db, file);
-    g_object_unref(db);
+    for (i = 0; i < stats->n_tables; i++)
+        g_free (stats->tables[i].name);
+    g_free (stats->tables);
+    g_free (stats);
+}
 
-    if (r != LIBMSI_RESULT_SUCCESS)
-        g_set_error_literal (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+/* gsf_input_copy() moves data 4k at a time; big chunks read straight
+ * from the input's own buffer make copying large cabinets much cheaper */
+#define STREAM_COPY_CHUNK (1024 * 1024)
 
-    return r == LIBMSI_RESULT_SUCCESS;
+bool copy_stream_data( LibmsiDatabase *db, GsfInput *in, GsfOutput *out )
+{
+    gsf_off_t remaining;
+
+    if (gsf_input_seek( in, 0, G_SEEK_SET ))
+        return false;
+
+    remaining = gsf_input_size( in );
+    while (remaining > 0)
+    {
+        size_t count = MIN( remaining, STREAM_COPY_CHUNK );
+        const guint8 *data = gsf_input_read( in, count, NULL );
+
+        if (!data || !gsf_output_write( out, count, data ))
+            return false;
+        remaining -= count;
+
+        if (!msi_progress_update( db, count, 0 ))
+            return false;
+    }
+
+    return true;
 }
 
-static int gsf_infile_copy(GsfInfile *inf, GsfOutfile *outf)
+static int gsf_infile_copy(LibmsiDatabase *db, GsfInfile *inf, GsfOutfile *outf)
 {
     int n = gsf_infile_num_children(inf);
     int i;
@@ -2296,9 +4611,9 @@ static int gsf_infile_copy(GsfInfile *inf, GsfOutfile *outf)
         gboolean ok;
 
         if (is_dir)
-            ok = gsf_infile_copy(childf, GSF_OUTFILE(dest));
+            ok = gsf_infile_copy(db, childf, GSF_OUTFILE(dest));
         else
-            ok = gsf_input_copy(child, dest);
+            ok = copy_stream_data(db, child, dest);
 
         g_object_unref(G_OBJECT(child));
         g_object_unref(G_OBJECT(dest));
@@ -2320,7 +4635,7 @@ static unsigned commit_storage( const char *name, GsfInfile *stg, void *opaque)
     if ( !outstg )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
-    if ( !gsf_infile_copy( stg, outstg ) )
+    if ( !gsf_infile_copy( db, stg, outstg ) )
         goto end;
 
     ret = LIBMSI_RESULT_SUCCESS;
@@ -2345,9 +4660,8 @@ static unsigned commit_stream( const char *name, GsfInput *stm, void *opaque)
     if ( !outstm )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
-    gsf_input_seek (stm, 0, G_SEEK_SET);
     gsf_output_seek (outstm, 0, G_SEEK_SET);
-    if ( !gsf_input_copy( stm, outstm ))
+    if ( !copy_stream_data( db, stm, outstm ))
         goto end;
 
     ret = LIBMSI_RESULT_SUCCESS;
@@ -2358,74 +4672,204 @@ end:
     return ret;
 }
 
-/**
- * libmsi_database_commit:
- * @db: a #LibmsiDatabase
- * @error: (allow-none): #GError to set on error, or %NULL
- *
- * Returns: %TRUE on success.
- **/
-gboolean
-libmsi_database_commit (LibmsiDatabase *db, GError **error)
+/* the streams written so far can't be taken back out of the outfile,
+ * so a commit that failed starts the next one over in a fresh one; the
+ * file it was writing is dropped rather than renamed over the target */
+static void msi_discard_output( LibmsiDatabase *db )
+{
+    if (db->outsink)
+        gsf_output_set_error(db->outsink, 0, "commit abandoned");
+    if (db->outfile)
+    {
+        gsf_output_close(GSF_OUTPUT(db->outfile));
+        g_object_unref(G_OBJECT(db->outfile));
+        db->outfile = NULL;
+    }
+    g_clear_object(&db->outsink);
+    if (db->outmem)
+    {
+        g_object_unref(G_OBJECT(db->outmem));
+        db->outmem = NULL;
+    }
+
+    if (_libmsi_database_start_transaction(db) != LIBMSI_RESULT_SUCCESS)
+        g_warning("failed to restart the transaction\n");
+}
+
+static gboolean
+_libmsi_database_commit (LibmsiDatabase *db, GCancellable *cancellable,
+                         GError **error)
 {
+    GCancellable *saved_cancellable = db->cancellable;
     unsigned r = LIBMSI_RESULT_SUCCESS;
     unsigned bytes_per_strref;
+    const char *what = "database";
 
     TRACE ("%p\n", db);
 
-    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
-    g_return_val_if_fail (!error || *error == NULL, FALSE);
-
     g_object_ref(db);
     if (db->flags & LIBMSI_DB_FLAGS_READONLY)
         goto end;
 
-    /* FIXME: lock the database */
+    /* an explicit cancellable (from commit_async) takes precedence
+     * over the one set with libmsi_database_set_cancellable() */
+    if (cancellable)
+        db->cancellable = cancellable;
 
-    r = msi_save_string_table (db->strings, db, &bytes_per_strref);
-    if (r != LIBMSI_RESULT_SUCCESS) {
-        g_set_error (error, LIBMSI_RESULT_ERROR, r,
-                     "failed to save string table r=%08x\n", r);
+    msi_progress_begin (db, LIBMSI_PROGRESS_OPERATION_COMMIT);
+    if (!msi_progress_update (db, 0, 0)) {
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
         goto end;
     }
 
+    /* FIXME: lock the database */
+
+    /* an unchanged string table keeps its ids, so unmodified tables
+     * can be copied over without being decoded */
+    what = "string table";
+    r = LIBMSI_RESULT_NOT_FOUND;
+    if (!msi_string_table_is_modified (db->strings))
+        r = msi_copy_raw_stream (db, szStringPool);
+    if (r == LIBMSI_RESULT_SUCCESS) {
+        bytes_per_strref = db->bytes_per_strref;
+        r = msi_copy_raw_stream (db, szStringData);
+    } else if (r == LIBMSI_RESULT_NOT_FOUND) {
+        /* nothing was written yet */
+        r = msi_save_string_table (db->strings, db->outfile, &bytes_per_strref);
+    }
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto end;
+
+    what = "storages";
     r = msi_enum_db_storages (db, commit_storage, db);
-    if (r != LIBMSI_RESULT_SUCCESS) {
-        g_set_error (error, LIBMSI_RESULT_ERROR, r,
-                     "failed to save storages r=%08x\n", r);
+    if (r != LIBMSI_RESULT_SUCCESS)
         goto end;
-    }
 
+    what = "streams";
     r = msi_enum_db_streams (db, commit_stream, db);
-    if (r != LIBMSI_RESULT_SUCCESS) {
-        g_set_error (error, LIBMSI_RESULT_ERROR, r,
-                     "failed to save streams r=%08x\n", r);
+    if (r != LIBMSI_RESULT_SUCCESS)
         goto end;
-    }
 
+    what = "tables";
     r = _libmsi_database_commit_tables (db, bytes_per_strref);
-    if (r != LIBMSI_RESULT_SUCCESS) {
-        g_set_error (error, LIBMSI_RESULT_ERROR, r,
-                     "failed to save tables r=%08x\n", r);
+    if (r != LIBMSI_RESULT_SUCCESS)
         goto end;
-    }
 
     db->bytes_per_strref = bytes_per_strref;
+    db->n_commits++;
+    free_cached_tables(db);
 
     /* FIXME: unlock the database */
 
-    _libmsi_database_close(db, true);
+    what = "output stream";
+    r = _libmsi_database_close(db, true);
     db->flags &= ~LIBMSI_DB_FLAGS_CREATE;
     db->flags |= LIBMSI_DB_FLAGS_TRANSACT;
     _libmsi_database_open(db);
     _libmsi_database_start_transaction(db);
 
 end:
+    if (r != LIBMSI_RESULT_SUCCESS && db->outfile)
+        msi_discard_output (db);
+
+    if (r != LIBMSI_RESULT_SUCCESS &&
+        !g_cancellable_set_error_if_cancelled (db->cancellable, error))
+        g_set_error (error, LIBMSI_RESULT_ERROR, r,
+                     "failed to save %s r=%08x\n", what, r);
+
+    db->cancellable = saved_cancellable;
     g_object_unref(db);
 
     return r == LIBMSI_RESULT_SUCCESS;
 }
 
+/**
+ * libmsi_database_commit:
+ * @db: a #LibmsiDatabase
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Returns: %TRUE on success.
+ **/
+gboolean
+libmsi_database_commit (LibmsiDatabase *db, GError **error)
+{
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    return _libmsi_database_commit (db, NULL, error);
+}
+
+static void
+commit_thread (GTask *task, gpointer source_object,
+               gpointer task_data, GCancellable *cancellable)
+{
+    LibmsiDatabase *db = source_object;
+    GError *error = NULL;
+
+    if (_libmsi_database_commit (db, cancellable, &error))
+        g_task_return_boolean (task, TRUE);
+    else if (error)
+        g_task_return_error (task, error);
+    else
+        g_task_return_new_error (task, LIBMSI_RESULT_ERROR,
+                                 LIBMSI_RESULT_FUNCTION_FAILED, G_STRFUNC);
+}
+
+/**
+ * libmsi_database_commit_async:
+ * @db: a #LibmsiDatabase
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the commit is done
+ * @user_data: (closure): the data to pass to callback function
+ *
+ * Asynchronously commit the database, in a worker thread.  @db must
+ * not be used until @callback is called.  The progress callback set
+ * with libmsi_database_set_progress_callback() is called from that
+ * worker thread.
+ *
+ * When the operation is finished, @callback will be called.  You can
+ * then call libmsi_database_commit_finish() to get the result.
+ **/
+void
+libmsi_database_commit_async (LibmsiDatabase *db,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+    GTask *task;
+
+    g_return_if_fail (LIBMSI_IS_DATABASE (db));
+    g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+    task = g_task_new (db, cancellable, callback, user_data);
+    g_task_set_source_tag (task, libmsi_database_commit_async);
+    g_task_run_in_thread (task, commit_thread);
+    g_object_unref (task);
+}
+
+/**
+ * libmsi_database_commit_finish:
+ * @db: a #LibmsiDatabase
+ * @result: a #GAsyncResult
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Finishes an asynchronous commit started with
+ * libmsi_database_commit_async().
+ *
+ * Returns: %TRUE on success.
+ **/
+gboolean
+libmsi_database_commit_finish (LibmsiDatabase *db,
+                               GAsyncResult *result,
+                               GError **error)
+{
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (g_task_is_valid (result, db), FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 struct msi_primary_key_record_info
 {
     unsigned n;
@@ -2563,17 +5007,40 @@ libmsi_database_is_table_persistent (LibmsiDatabase *db, const char *table,
     return r == LIBMSI_CONDITION_TRUE;
 }
 
-/* TODO: use GInitable */
 static gboolean
-init (LibmsiDatabase *self, GError **error)
+libmsi_database_initable_init (GInitable *initable,
+                               GCancellable *cancellable,
+                               GError **error)
 {
+    LibmsiDatabase *self = LIBMSI_DATABASE (initable);
     LibmsiResult ret;
 
+    const char *name = self->path ? self->path : "in-memory database";
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
     if (self->flags & LIBMSI_DB_FLAGS_CREATE) {
         self->strings = msi_init_string_table (&self->bytes_per_strref);
+    } else if (self->snapshot_path) {
+        ret = _libmsi_database_open_snapshot (self, error);
+        if (ret) {
+            if (error && !*error)
+                g_set_error (error, LIBMSI_RESULT_ERROR, ret,
+                             "failed to open snapshot %s", self->snapshot_path);
+            return FALSE;
+        }
+    } else if (!self->path && !self->bytes) {
+        g_set_error (error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_PARAMETER,
+                     "no path or data to open");
+        return FALSE;
     } else {
-        if (_libmsi_database_open(self))
+        ret = _libmsi_database_open (self);
+        if (ret) {
+            g_set_error (error, LIBMSI_RESULT_ERROR, ret,
+                         "failed to open %s", name);
             return FALSE;
+        }
     }
 
     self->media_transform_offset = MSI_INITIAL_MEDIA_TRANSFORM_OFFSET;
@@ -2583,8 +5050,19 @@ init (LibmsiDatabase *self, GError **error)
         enum_stream_names (self->infile);
 
     ret = _libmsi_database_start_transaction (self);
+    if (ret) {
+        g_set_error (error, LIBMSI_RESULT_ERROR, ret,
+                     "failed to start transaction on %s", name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
 
-    return !ret;
+static void
+libmsi_database_initable_iface_init (GInitableIface *iface)
+{
+    iface->init = libmsi_database_initable_init;
 }
 
 /**
@@ -2604,21 +5082,221 @@ libmsi_database_new (const gchar *path,
                      const char *persist,
                      GError **error)
 {
-    LibmsiDatabase *self;
-
     g_return_val_if_fail (path != NULL, NULL);
     g_return_val_if_fail (!error || *error == NULL, NULL);
 
-    self = g_object_new (LIBMSI_TYPE_DATABASE,
-                         "path", path,
-                         "outpath", persist,
-                         "flags", flags,
-                         NULL);
+    return g_initable_new (LIBMSI_TYPE_DATABASE, NULL, error,
+                           "path", path,
+                           "outpath", persist,
+                           "flags", flags,
+                           NULL);
+}
+
+/**
+ * libmsi_database_new_from_bytes:
+ * @bytes: (allow-none): the content of a MSI file
+ * @flags: #LibmsiDbFlags opening flags
+ * @output: (allow-none): a #GOutputStream receiving the committed database
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Create a MSI database in memory, or open it from @bytes, which may
+ * be %NULL only with %LIBMSI_DB_FLAGS_CREATE.  The file system is never
+ * touched: each libmsi_database_commit() writes the complete database
+ * to @output, and the committed data is readable from the "bytes"
+ * property.  A later commit replaces what the one before wrote, so
+ * @output must then be seekable and truncatable, as a
+ * #GMemoryOutputStream is; otherwise the commit fails.
+ *
+ * Returns: a new #LibmsiDatabase on success, %NULL if fail.
+ **/
+LibmsiDatabase *
+libmsi_database_new_from_bytes (GBytes *bytes,
+                                guint flags,
+                                GOutputStream *output,
+                                GError **error)
+{
+    g_return_val_if_fail (bytes || flags & LIBMSI_DB_FLAGS_CREATE, NULL);
+    g_return_val_if_fail (!output || G_IS_OUTPUT_STREAM (output), NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
+
+    return g_initable_new (LIBMSI_TYPE_DATABASE, NULL, error,
+                           "bytes", bytes,
+                           "output-stream", output,
+                           "flags", flags,
+                           NULL);
+}
+
+/**
+ * libmsi_database_new_from_stream:
+ * @stream: a #GInputStream with the content of a MSI file
+ * @flags: #LibmsiDbFlags opening flags
+ * @output: (allow-none): a #GOutputStream receiving the committed database
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Open a MSI database from @stream.  The stream is read to the end,
+ * and the database is then handled in memory as with
+ * libmsi_database_new_from_bytes().
+ *
+ * Returns: a new #LibmsiDatabase on success, %NULL if fail.
+ **/
+LibmsiDatabase *
+libmsi_database_new_from_stream (GInputStream *stream,
+                                 guint flags,
+                                 GOutputStream *output,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+    LibmsiDatabase *db;
+    GOutputStream *mem;
+    GBytes *bytes;
+
+    g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+    g_return_val_if_fail (!output || G_IS_OUTPUT_STREAM (output), NULL);
+    g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
 
-    if (!init (self, error)) {
-        g_object_unref (self);
+    mem = g_memory_output_stream_new_resizable ();
+    if (g_output_stream_splice (mem, stream,
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                cancellable, error) < 0) {
+        g_object_unref (mem);
         return NULL;
     }
 
-    return self;
+    bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (mem));
+    g_object_unref (mem);
+
+    db = libmsi_database_new_from_bytes (bytes, flags, output, error);
+    g_bytes_unref (bytes);
+
+    return db;
+}
+
+/**
+ * libmsi_database_open_snapshot:
+ * @path: path to the MSI file the snapshot was saved from
+ * @snapshot: path to a snapshot written by libmsi_database_save_snapshot()
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Open the read-only database @path from @snapshot.  The snapshot is
+ * mapped in memory and used in place, so there is no storage to parse,
+ * string pool to decode or table to transpose.
+ *
+ * The snapshot is only used if the size, modification time and hash of
+ * @path are still those it was saved from; otherwise
+ * %LIBMSI_RESULT_INVALID_DATA is returned, and the caller should open
+ * @path with libmsi_database_new() and save a new snapshot.
+ *
+ * Returns: a new #LibmsiDatabase on success, %NULL if fail.
+ **/
+LibmsiDatabase *
+libmsi_database_open_snapshot (const gchar *path,
+                               const gchar *snapshot,
+                               GError **error)
+{
+    g_return_val_if_fail (path != NULL, NULL);
+    g_return_val_if_fail (snapshot != NULL, NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
+
+    return g_initable_new (LIBMSI_TYPE_DATABASE, NULL, error,
+                           "path", path,
+                           "snapshot", snapshot,
+                           "flags", LIBMSI_DB_FLAGS_READONLY,
+                           NULL);
+}
+
+/**
+ * libmsi_database_save_snapshot:
+ * @db: a #LibmsiDatabase opened from a file
+ * @path: the snapshot file to write
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Write the decoded content of @db to @path, to be reopened quickly
+ * with libmsi_database_open_snapshot().  Every table is loaded first.
+ * The database must not have uncommitted changes.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+libmsi_database_save_snapshot (LibmsiDatabase *db,
+                               const char *path,
+                               GError **error)
+{
+    unsigned r;
+
+    TRACE("%p %s\n", db, path);
+
+    g_return_val_if_fail (LIBMSI_IS_DATABASE (db), FALSE);
+    g_return_val_if_fail (path, FALSE);
+    g_return_val_if_fail (!error || *error == NULL, FALSE);
+
+    g_object_ref(db);
+    r = _libmsi_database_save_snapshot (db, path, error);
+    g_object_unref(db);
+
+    if (r != LIBMSI_RESULT_SUCCESS && error && !*error)
+        g_set_error (error, LIBMSI_RESULT_ERROR, r, G_STRFUNC);
+
+    return r == LIBMSI_RESULT_SUCCESS;
+}
+
+/**
+ * libmsi_database_new_async:
+ * @path: path to a MSI file
+ * @flags: #LibmsiDbFlags opening flags
+ * @persist: (allow-none): path to output MSI file
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the database is ready
+ * @user_data: (closure): the data to pass to callback function
+ *
+ * Asynchronously create a MSI database or open from @path, in a
+ * worker thread.
+ *
+ * When the operation is finished, @callback will be called.  You can
+ * then call libmsi_database_new_finish() to get the result.
+ **/
+void
+libmsi_database_new_async (const gchar *path,
+                           guint flags,
+                           const char *persist,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+    g_return_if_fail (path != NULL);
+    g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+    g_async_initable_new_async (LIBMSI_TYPE_DATABASE, G_PRIORITY_DEFAULT,
+                                cancellable, callback, user_data,
+                                "path", path,
+                                "outpath", persist,
+                                "flags", flags,
+                                NULL);
+}
+
+/**
+ * libmsi_database_new_finish:
+ * @result: a #GAsyncResult
+ * @error: (allow-none): #GError to set on error, or %NULL
+ *
+ * Finishes an operation started with libmsi_database_new_async().
+ *
+ * Returns: a new #LibmsiDatabase on success, %NULL if fail.
+ **/
+LibmsiDatabase *
+libmsi_database_new_finish (GAsyncResult *result,
+                            GError **error)
+{
+    GObject *source;
+    GObject *object;
+
+    g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+    g_return_val_if_fail (!error || *error == NULL, NULL);
+
+    source = g_async_result_get_source_object (result);
+    object = g_async_initable_new_finish (G_ASYNC_INITABLE (source), result, error);
+    g_object_unref (source);
+
+    return object ? LIBMSI_DATABASE (object) : NULL;
 }
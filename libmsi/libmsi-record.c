@@ -471,8 +471,9 @@ libmsi_record_set_string (LibmsiRecord *rec, unsigned field, const char *szValue
     return TRUE;
 }
 
-/* read the data in a file into a memory-backed GsfInput */
-static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
+/* read the data in a file into a memory-backed GsfInput, or with @lazy
+ * hand out the file-backed one, to be read when the stream is used */
+static unsigned _libmsi_addstream_from_file(const char *szFile, bool lazy, GsfInput **pstm)
 {
     GsfInput *stm;
     guint8 *data;
@@ -486,7 +487,13 @@ static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
     }
 
     sz = gsf_input_size(stm);
-    if (sz == 0)
+    if (lazy)
+    {
+        TRACE("streaming %s, %ld bytes from GsfInput %p\n", debugstr_a(szFile), sz, stm);
+        *pstm = stm;
+        return LIBMSI_RESULT_SUCCESS;
+    }
+    else if (sz == 0)
     {
         data = g_malloc(1);
     }
@@ -494,7 +501,10 @@ static unsigned _libmsi_addstream_from_file(const char *szFile, GsfInput **pstm)
     {
         data = g_try_malloc(sz);
         if (!data)
+        {
+            g_object_unref(G_OBJECT(stm));
             return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        }
 
         if (!gsf_input_read(stm, sz, data))
         {
@@ -546,7 +556,7 @@ unsigned _libmsi_record_load_stream_from_file(LibmsiRecord *rec, unsigned field,
     else
     {
         /* read the file into a stream and save the stream in the record */
-        r = _libmsi_addstream_from_file(szFilename, &stm);
+        r = _libmsi_addstream_from_file(szFilename, false, &stm);
         if( r != LIBMSI_RESULT_SUCCESS )
             return r;
 
@@ -583,6 +593,42 @@ libmsi_record_load_stream(LibmsiRecord *rec, unsigned field, const char *szFilen
     return ret == LIBMSI_RESULT_SUCCESS;
 }
 
+/**
+ * libmsi_record_load_stream_lazy:
+ * @record: a #LibmsiRecord
+ * @field: a field identifier
+ * @filename: a filename
+ *
+ * Like libmsi_record_load_stream(), but the file is only opened here,
+ * and read when the stream is used: once the record is stored in a
+ * database, that is when the database is committed.  The file is not
+ * held in memory meanwhile, but it must not change, move or disappear
+ * until libmsi_database_commit() has returned, and it stays open until
+ * then.
+ *
+ * Returns: %TRUE on success.
+ **/
+gboolean
+libmsi_record_load_stream_lazy(LibmsiRecord *rec, unsigned field, const char *szFilename)
+{
+    GsfInput *stm;
+    unsigned ret;
+
+    TRACE("%p %d %s\n", rec, field, debugstr_a(szFilename));
+
+    g_return_val_if_fail (LIBMSI_IS_RECORD (rec), FALSE);
+    g_return_val_if_fail (szFilename != NULL, FALSE);
+
+    if (field == 0 || field > rec->count)
+        return FALSE;
+
+    ret = _libmsi_addstream_from_file(szFilename, true, &stm);
+    if (ret == LIBMSI_RESULT_SUCCESS)
+        _libmsi_record_load_stream(rec, field, stm);
+
+    return ret == LIBMSI_RESULT_SUCCESS;
+}
+
 /**
  * libmsi_record_set_stream:
  * @record: a #LibmsiRecord
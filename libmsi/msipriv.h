@@ -37,6 +37,7 @@
 #include <gsf/gsf-input-memory.h>
 #include <gsf/gsf-input-stdio.h>
 #include <gsf/gsf-output-stdio.h>
+#include <gsf/gsf-output-memory.h>
 #include <gsf/gsf-infile-msole.h>
 #include <gsf/gsf-outfile-msole.h>
 
@@ -96,6 +97,11 @@ struct _LibmsiDatabase
     char *path;
     char *outpath;
     bool rename_outpath;
+    GBytes *bytes;
+    GOutputStream *output;
+    bool output_written;
+    GsfOutput *outmem;
+    GsfOutput *outsink;
     guint flags;
     unsigned media_transform_offset;
     unsigned media_transform_disk_id;
@@ -103,6 +109,19 @@ struct _LibmsiDatabase
     struct list transforms;
     struct list streams;
     struct list storages;
+    GCancellable *cancellable;
+    LibmsiProgressFunc progress_func;
+    gpointer progress_data;
+    GDestroyNotify progress_notify;
+    LibmsiProgressOperation progress_operation;
+    guint64 progress_bytes;
+    guint64 progress_rows;
+    guint64 n_table_loads;
+    guint64 n_index_builds;
+    guint64 n_query_parses;
+    guint64 n_commits;
+    char *snapshot_path;
+    GMappedFile *snapshot;
 };
 
 typedef struct _LibmsiView LibmsiView;
@@ -333,6 +352,9 @@ typedef struct {
 unsigned msi_strcpy_to_awstring( const char *str, awstring *awbuf, unsigned *sz );
 
 extern void free_cached_tables( LibmsiDatabase *db );
+extern unsigned msi_save_cached_tables( LibmsiDatabase *db, struct list *saved );
+extern void msi_restore_cached_tables( LibmsiDatabase *db, struct list *saved );
+extern void msi_free_saved_tables( struct list *saved );
 extern unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_strref );
 
 
@@ -349,9 +371,15 @@ extern void msi_destroy_stringtable( string_table *st );
 extern const char *msi_string_lookup_id( const string_table *st, unsigned id );
 extern string_table *msi_init_string_table( unsigned *bytes_per_strref );
 extern string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref );
-extern unsigned msi_save_string_table( const string_table *st, LibmsiDatabase *db, unsigned *bytes_per_strref );
+extern unsigned msi_save_string_table( const string_table *st, GsfOutfile *outfile, unsigned *bytes_per_strref );
 extern unsigned msi_get_string_table_codepage( const string_table *st );
 extern unsigned msi_set_string_table_codepage( string_table *st, unsigned codepage );
+extern bool msi_string_table_is_modified( const string_table *st );
+extern void msi_string_table_get_stats( const string_table *st, guint64 *bytes, unsigned *count );
+extern void msi_string_table_save_snapshot( const string_table *st, GByteArray *out );
+extern string_table *msi_string_table_open_snapshot( const uint8_t *data, gsize size );
+extern unsigned msi_string_table_begin_undo( string_table *st );
+extern void msi_string_table_end_undo( string_table *st, unsigned mark, bool rollback );
 
 unsigned _libmsi_open_table( LibmsiDatabase *db, const char *name, bool encoded );
 extern bool table_view_exists( LibmsiDatabase *db, const char *name );
@@ -361,12 +389,28 @@ extern unsigned read_stream_data( GsfInfile *stg, const char *stname,
                               uint8_t **pdata, unsigned *psz );
 extern unsigned write_stream_data( LibmsiDatabase *db, const char *stname,
                                const void *data, unsigned sz );
+extern unsigned write_outfile_stream_data( GsfOutfile *outfile, const char *stname,
+                               const void *data, unsigned sz );
 extern unsigned write_raw_stream_data( LibmsiDatabase *db, const char *stname,
                         const void *data, unsigned sz, GsfInput **outstm );
+extern unsigned msi_copy_raw_stream( LibmsiDatabase *db, const char *stname );
+extern unsigned msi_table_insert_rows( LibmsiDatabase *db, const char *name,
+                                       LibmsiRecord **recs, unsigned count, bool temporary );
+extern unsigned msi_table_append_rows( LibmsiView *view, LibmsiRecord **recs,
+                                       unsigned count, bool temporary );
+extern unsigned msi_table_sort_rows( LibmsiView *view, unsigned first );
+extern void msi_table_discard_rows( LibmsiView *view, unsigned first );
+extern unsigned msi_get_table_stats( LibmsiDatabase *db, LibmsiTableStats **stats, unsigned *count );
+extern bool msi_tables_modified( LibmsiDatabase *db );
+extern unsigned msi_table_save_snapshot( LibmsiDatabase *db, GByteArray *out );
+extern unsigned msi_table_open_snapshot( LibmsiDatabase *db, const uint8_t *data, gsize size );
+extern bool copy_stream_data( LibmsiDatabase *db, GsfInput *in, GsfOutput *out );
 extern unsigned _libmsi_database_commit_streams( LibmsiDatabase *db );
 
 /* transform functions */
 extern unsigned msi_table_apply_transform( LibmsiDatabase *db, GsfInfile *stg );
+extern unsigned msi_table_generate_transform( LibmsiDatabase *db, LibmsiDatabase *ref,
+                                              GsfOutfile *outfile );
 extern unsigned _libmsi_database_apply_transform( LibmsiDatabase *db,
                  const char *szTransformFile);
 extern void append_storage_to_db( LibmsiDatabase *db, GsfInfile *stg );
@@ -391,6 +435,10 @@ extern void enum_stream_names( GsfInfile *stg );
 extern char *encode_streamname(bool bTable, const char *in);
 extern void decode_streamname(const char *in, char *out);
 
+/* progress reporting */
+extern void msi_progress_begin( LibmsiDatabase *db, LibmsiProgressOperation op );
+extern bool msi_progress_update( LibmsiDatabase *db, guint64 bytes, guint64 rows );
+
 /* database internals */
 extern LibmsiResult _libmsi_database_start_transaction(LibmsiDatabase *db);
 extern LibmsiResult _libmsi_database_open(LibmsiDatabase *db);
@@ -473,6 +521,64 @@ static inline void msi_free( void *mem )
     free(mem);
 }
 
+/* snapshot sections are little-endian and start 8-byte aligned */
+
+static inline void msi_snapshot_align( GByteArray *out )
+{
+    static const uint8_t zero[8];
+
+    if (out->len % 8)
+        g_byte_array_append( out, zero, 8 - out->len % 8 );
+}
+
+static inline void msi_snapshot_set32( GByteArray *out, gsize pos, guint32 val )
+{
+    val = GUINT32_TO_LE( val );
+    memcpy( out->data + pos, &val, sizeof(val) );
+}
+
+static inline void msi_snapshot_set64( GByteArray *out, gsize pos, guint64 val )
+{
+    val = GUINT64_TO_LE( val );
+    memcpy( out->data + pos, &val, sizeof(val) );
+}
+
+static inline void msi_snapshot_put32( GByteArray *out, guint32 val )
+{
+    val = GUINT32_TO_LE( val );
+    g_byte_array_append( out, (const uint8_t *)&val, sizeof(val) );
+}
+
+static inline void msi_snapshot_put64( GByteArray *out, guint64 val )
+{
+    val = GUINT64_TO_LE( val );
+    g_byte_array_append( out, (const uint8_t *)&val, sizeof(val) );
+}
+
+static inline guint32 msi_snapshot_get32( const uint8_t *data )
+{
+    guint32 val;
+
+    memcpy( &val, data, sizeof(val) );
+    return GUINT32_FROM_LE( val );
+}
+
+static inline guint64 msi_snapshot_get64( const uint8_t *data )
+{
+    guint64 val;
+
+    memcpy( &val, data, sizeof(val) );
+    return GUINT64_FROM_LE( val );
+}
+
+/* a NUL-terminated name inside a section, or NULL if it runs past the end */
+static inline const char *msi_snapshot_name( const uint8_t *data, gsize size, guint64 offset )
+{
+    if (offset >= size || !memchr( data + offset, 0, size - offset ))
+        return NULL;
+    return (const char *)data + offset;
+}
+
 static inline char *strcpyn( char *dst, const char *src, unsigned count )
 {
     char *d = dst;
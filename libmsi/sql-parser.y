@@ -1013,6 +1013,7 @@ unsigned _libmsi_parse_sql( LibmsiDatabase *db, const char *command, LibmsiView
     sql.view = phview;
     sql.mem = mem;
 
+    db->n_query_parses++;
     r = sql_parse(&sql);
 
     TRACE("Parse returned %d\n", r);
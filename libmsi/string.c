@@ -45,8 +45,20 @@ struct string_table
     unsigned freeslot;
     unsigned codepage;
     unsigned sortcount;
+    bool modified;             /* changed since it was loaded */
     struct msistring *strings; /* an array of strings */
     unsigned *sorted;              /* index */
+    const char *arena;         /* strings mapped from a snapshot */
+    gsize arena_size;
+    GArray *undo;              /* references added since the undo mark */
+    unsigned undo_depth;
+};
+
+struct msistringref
+{
+    unsigned id;
+    uint16_t refcount;
+    enum StringPersistence persistence;
 };
 
 static bool validate_codepage( unsigned codepage )
@@ -103,22 +115,35 @@ static string_table *init_stringtable( int entries, unsigned codepage )
     st->freeslot = 1;
     st->codepage = codepage;
     st->sortcount = 0;
+    st->modified = true;
+    st->arena = NULL;
+    st->arena_size = 0;
+    st->undo = NULL;
+    st->undo_depth = 0;
 
     return st;
 }
 
+static bool string_in_arena( const string_table *st, const char *str )
+{
+    return str >= st->arena && str < st->arena + st->arena_size;
+}
+
 void msi_destroy_stringtable( string_table *st )
 {
     unsigned i;
 
     for( i=0; i<st->maxcount; i++ )
     {
-        if( st->strings[i].persistent_refcount ||
-            st->strings[i].nonpersistent_refcount )
+        if( (st->strings[i].persistent_refcount ||
+             st->strings[i].nonpersistent_refcount) &&
+            !string_in_arena( st, st->strings[i].str ) )
             msi_free( st->strings[i].str );
     }
     msi_free( st->strings );
     msi_free( st->sorted );
+    if( st->undo )
+        g_array_free( st->undo, TRUE );
     msi_free( st );
 }
 
@@ -214,6 +239,7 @@ static void set_st_entry( string_table *st, unsigned n, char *str, uint16_t refc
     }
 
     st->strings[n].str = str;
+    st->modified = true;
 
     insert_string_sorted( st, n );
 
@@ -271,6 +297,7 @@ static int msi_addstring( string_table *st, unsigned n, const char *data, int le
     {
         if( LIBMSI_RESULT_SUCCESS == _libmsi_id_from_string( st, data, &n ) )
         {
+            st->modified = true;
             if (persistence == StringPersistent)
                 st->strings[n].persistent_refcount += refcount;
             else
@@ -303,6 +330,19 @@ static int msi_addstring( string_table *st, unsigned n, const char *data, int le
     return n;
 }
 
+static void log_string_ref( string_table *st, unsigned n, uint16_t refcount, enum StringPersistence persistence )
+{
+    struct msistringref ref;
+
+    if( !st->undo )
+        return;
+
+    ref.id = n;
+    ref.refcount = refcount;
+    ref.persistence = persistence;
+    g_array_append_val( st->undo, ref );
+}
+
 int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t refcount, enum StringPersistence persistence )
 {
     unsigned n;
@@ -315,10 +355,12 @@ int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t re
 
     if( _libmsi_id_from_string_utf8( st, data, &n ) == LIBMSI_RESULT_SUCCESS )
     {
+        st->modified = true;
         if (persistence == StringPersistent)
             st->strings[n].persistent_refcount += refcount;
         else
             st->strings[n].nonpersistent_refcount += refcount;
+        log_string_ref( st, n, refcount, persistence );
         return n;
     }
 
@@ -338,10 +380,84 @@ int _libmsi_add_string( string_table *st, const char *data, int len, uint16_t re
     str[len] = 0;
 
     set_st_entry( st, n, str, refcount, persistence );
+    log_string_ref( st, n, refcount, persistence );
 
     return n;
 }
 
+/* takes back a reference, and the string itself with the last one */
+static void release_string( string_table *st, const struct msistringref *ref )
+{
+    struct msistring *s = &st->strings[ref->id];
+    int i, c, low = 0, high = st->sortcount - 1;
+
+    if (ref->persistence == StringPersistent)
+        s->persistent_refcount -= MIN( ref->refcount, s->persistent_refcount );
+    else
+        s->nonpersistent_refcount -= MIN( ref->refcount, s->nonpersistent_refcount );
+
+    if( s->persistent_refcount || s->nonpersistent_refcount || !s->str )
+        return;
+
+    while (low <= high)
+    {
+        i = (low + high) / 2;
+        c = strcmp( s->str, st->strings[st->sorted[i]].str );
+
+        if (c < 0)
+            high = i - 1;
+        else if (c > 0)
+            low = i + 1;
+        else
+        {
+            memmove( &st->sorted[i], &st->sorted[i] + 1, (st->sortcount - i - 1) * sizeof(unsigned) );
+            st->sortcount--;
+            break;
+        }
+    }
+
+    if( !string_in_arena( st, s->str ) )
+        msi_free( s->str );
+    s->str = NULL;
+    if( ref->id < st->freeslot )
+        st->freeslot = ref->id;
+}
+
+/* Starts counting the references _libmsi_add_string hands out, so that
+ * they can be taken back if the rows holding them are dropped.  Marks
+ * nest; the returned mark is passed to msi_string_table_end_undo. */
+unsigned msi_string_table_begin_undo( string_table *st )
+{
+    if( !st->undo )
+        st->undo = g_array_new( FALSE, FALSE, sizeof(struct msistringref) );
+    st->undo_depth++;
+    return st->undo->len;
+}
+
+/* Stops counting at @mark; with @rollback, every reference added since
+ * is released again, latest first.  Without, the references stay in
+ * the log for as long as an enclosing mark is open, so that a rollback
+ * of that one still takes them back. */
+void msi_string_table_end_undo( string_table *st, unsigned mark, bool rollback )
+{
+    unsigned i;
+
+    g_return_if_fail( st->undo && mark <= st->undo->len );
+
+    if( rollback )
+    {
+        for( i = st->undo->len; i > mark; i-- )
+            release_string( st, &g_array_index( st->undo, struct msistringref, i - 1 ) );
+        g_array_set_size( st->undo, mark );
+    }
+
+    if( !--st->undo_depth )
+    {
+        g_array_free( st->undo, TRUE );
+        st->undo = NULL;
+    }
+}
+
 /* find the string identified by an id - return null if there's none */
 G_GNUC_PURE
 const char *msi_string_lookup_id( const string_table *st, unsigned id )
@@ -559,6 +675,7 @@ string_table *msi_load_string_table( GsfInfile *stg, unsigned *bytes_per_strref
         g_critical("string table load failed! (%08x != %08x), please report\n", datasize, offset );
 
     TRACE("Loaded %d strings\n", count);
+    st->modified = false;
 
 end:
     msi_free( pool );
@@ -567,7 +684,117 @@ end:
     return st;
 }
 
-unsigned msi_save_string_table( const string_table *st, LibmsiDatabase *db, unsigned *bytes_per_strref )
+/*
+ * The snapshot of a string table keeps the decoded strings in a single
+ * arena along with the sorted index, so that reopening it needs no
+ * conversion, allocation or sorting per string:
+ *
+ *   codepage, count, sortcount and arena size, as 32-bit values
+ *   count entries of a 32-bit arena offset and the two reference counts
+ *   sortcount string ids, the sorted index
+ *   the arena of NUL-terminated UTF-8 strings
+ */
+void msi_string_table_save_snapshot( const string_table *st, GByteArray *out )
+{
+    gsize start = out->len;
+    unsigned i, offset = 0;
+
+    msi_snapshot_put32( out, st->codepage );
+    msi_snapshot_put32( out, st->maxcount );
+    msi_snapshot_put32( out, st->sortcount );
+    msi_snapshot_put32( out, 0 );
+
+    for (i = 0; i < st->maxcount; i++)
+    {
+        const struct msistring *entry = &st->strings[i];
+
+        if (!entry->persistent_refcount && !entry->nonpersistent_refcount)
+        {
+            msi_snapshot_put64( out, 0 );
+            continue;
+        }
+        msi_snapshot_put32( out, offset );
+        msi_snapshot_put32( out, entry->persistent_refcount |
+                                 entry->nonpersistent_refcount << 16 );
+        offset += strlen( entry->str ) + 1;
+    }
+
+    for (i = 0; i < st->sortcount; i++)
+        msi_snapshot_put32( out, st->sorted[i] );
+
+    msi_snapshot_set32( out, start + 12, offset );
+    for (i = 0; i < st->maxcount; i++)
+    {
+        const struct msistring *entry = &st->strings[i];
+
+        if (entry->persistent_refcount || entry->nonpersistent_refcount)
+            g_byte_array_append( out, (const uint8_t *)entry->str, strlen( entry->str ) + 1 );
+    }
+}
+
+/* the strings are used in place, so @data must outlive the table */
+string_table *msi_string_table_open_snapshot( const uint8_t *data, gsize size )
+{
+    string_table *st;
+    const uint8_t *entries, *sorted;
+    unsigned i, count, sortcount, arena_size, offset, refs;
+
+    if (size < 16)
+        goto corrupt;
+
+    count = msi_snapshot_get32( data + 4 );
+    sortcount = msi_snapshot_get32( data + 8 );
+    arena_size = msi_snapshot_get32( data + 12 );
+    if (sortcount > count ||
+        16 + (guint64)count * 8 + (guint64)sortcount * 4 + arena_size > size)
+        goto corrupt;
+
+    entries = data + 16;
+    sorted = entries + count * 8;
+    if (arena_size && sorted[sortcount * 4 + arena_size - 1])
+        goto corrupt;
+
+    st = init_stringtable( count, msi_snapshot_get32( data ) );
+    if (!st)
+        return NULL;
+
+    st->arena = (const char *)sorted + sortcount * 4;
+    st->arena_size = arena_size;
+
+    for (i = 0; i < count; i++)
+    {
+        offset = msi_snapshot_get32( entries + i * 8 );
+        refs = msi_snapshot_get32( entries + i * 8 + 4 );
+        if (!refs)
+            continue;
+        if (offset >= arena_size)
+            goto corrupt_table;
+
+        st->strings[i].persistent_refcount = refs & 0xffff;
+        st->strings[i].nonpersistent_refcount = refs >> 16;
+        st->strings[i].str = (char *)st->arena + offset;
+    }
+
+    for (i = 0; i < sortcount; i++)
+    {
+        st->sorted[i] = msi_snapshot_get32( sorted + i * 4 );
+        if (st->sorted[i] >= count || !st->strings[st->sorted[i]].str)
+            goto corrupt_table;
+    }
+    st->sortcount = sortcount;
+    st->modified = false;
+
+    TRACE("Mapped %d strings\n", count);
+    return st;
+
+corrupt_table:
+    msi_destroy_stringtable( st );
+corrupt:
+    g_critical("string table snapshot is corrupt\n");
+    return NULL;
+}
+
+unsigned msi_save_string_table( const string_table *st, GsfOutfile *outfile, unsigned *bytes_per_strref )
 {
     unsigned i, datasize = 0, poolsize = 0, sz, used, r, codepage, n;
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
@@ -668,11 +895,11 @@ unsigned msi_save_string_table( const string_table *st, LibmsiDatabase *db, unsi
     }
 
     /* write the streams */
-    r = write_stream_data( db, szStringData, data, datasize );
+    r = write_outfile_stream_data( outfile, szStringData, data, datasize );
     TRACE("Wrote StringData r=%08x\n", r);
     if( r )
         goto err;
-    r = write_stream_data( db, szStringPool, pool, poolsize );
+    r = write_outfile_stream_data( outfile, szStringPool, pool, poolsize );
     TRACE("Wrote StringPool r=%08x\n", r);
     if( r )
         goto err;
@@ -692,11 +919,33 @@ unsigned msi_get_string_table_codepage( const string_table *st )
     return st->codepage;
 }
 
+G_GNUC_PURE
+bool msi_string_table_is_modified( const string_table *st )
+{
+    return st->modified;
+}
+
+void msi_string_table_get_stats( const string_table *st, guint64 *bytes, unsigned *count )
+{
+    unsigned i;
+
+    *bytes = sizeof(*st) + st->maxcount * (sizeof(struct msistring) + sizeof(unsigned));
+    *count = 0;
+    for (i = 0; i < st->maxcount; i++)
+    {
+        if (!st->strings[i].str)
+            continue;
+        *bytes += strlen( st->strings[i].str ) + 1;
+        (*count)++;
+    }
+}
+
 unsigned msi_set_string_table_codepage( string_table *st, unsigned codepage )
 {
     if (validate_codepage( codepage ))
     {
         st->codepage = codepage;
+        st->modified = true;
         return LIBMSI_RESULT_SUCCESS;
     }
     return LIBMSI_RESULT_FUNCTION_FAILED;
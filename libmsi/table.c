@@ -60,7 +60,11 @@ struct _LibmsiTable
     LibmsiColumnInfo *colinfo;
     unsigned col_count;
     LibmsiCondition persistent;
+    bool modified;
     int ref_count;
+    uint8_t *snapshot;          /* rows mapped from a snapshot */
+    unsigned snapshot_rows;
+    unsigned snapshot_row_size;
     char name[1];
 };
 
@@ -308,17 +312,23 @@ end:
 
 unsigned write_stream_data( LibmsiDatabase *db, const char *stname,
                         const void *data, unsigned sz )
+{
+    if (!db->outfile)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    return write_outfile_stream_data( db->outfile, stname, data, sz );
+}
+
+unsigned write_outfile_stream_data( GsfOutfile *outfile, const char *stname,
+                        const void *data, unsigned sz )
 {
     unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
     char *encname;
     GsfOutput *stm;
 
-    if (!db->outfile)
-        return ret;
-
     encname = encode_streamname(true, stname );
 
-    stm = gsf_outfile_new_child( db->outfile, encname, false );
+    stm = gsf_outfile_new_child( outfile, encname, false );
     msi_free( encname );
     if( !stm )
     {
@@ -340,17 +350,76 @@ end:
     return ret;
 }
 
+/*
+ * msi_copy_raw_stream
+ *
+ * Copy the encoded stream stname from the database's input file to
+ * its output file unchanged, without decoding it.  Returns
+ * LIBMSI_RESULT_NOT_FOUND without writing anything if the input file
+ * doesn't have such a stream, so that the caller can write it itself.
+ * Any other failure may leave a partial stream in the output file.
+ */
+unsigned msi_copy_raw_stream( LibmsiDatabase *db, const char *stname )
+{
+    unsigned ret = LIBMSI_RESULT_FUNCTION_FAILED;
+    char *encname;
+    GsfInput *in;
+    GsfOutput *out;
+
+    if (!db->infile || !db->outfile)
+        return LIBMSI_RESULT_NOT_FOUND;
+
+    encname = encode_streamname(true, stname);
+    in = gsf_infile_child_by_name( db->infile, encname );
+    if( !in )
+    {
+        msi_free( encname );
+        return LIBMSI_RESULT_NOT_FOUND;
+    }
+
+    out = gsf_outfile_new_child( db->outfile, encname, false );
+    msi_free( encname );
+    if( !out )
+    {
+        g_warning("open stream failed\n");
+        goto end;
+    }
+
+    if (copy_stream_data( db, in, out ))
+        ret = LIBMSI_RESULT_SUCCESS;
+
+    gsf_output_close( out );
+    g_object_unref(G_OBJECT(out));
+
+end:
+    g_object_unref(G_OBJECT(in));
+    return ret;
+}
+
 static void msi_free_colinfo( LibmsiColumnInfo *colinfo, unsigned count )
 {
     unsigned i;
     for (i = 0; i < count; i++) msi_free( colinfo[i].hash_table );
 }
 
+/* rows read from a snapshot point into its mapping and are not freed */
+static bool table_row_is_mapped( const LibmsiTable *table, const uint8_t *row )
+{
+    return row >= table->snapshot &&
+           row < table->snapshot + (gsize)table->snapshot_rows * table->snapshot_row_size;
+}
+
+static void table_free_row( LibmsiTable *table, uint8_t *row )
+{
+    if (!table_row_is_mapped( table, row ))
+        msi_free( row );
+}
+
 static void free_table( LibmsiTable *table )
 {
     unsigned i;
     for( i=0; i<table->row_count; i++ )
-        msi_free( table->data[i] );
+        table_free_row( table, table->data[i] );
     msi_free( table->data );
     msi_free( table->data_persistent );
     msi_free_colinfo( table->colinfo, table->col_count );
@@ -456,6 +525,39 @@ err:
     return LIBMSI_RESULT_FUNCTION_FAILED;
 }
 
+/* the snapshot already holds the rows in memory layout, they are used
+ * in place rather than transposed */
+static unsigned read_table_from_snapshot( LibmsiDatabase *db, LibmsiTable *t )
+{
+    unsigned i, row_size_mem;
+
+    TRACE("%s\n",debugstr_a(t->name));
+
+    row_size_mem = msi_table_get_row_size( db, t->colinfo, t->col_count, LONG_STR_BYTES );
+    if (row_size_mem != t->snapshot_row_size)
+    {
+        g_warning("Snapshot row size is invalid %d/%d\n", t->snapshot_row_size, row_size_mem );
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    }
+    if (!t->snapshot_rows)
+        return LIBMSI_RESULT_SUCCESS;
+
+    t->data = msi_alloc( t->snapshot_rows * sizeof(uint8_t *) );
+    if (!t->data)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    t->data_persistent = msi_alloc( t->snapshot_rows * sizeof(bool) );
+    if (!t->data_persistent)
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
+    for (i = 0; i < t->snapshot_rows; i++)
+    {
+        t->data[i] = t->snapshot + i * row_size_mem;
+        t->data_persistent[i] = true;
+    }
+    t->row_count = t->snapshot_rows;
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 void free_cached_tables( LibmsiDatabase *db )
 {
     while( !list_empty( &db->tables ) )
@@ -467,6 +569,173 @@ void free_cached_tables( LibmsiDatabase *db )
     }
 }
 
+static LibmsiTable *copy_table( LibmsiDatabase *db, const LibmsiTable *t )
+{
+    LibmsiTable *copy;
+    unsigned i, row_size;
+
+    copy = msi_alloc_zero( sizeof(LibmsiTable) + strlen( t->name ) );
+    if (!copy)
+        return NULL;
+
+    strcpy( copy->name, t->name );
+    copy->persistent = t->persistent;
+    copy->modified = t->modified;
+    copy->ref_count = t->ref_count;
+    copy->snapshot = t->snapshot;
+    copy->snapshot_rows = t->snapshot_rows;
+    copy->snapshot_row_size = t->snapshot_row_size;
+
+    if (t->col_count)
+    {
+        copy->colinfo = msi_alloc( t->col_count * sizeof(LibmsiColumnInfo) );
+        if (!copy->colinfo)
+            goto err;
+        memcpy( copy->colinfo, t->colinfo, t->col_count * sizeof(LibmsiColumnInfo) );
+        for (i = 0; i < t->col_count; i++) copy->colinfo[i].hash_table = NULL;
+        copy->col_count = t->col_count;
+    }
+
+    if (t->row_count)
+    {
+        copy->data = msi_alloc( t->row_count * sizeof(uint8_t *) );
+        copy->data_persistent = msi_alloc( t->row_count * sizeof(bool) );
+        if (!copy->data || !copy->data_persistent)
+            goto err;
+        memcpy( copy->data_persistent, t->data_persistent, t->row_count * sizeof(bool) );
+
+        row_size = msi_table_get_row_size( db, t->colinfo, t->col_count, LONG_STR_BYTES );
+        for (i = 0; i < t->row_count; i++)
+        {
+            if (table_row_is_mapped( t, t->data[i] ))
+                copy->data[i] = t->data[i];
+            else if (!(copy->data[i] = msi_alloc( row_size )))
+                goto err;
+            else
+                memcpy( copy->data[i], t->data[i], row_size );
+            copy->row_count = i + 1;
+        }
+    }
+    return copy;
+
+err:
+    free_table( copy );
+    return NULL;
+}
+
+/* copy the rows and columns of the cached tables to @saved, so that
+ * msi_restore_cached_tables can undo the changes made after this */
+unsigned msi_save_cached_tables( LibmsiDatabase *db, struct list *saved )
+{
+    LibmsiTable *t, *copy;
+
+    list_init( saved );
+    LIST_FOR_EACH_ENTRY( t, &db->tables, LibmsiTable, entry )
+    {
+        if (!(copy = copy_table( db, t )))
+        {
+            msi_free_saved_tables( saved );
+            return LIBMSI_RESULT_OUTOFMEMORY;
+        }
+        list_add_tail( saved, &copy->entry );
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* the tables still cached keep their LibmsiTable, which open views
+ * point to, and get their saved rows and columns back; tables cached
+ * since are dropped, and read again from the file when needed */
+void msi_restore_cached_tables( LibmsiDatabase *db, struct list *saved )
+{
+    LibmsiTable *t, *next, *copy, tmp;
+
+    LIST_FOR_EACH_ENTRY_SAFE( t, next, &db->tables, LibmsiTable, entry )
+    {
+        LIST_FOR_EACH_ENTRY( copy, saved, LibmsiTable, entry )
+            if (!strcmp( copy->name, t->name ))
+                break;
+
+        if (&copy->entry == saved)
+        {
+            list_remove( &t->entry );
+            free_table( t );
+            continue;
+        }
+
+        list_remove( &copy->entry );
+        tmp = *t;
+        t->data = copy->data;
+        t->data_persistent = copy->data_persistent;
+        t->row_count = copy->row_count;
+        t->colinfo = copy->colinfo;
+        t->col_count = copy->col_count;
+        t->persistent = copy->persistent;
+        t->modified = copy->modified;
+        t->snapshot = copy->snapshot;
+        t->snapshot_rows = copy->snapshot_rows;
+        t->snapshot_row_size = copy->snapshot_row_size;
+        copy->data = tmp.data;
+        copy->data_persistent = tmp.data_persistent;
+        copy->row_count = tmp.row_count;
+        copy->colinfo = tmp.colinfo;
+        copy->col_count = tmp.col_count;
+        copy->snapshot = tmp.snapshot;
+        copy->snapshot_rows = tmp.snapshot_rows;
+        copy->snapshot_row_size = tmp.snapshot_row_size;
+        free_table( copy );
+    }
+
+    /* what is left was dropped since it was saved */
+    while (!list_empty( saved ))
+    {
+        copy = LIST_ENTRY( list_head( saved ), LibmsiTable, entry );
+        list_remove( &copy->entry );
+        list_add_tail( &db->tables, &copy->entry );
+    }
+}
+
+void msi_free_saved_tables( struct list *saved )
+{
+    while (!list_empty( saved ))
+    {
+        LibmsiTable *t = LIST_ENTRY( list_head( saved ), LibmsiTable, entry );
+
+        list_remove( &t->entry );
+        free_table( t );
+    }
+}
+
+/* memory held by the cached tables: the transposed rows, and the
+ * column hash tables built by table_view_find_matching_rows */
+unsigned msi_get_table_stats( LibmsiDatabase *db, LibmsiTableStats **stats, unsigned *count )
+{
+    LibmsiTableStats *ts;
+    LibmsiTable *t;
+    unsigned n = 0, i;
+
+    *count = list_count( &db->tables );
+    *stats = ts = g_new0( LibmsiTableStats, *count );
+
+    LIST_FOR_EACH_ENTRY( t, &db->tables, LibmsiTable, entry )
+    {
+        unsigned row_size = msi_table_get_row_size( db, t->colinfo, t->col_count, LONG_STR_BYTES );
+
+        ts[n].name = g_strdup( t->name );
+        ts[n].row_count = t->row_count;
+        ts[n].row_bytes = sizeof(LibmsiTable) + strlen( t->name ) +
+                          t->col_count * sizeof(LibmsiColumnInfo) +
+                          (guint64)t->row_count * (sizeof(uint8_t *) + sizeof(bool) + row_size);
+
+        for (i = 0; i < t->col_count; i++)
+            if (t->colinfo[i].hash_table)
+                ts[n].index_bytes += LibmsiTable_HASH_TABLE_SIZE * sizeof(LibmsiColumnHashEntry *) +
+                                     t->row_count * sizeof(LibmsiColumnHashEntry);
+        n++;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
 G_GNUC_PURE
 static LibmsiTable *find_cached_table( LibmsiDatabase *db, const char *name )
 {
@@ -479,6 +748,126 @@ static LibmsiTable *find_cached_table( LibmsiDatabase *db, const char *name )
     return NULL;
 }
 
+bool msi_tables_modified( LibmsiDatabase *db )
+{
+    LibmsiTable *t;
+
+    LIST_FOR_EACH_ENTRY( t, &db->tables, LibmsiTable, entry )
+        if( t->modified )
+            return true;
+
+    return false;
+}
+
+static unsigned get_table( LibmsiDatabase *db, const char *name, LibmsiTable **table_ret );
+
+/*
+ * The snapshot of the tables keeps the rows of every stored table in
+ * their in-memory layout, so reopening it needs no transpose:
+ *
+ *   the table count, as a 64-bit value
+ *   per table, the 64-bit offsets of its name and of its rows, then
+ *   the 32-bit row count and row size
+ *   the names and rows
+ *
+ * Offsets are from the start of the section.  Temporary tables and
+ * rows are left out.
+ */
+unsigned msi_table_save_snapshot( LibmsiDatabase *db, GByteArray *out )
+{
+    LibmsiTable *table, *table2, *t;
+    gsize start = out->len, pos;
+    unsigned i, count = 0, rows, row_size;
+
+    /* load what was not used yet; a table stream without columns
+     * cannot be loaded and is left out */
+    LIST_FOR_EACH_ENTRY_SAFE( table, table2, &db->tables, LibmsiTable, entry )
+    {
+        if (get_table( db, table->name, &t ) != LIBMSI_RESULT_SUCCESS)
+            TRACE("skipping %s\n", debugstr_a(table->name));
+    }
+
+    LIST_FOR_EACH_ENTRY( table, &db->tables, LibmsiTable, entry )
+        if (table->persistent != LIBMSI_CONDITION_FALSE)
+            count++;
+
+    msi_snapshot_put64( out, count );
+    pos = out->len;
+    g_byte_array_set_size( out, out->len + count * 24 );
+
+    LIST_FOR_EACH_ENTRY( table, &db->tables, LibmsiTable, entry )
+    {
+        if (table->persistent == LIBMSI_CONDITION_FALSE)
+            continue;
+
+        row_size = msi_table_get_row_size( db, table->colinfo, table->col_count, LONG_STR_BYTES );
+        msi_snapshot_set64( out, pos, out->len - start );
+        g_byte_array_append( out, (const uint8_t *)table->name, strlen( table->name ) + 1 );
+        msi_snapshot_set64( out, pos + 8, out->len - start );
+
+        rows = 0;
+        for (i = 0; i < table->row_count; i++)
+        {
+            if (!table->data_persistent[i])
+                continue;
+            g_byte_array_append( out, table->data[i], row_size );
+            rows++;
+        }
+        msi_snapshot_set32( out, pos + 16, rows );
+        msi_snapshot_set32( out, pos + 20, row_size );
+        pos += 24;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+/* the tables are only registered here; their rows are set up from
+ * @data when first used, so @data must outlive the database */
+unsigned msi_table_open_snapshot( LibmsiDatabase *db, const uint8_t *data, gsize size )
+{
+    guint64 count, i, name_offset, rows_offset;
+    unsigned r, row_count, row_size;
+    const uint8_t *entry;
+    LibmsiTable *table;
+    const char *name;
+
+    if (size < 8)
+        goto corrupt;
+
+    count = msi_snapshot_get64( data );
+    if (count > (size - 8) / 24)
+        goto corrupt;
+
+    for (i = 0; i < count; i++)
+    {
+        entry = data + 8 + i * 24;
+        name_offset = msi_snapshot_get64( entry );
+        rows_offset = msi_snapshot_get64( entry + 8 );
+        row_count = msi_snapshot_get32( entry + 16 );
+        row_size = msi_snapshot_get32( entry + 20 );
+
+        name = msi_snapshot_name( data, size, name_offset );
+        if (!name || rows_offset > size ||
+            (guint64)row_count * row_size > size - rows_offset)
+            goto corrupt;
+
+        r = _libmsi_open_table( db, name, false );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+
+        table = find_cached_table( db, name );
+        table->snapshot = (uint8_t *)data + rows_offset;
+        table->snapshot_rows = row_count;
+        table->snapshot_row_size = row_size;
+    }
+
+    return LIBMSI_RESULT_SUCCESS;
+
+corrupt:
+    g_critical("table snapshot is corrupt\n");
+    return LIBMSI_RESULT_FUNCTION_FAILED;
+}
+
 static void table_calc_column_offsets( LibmsiDatabase *db, LibmsiColumnInfo *colinfo, unsigned count )
 {
     unsigned i;
@@ -617,13 +1006,17 @@ static unsigned get_table( LibmsiDatabase *db, const char *name, LibmsiTable **t
         free_table( table );
         return r;
     }
-    r = read_table_from_storage( db, table, db->infile );
+    if (table->snapshot)
+        r = read_table_from_snapshot( db, table );
+    else
+        r = read_table_from_storage( db, table, db->infile );
     if (r != LIBMSI_RESULT_SUCCESS)
     {
         list_remove(&table->entry);
         free_table( table );
         return r;
     }
+    db->n_table_loads++;
     *table_ret = table;
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -744,6 +1137,7 @@ unsigned msi_create_table( LibmsiDatabase *db, const char *name, column_info *co
     table->colinfo = NULL;
     table->col_count = 0;
     table->persistent = persistent;
+    table->modified = true;
     strcpy( table->name, name );
 
     for( col = col_info; col; col = col->next )
@@ -879,6 +1273,9 @@ static unsigned save_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned b
 
     TRACE("Saving %s\n", debugstr_a( t->name ) );
 
+    if (!msi_progress_update( db, 0, 0 ))
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+
     row_size = msi_table_get_row_size( db, t->colinfo, t->col_count, bytes_per_strref );
     row_count = t->row_count;
     for (i = 0; i < t->row_count; i++)
@@ -936,6 +1333,8 @@ static unsigned save_table( LibmsiDatabase *db, const LibmsiTable *t, unsigned b
 
     TRACE("writing %d bytes\n", rawsize);
     r = write_stream_data( db, t->name, rawdata, rawsize );
+    if (r == LIBMSI_RESULT_SUCCESS)
+        msi_progress_update( db, rawsize, t->row_count );
 
 err:
     msi_free( rawdata );
@@ -945,11 +1344,13 @@ err:
 static void msi_update_table_columns( LibmsiDatabase *db, const char *name )
 {
     LibmsiTable *table;
-    unsigned size, offset, old_count;
+    unsigned size, offset, old_count, old_size;
     unsigned n;
 
     table = find_cached_table( db, name );
+    table->modified = true;
     old_count = table->col_count;
+    old_size = msi_table_get_row_size( db, table->colinfo, table->col_count, LONG_STR_BYTES );
     msi_free_colinfo( table->colinfo, table->col_count );
     msi_free( table->colinfo );
     table->colinfo = NULL;
@@ -962,7 +1363,14 @@ static void msi_update_table_columns( LibmsiDatabase *db, const char *name )
 
     for ( n = 0; n < table->row_count; n++ )
     {
-        table->data[n] = msi_realloc( table->data[n], size );
+        if (table_row_is_mapped( table, table->data[n] ))
+        {
+            uint8_t *row = msi_alloc( size );
+            memcpy( row, table->data[n], MIN( old_size, size ) );
+            table->data[n] = row;
+        }
+        else
+            table->data[n] = msi_realloc( table->data[n], size );
         if (old_count < table->col_count)
             memset( &table->data[n][offset], 0, size - offset );
     }
@@ -1011,6 +1419,8 @@ typedef struct _LibmsiTableView
     LibmsiColumnInfo *columns;
     unsigned           num_cols;
     unsigned           row_size;
+    GHashTable        *keys;
+    unsigned           keys_rows;
     char          name[1];
 } LibmsiTableView;
 
@@ -1207,6 +1617,8 @@ static unsigned table_view_set_int( LibmsiTableView *tv, unsigned row, unsigned
     for ( i = 0; i < n; i++ )
         tv->table->data[row][offset + i] = (val >> i * 8) & 0xff;
 
+    tv->table->modified = true;
+
     return LIBMSI_RESULT_SUCCESS;
 }
 
@@ -1440,6 +1852,7 @@ static unsigned table_create_new_row( LibmsiView *view, unsigned *num, bool temp
     (*data_persist_ptr)[*row_count] = !temporary;
 
     (*row_count)++;
+    tv->table->modified = true;
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -1516,9 +1929,9 @@ static unsigned table_view_get_column_info( LibmsiView *view,
 
 static unsigned msi_table_find_row( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *row, unsigned *column );
 
-static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
+static unsigned table_validate_nulls( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
 {
-    unsigned r, row, i;
+    unsigned i;
 
     /* check there's no null values where they're not allowed */
     for( i = 0; i < tv->num_cols; i++ )
@@ -1552,6 +1965,17 @@ static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsi
         }
     }
 
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned table_validate_new( LibmsiTableView *tv, LibmsiRecord *rec, unsigned *column )
+{
+    unsigned r, row;
+
+    r = table_validate_nulls( tv, rec, column );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
     /* check there's no duplicate keys */
     r = msi_table_find_row( tv, rec, &row, column );
     if (r == LIBMSI_RESULT_SUCCESS)
@@ -1618,58 +2042,453 @@ static int find_insert_index( LibmsiTableView *tv, LibmsiRecord *rec )
     return high + 1;
 }
 
-static unsigned table_view_insert_row( LibmsiView *view, LibmsiRecord *rec, unsigned row, bool temporary )
+static bool table_has_keys( const LibmsiTableView *tv )
 {
-    LibmsiTableView *tv = (LibmsiTableView*)view;
-    unsigned i, r;
+    unsigned i;
 
-    TRACE("%p %p %s\n", tv, rec, temporary ? "true" : "false" );
+    for (i = 0; i < tv->num_cols; i++)
+        if (tv->columns[i].type & MSITYPE_KEY)
+            return true;
+    return false;
+}
 
-    /* check that the key is unique - can we find a matching row? */
-    r = table_validate_new( tv, rec, NULL );
-    if( r != LIBMSI_RESULT_SUCCESS )
-        return LIBMSI_RESULT_FUNCTION_FAILED;
+/* A primary key as bytes, so that whole keys hash and compare at once.
+ * Values are encoded as the table stores them; a string that is not in
+ * the string table yet goes in as text, which no stored key can match. */
+static GBytes *msi_record_key( LibmsiTableView *tv, LibmsiRecord *rec )
+{
+    GByteArray *key = g_byte_array_new();
+    const char *str;
+    unsigned i, r, val;
+    guint8 tag;
 
-    if (row == -1)
-        row = find_insert_index( tv, rec );
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (!(tv->columns[i].type & MSITYPE_KEY))
+            continue;
 
-    r = table_create_new_row( view, &row, temporary );
-    TRACE("insert_row returned %08x\n", r);
-    if( r != LIBMSI_RESULT_SUCCESS )
-        return r;
+        val = 0;
+        r = LIBMSI_RESULT_SUCCESS;
+        if (!libmsi_record_is_null( rec, i + 1 ))
+            r = get_table_value_from_record( tv, rec, i + 1, &val );
 
-    /* shift the rows to make room for the new row */
-    for (i = tv->table->row_count - 1; i > row; i--)
-    {
-        memmove(&(tv->table->data[i][0]),
-                &(tv->table->data[i - 1][0]), tv->row_size);
-        tv->table->data_persistent[i] = tv->table->data_persistent[i - 1];
+        str = r == LIBMSI_RESULT_NOT_FOUND ? _libmsi_record_get_string_raw( rec, i + 1 ) : NULL;
+        if (str && str[0])
+        {
+            tag = 1;
+            g_byte_array_append( key, &tag, 1 );
+            g_byte_array_append( key, (const guint8 *)str, strlen( str ) + 1 );
+            continue;
+        }
+        if (r != LIBMSI_RESULT_SUCCESS && r != LIBMSI_RESULT_NOT_FOUND)
+        {
+            g_byte_array_unref( key );
+            return NULL;
+        }
+
+        /* an empty string is stored as no string at all */
+        tag = 0;
+        g_byte_array_append( key, &tag, 1 );
+        g_byte_array_append( key, (const guint8 *)&val, sizeof(val) );
     }
 
-    /* Re-set the persistence flag */
-    tv->table->data_persistent[row] = !temporary;
-    return table_view_set_row( view, row, rec, (1<<tv->num_cols) - 1 );
+    return g_byte_array_free_to_bytes( key );
 }
 
-static unsigned table_view_delete_row( LibmsiView *view, unsigned row )
+static GBytes *msi_row_key( LibmsiTableView *tv, unsigned row )
 {
-    LibmsiTableView *tv = (LibmsiTableView*)view;
-    unsigned r, num_rows, num_cols, i;
+    GByteArray *key = g_byte_array_new();
+    unsigned i, val;
+    guint8 tag = 0;
 
-    TRACE("%p %d\n", tv, row);
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (!(tv->columns[i].type & MSITYPE_KEY))
+            continue;
 
-    if ( !tv->table )
-        return LIBMSI_RESULT_INVALID_PARAMETER;
+        table_view_fetch_int( &tv->view, row, i + 1, &val );
+        g_byte_array_append( key, &tag, 1 );
+        g_byte_array_append( key, (const guint8 *)&val, sizeof(val) );
+    }
 
-    r = table_view_get_dimensions( view, &num_rows, &num_cols );
-    if ( r != LIBMSI_RESULT_SUCCESS )
-        return r;
+    return g_byte_array_free_to_bytes( key );
+}
+
+static void table_forget_keys( LibmsiTableView *tv )
+{
+    if (tv->keys)
+        g_hash_table_unref( tv->keys );
+    tv->keys = NULL;
+}
+
+/* The keys of the table's rows, built on the first append through the
+ * view and kept up to date by the appends after it, so that batch
+ * after batch is checked without going over the table again.  Other
+ * row changes through the view drop it. */
+static GHashTable *table_get_keys( LibmsiTableView *tv )
+{
+    unsigned i;
+
+    /* another view may have added or removed rows meanwhile */
+    if (tv->keys && tv->keys_rows != tv->table->row_count)
+        table_forget_keys( tv );
+
+    if (!tv->keys)
+    {
+        tv->keys = g_hash_table_new_full( g_bytes_hash, g_bytes_equal,
+                                          (GDestroyNotify)g_bytes_unref, NULL );
+        for (i = 0; i < tv->table->row_count; i++)
+            g_hash_table_add( tv->keys, msi_row_key( tv, i ) );
+        tv->keys_rows = tv->table->row_count;
+    }
+    return tv->keys;
+}
+
+/* Checks that no record repeats a key of the table or of another
+ * record, before anything is stored: set_row would replace the stream
+ * of a row with the same key. */
+static unsigned table_validate_keys( LibmsiTableView *tv, LibmsiRecord **recs, unsigned count )
+{
+    GHashTable *keys, *batch;
+    unsigned r = LIBMSI_RESULT_SUCCESS, i;
+    GBytes *key;
+
+    if (!table_has_keys( tv ))
+        return LIBMSI_RESULT_SUCCESS;
+
+    keys = table_get_keys( tv );
+    batch = g_hash_table_new_full( g_bytes_hash, g_bytes_equal,
+                                   (GDestroyNotify)g_bytes_unref, NULL );
+    for (i = 0; i < count; i++)
+    {
+        key = msi_record_key( tv, recs[i] );
+        if (!key)
+        {
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            break;
+        }
+
+        if (g_hash_table_contains( keys, key ) || g_hash_table_contains( batch, key ))
+        {
+            TRACE("duplicate key in record %u\n", i);
+            g_bytes_unref( key );
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            break;
+        }
+        g_hash_table_add( batch, key );
+    }
+
+    g_hash_table_unref( batch );
+    return r;
+}
+
+static unsigned table_view_insert_row( LibmsiView *view, LibmsiRecord *rec, unsigned row, bool temporary )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    unsigned i, r;
+
+    TRACE("%p %p %s\n", tv, rec, temporary ? "true" : "false" );
+
+    /* check that the key is unique - can we find a matching row? */
+    r = table_validate_new( tv, rec, NULL );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return LIBMSI_RESULT_FUNCTION_FAILED;
+    table_forget_keys( tv );
+
+    if (row == -1)
+        row = find_insert_index( tv, rec );
+
+    r = table_create_new_row( view, &row, temporary );
+    TRACE("insert_row returned %08x\n", r);
+    if( r != LIBMSI_RESULT_SUCCESS )
+        return r;
+
+    /* shift the rows to make room for the new row */
+    for (i = tv->table->row_count - 1; i > row; i--)
+    {
+        memmove(&(tv->table->data[i][0]),
+                &(tv->table->data[i - 1][0]), tv->row_size);
+        tv->table->data_persistent[i] = tv->table->data_persistent[i - 1];
+    }
+
+    /* Re-set the persistence flag */
+    tv->table->data_persistent[row] = !temporary;
+    return table_view_set_row( view, row, rec, (1<<tv->num_cols) - 1 );
+}
+
+/* set_row as the view's callers use it, to update rows in place; one
+ * that changes a key leaves the keys of msi_table_append_rows stale */
+static unsigned table_view_update_row( LibmsiView *view, unsigned row, LibmsiRecord *rec, unsigned mask )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    unsigned i;
+
+    for (i = 0; i < tv->num_cols; i++)
+        if ((mask & (1 << i)) && (tv->columns[i].type & MSITYPE_KEY))
+            table_forget_keys( tv );
+
+    return table_view_set_row( view, row, rec, mask );
+}
+
+typedef struct _LibmsiTableRow
+{
+    uint8_t *data;
+    bool persistent;
+} LibmsiTableRow;
+
+/* same ordering as compare_record, on two rows of the table */
+static int compare_rows( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+    const LibmsiTableView *tv = user_data;
+    const LibmsiTableRow *ra = a, *rb = b;
+    unsigned i, n, x, y;
+
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (!(tv->columns[i].type & MSITYPE_KEY)) continue;
+
+        n = bytes_per_column( tv->db, &tv->columns[i], LONG_STR_BYTES );
+        x = read_table_int( &ra->data, 0, tv->columns[i].offset, n );
+        y = read_table_int( &rb->data, 0, tv->columns[i].offset, n );
+        if (x != y)
+            return x < y ? -1 : 1;
+    }
+    return 0;
+}
+
+static void table_reset_hash_tables( LibmsiTableView *tv )
+{
+    unsigned i;
+
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        msi_free( tv->columns[i].hash_table );
+        tv->columns[i].hash_table = NULL;
+    }
+}
+
+/* Drop the rows from @first on, along with the streams set_row stored
+ * for them.  The strings they added are taken back through the string
+ * table's undo mark, which the caller holds. */
+void msi_table_discard_rows( LibmsiView *view, unsigned first )
+{
+    LibmsiTableView *tv = (LibmsiTableView *)view;
+    unsigned i, row, val;
+    char *stname, *encname;
+
+    while (tv->table->row_count > first)
+    {
+        row = tv->table->row_count - 1;
+        for (i = 0; i < tv->num_cols; i++)
+        {
+            if (!MSITYPE_IS_BINARY( tv->columns[i].type ))
+                continue;
+
+            /* left at 0 when set_row failed before the stream was stored */
+            if (table_view_fetch_int( view, row, i + 1, &val ) != LIBMSI_RESULT_SUCCESS || !val)
+                continue;
+            if (msi_stream_name( tv, row, &stname ) != LIBMSI_RESULT_SUCCESS)
+                continue;
+
+            encname = encode_streamname( false, stname );
+            msi_destroy_stream( tv->db, encname );
+            msi_free( encname );
+            msi_free( stname );
+        }
+
+        tv->table->row_count--;
+        table_free_row( tv->table, tv->table->data[row] );
+    }
+
+    table_forget_keys( tv );
+    table_reset_hash_tables( tv );
+}
+
+/* Append rows at the end of a table without keeping it sorted.  The
+ * row arrays grow once per call; msi_table_sort_rows puts the table
+ * back in order when all rows are in.  On failure no row is added,
+ * and the strings and streams of the rows already set are removed. */
+unsigned msi_table_append_rows( LibmsiView *view, LibmsiRecord **recs,
+                                unsigned count, bool temporary )
+{
+    LibmsiTableView *tv = (LibmsiTableView *)view;
+    uint8_t **data;
+    bool *persistent;
+    unsigned r, i, old_count, total, mark;
+
+    TRACE("%p %u rows\n", tv, count);
+
+    for (i = 0; i < count; i++)
+    {
+        r = table_validate_nulls( tv, recs[i], NULL );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            return r;
+    }
+
+    if (!count)
+        return LIBMSI_RESULT_SUCCESS;
+
+    r = table_validate_keys( tv, recs, count );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    old_count = tv->table->row_count;
+    total = old_count + count;
+
+    data = msi_realloc( tv->table->data, total * sizeof(uint8_t *) );
+    if (!data)
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    tv->table->data = data;
+
+    persistent = msi_realloc( tv->table->data_persistent, total * sizeof(bool) );
+    if (!persistent)
+        return LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+    tv->table->data_persistent = persistent;
+
+    mark = msi_string_table_begin_undo( tv->db->strings );
+    for (i = 0; i < count; i++)
+    {
+        unsigned row = tv->table->row_count;
+
+        tv->table->data[row] = msi_alloc_zero( tv->row_size );
+        if (!tv->table->data[row])
+        {
+            r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+            goto rollback;
+        }
+        tv->table->data_persistent[row] = !temporary;
+        tv->table->row_count++;
+
+        r = table_view_set_row( view, row, recs[i], (1 << tv->num_cols) - 1 );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto rollback;
+    }
+
+    msi_string_table_end_undo( tv->db->strings, mark, false );
+    if (tv->keys)
+    {
+        for (i = old_count; i < tv->table->row_count; i++)
+            g_hash_table_add( tv->keys, msi_row_key( tv, i ) );
+        tv->keys_rows = tv->table->row_count;
+    }
+    table_reset_hash_tables( tv );
+    tv->table->modified = true;
+    return LIBMSI_RESULT_SUCCESS;
+
+rollback:
+    msi_table_discard_rows( view, old_count );
+    msi_string_table_end_undo( tv->db->strings, mark, true );
+    return r;
+}
+
+/* Sort a table on its primary key after rows were appended from row
+ * @first on.  msi_table_append_rows already refuses duplicate keys;
+ * should two rows still share one, the appended rows are removed
+ * again and the table is left as it was before the append; their
+ * strings go with the undo mark the caller took before appending. */
+unsigned msi_table_sort_rows( LibmsiView *view, unsigned first )
+{
+    LibmsiTableView *tv = (LibmsiTableView *)view;
+    LibmsiTableRow *rows;
+    bool has_keys = false;
+    unsigned r = LIBMSI_RESULT_SUCCESS, i, total = tv->table->row_count;
+
+    for (i = 0; i < tv->num_cols; i++)
+        if (tv->columns[i].type & MSITYPE_KEY)
+            has_keys = true;
+
+    if (!has_keys || first >= total)
+        return LIBMSI_RESULT_SUCCESS;
+
+    rows = msi_alloc( total * sizeof(LibmsiTableRow) );
+    if (!rows)
+    {
+        r = LIBMSI_RESULT_NOT_ENOUGH_MEMORY;
+        goto rollback;
+    }
+    for (i = 0; i < total; i++)
+    {
+        rows[i].data = tv->table->data[i];
+        rows[i].persistent = tv->table->data_persistent[i];
+    }
+
+    g_qsort_with_data( rows, total, sizeof(LibmsiTableRow), compare_rows, tv );
+
+    for (i = 1; i < total; i++)
+    {
+        if (!compare_rows( &rows[i - 1], &rows[i], tv ))
+        {
+            TRACE("duplicate key in row %u\n", i);
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            goto rollback;
+        }
+    }
+
+    for (i = 0; i < total; i++)
+    {
+        tv->table->data[i] = rows[i].data;
+        tv->table->data_persistent[i] = rows[i].persistent;
+    }
+
+    /* rows moved around, reset the hash tables */
+    table_reset_hash_tables( tv );
+    msi_free( rows );
+    return LIBMSI_RESULT_SUCCESS;
+
+rollback:
+    msi_free( rows );
+    msi_table_discard_rows( view, first );
+    return r;
+}
+
+/* Insert many rows into a table at once.  The rows are appended and
+ * the table is sorted a single time, rather than searching for the
+ * insert position and shifting the tail of the table for every row.
+ * Duplicate keys fail the whole batch, and no row is added then. */
+unsigned msi_table_insert_rows( LibmsiDatabase *db, const char *name,
+                                LibmsiRecord **recs, unsigned count, bool temporary )
+{
+    LibmsiView *view;
+    unsigned r, old_count, mark;
+
+    TRACE("%s %u rows\n", debugstr_a(name), count);
+
+    r = table_view_create( db, name, &view );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    old_count = ((LibmsiTableView *)view)->table->row_count;
+    mark = msi_string_table_begin_undo( db->strings );
+    r = msi_table_append_rows( view, recs, count, temporary );
+    if (r == LIBMSI_RESULT_SUCCESS)
+        r = msi_table_sort_rows( view, old_count );
+    msi_string_table_end_undo( db->strings, mark, r != LIBMSI_RESULT_SUCCESS );
+
+    view->ops->delete( view );
+    return r;
+}
+
+static unsigned table_view_delete_row( LibmsiView *view, unsigned row )
+{
+    LibmsiTableView *tv = (LibmsiTableView*)view;
+    unsigned r, num_rows, num_cols, i;
+
+    TRACE("%p %d\n", tv, row);
+
+    if ( !tv->table )
+        return LIBMSI_RESULT_INVALID_PARAMETER;
+
+    r = table_view_get_dimensions( view, &num_rows, &num_cols );
+    if ( r != LIBMSI_RESULT_SUCCESS )
+        return r;
 
     if ( row >= num_rows )
         return LIBMSI_RESULT_FUNCTION_FAILED;
 
     num_rows = tv->table->row_count;
     tv->table->row_count--;
+    tv->table->modified = true;
+    table_forget_keys( tv );
 
     /* reset the hash tables */
     for (i = 0; i < tv->num_cols; i++)
@@ -1684,7 +2503,7 @@ static unsigned table_view_delete_row( LibmsiView *view, unsigned row )
         tv->table->data_persistent[i - 1] = tv->table->data_persistent[i];
     }
 
-    msi_free(tv->table->data[num_rows - 1]);
+    table_free_row( tv->table, tv->table->data[num_rows - 1] );
 
     return LIBMSI_RESULT_SUCCESS;
 }
@@ -1697,6 +2516,7 @@ static unsigned table_view_delete( LibmsiView *view )
 
     tv->table = NULL;
     tv->columns = NULL;
+    table_forget_keys( tv );
 
     msi_free( tv );
 
@@ -1740,6 +2560,7 @@ static unsigned table_view_find_matching_rows( LibmsiView *view, unsigned col,
 
         memset(hash_table, 0, LibmsiTable_HASH_TABLE_SIZE * sizeof(LibmsiColumnHashEntry*));
         tv->columns[col-1].hash_table = hash_table;
+        tv->db->n_index_builds++;
 
         new_entry = (LibmsiColumnHashEntry *)(hash_table + LibmsiTable_HASH_TABLE_SIZE);
 
@@ -1965,7 +2786,7 @@ static const LibmsiViewOps table_ops =
     table_view_fetch_int,
     table_view_fetch_stream,
     table_view_get_row,
-    table_view_set_row,
+    table_view_update_row,
     table_view_insert_row,
     table_view_delete_row,
     table_view_execute,
@@ -2024,6 +2845,8 @@ unsigned table_view_create( LibmsiDatabase *db, const char *name, LibmsiView **v
     return LIBMSI_RESULT_SUCCESS;
 }
 
+/* the tables stay cached, so that a commit that fails part way loses
+ * nothing; the caller drops them once the whole commit has succeeded */
 unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_strref )
 {
     unsigned r = LIBMSI_RESULT_SUCCESS;
@@ -2037,6 +2860,27 @@ unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_
 
     LIST_FOR_EACH_ENTRY_SAFE( table, table2, &db->tables, LibmsiTable, entry )
     {
+        /* Tables that were never loaded or not modified since are
+         * still byte-for-byte identical to the input file, as long as
+         * string references keep the same width.  */
+        if( !table->modified && table->persistent != LIBMSI_CONDITION_FALSE &&
+            bytes_per_strref == db->bytes_per_strref )
+        {
+            r = msi_copy_raw_stream( db, table->name );
+            if( r == LIBMSI_RESULT_SUCCESS )
+            {
+                TRACE("Copied unmodified %s\n", debugstr_a( table->name ) );
+                continue;
+            }
+            /* a partial copy is already in the output file */
+            if( r != LIBMSI_RESULT_NOT_FOUND )
+            {
+                g_warning("failed to copy table %s (r=%08x)\n",
+                      debugstr_a(table->name), r);
+                return r;
+            }
+        }
+
         r = get_table( db, table->name, &t );
         if( r != LIBMSI_RESULT_SUCCESS )
         {
@@ -2051,8 +2895,6 @@ unsigned _libmsi_database_commit_tables( LibmsiDatabase *db, unsigned bytes_per_
                   debugstr_a(table->name), r);
             return r;
         }
-        list_remove(&table->entry);
-        free_table(table);
     }
 
     return r;
@@ -2362,50 +3204,311 @@ typedef struct
     char *name;
 } TRANSFORMDATA;
 
-static unsigned msi_table_load_transform( LibmsiDatabase *db, GsfInfile *stg,
-                                      string_table *st, TRANSFORMDATA *transform,
-                                      unsigned bytes_per_strref )
+typedef struct
 {
-    uint8_t *rawdata = NULL;
-    LibmsiTableView *tv = NULL;
-    unsigned r, n, sz, i, mask, num_cols, colcol = 0, rawsize = 0;
-    LibmsiRecord *rec = NULL;
-    char coltable[32];
-    const char *name;
-
-    if (!transform)
-        return LIBMSI_RESULT_SUCCESS;
+    LibmsiRecord *rec;
+    unsigned mask;
+} TRANSFORMROW;
 
-    name = transform->name;
+/* the index entries of a transform batch: rows already in the table
+ * and rows waiting to be inserted */
+#define TRANSFORM_EXISTING(n)   GUINT_TO_POINTER((n) << 1)
+#define TRANSFORM_PENDING(n)    GUINT_TO_POINTER(((n) << 1) | 1)
 
-    coltable[0] = 0;
-    TRACE("%p %p %p %s\n", db, stg, st, debugstr_a(name) );
+static void transform_key_append( GByteArray *key, const LibmsiColumnInfo *col,
+                                  const char *str, unsigned val )
+{
+    uint8_t tag;
 
-    /* read the transform data */
-    read_stream_data( stg, name, &rawdata, &rawsize );
-    if ( !rawdata )
+    if ((col->type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(col->type))
     {
-        TRACE("table %s empty\n", debugstr_a(name) );
-        return LIBMSI_RESULT_INVALID_TABLE;
+        tag = (str && str[0]) ? 's' : 'n';
+        g_byte_array_append( key, &tag, 1 );
+        if (tag == 's')
+            g_byte_array_append( key, (const uint8_t *)str, strlen( str ) + 1 );
+    }
+    else
+    {
+        tag = 'i';
+        g_byte_array_append( key, &tag, 1 );
+        g_byte_array_append( key, (const uint8_t *)&val, sizeof(val) );
     }
+}
 
-    /* create a table view */
-    r = table_view_create( db, name, (LibmsiView**) &tv );
-    if( r != LIBMSI_RESULT_SUCCESS )
-        goto err;
+/* key of a table row; strings go by value, as the transform's string
+ * ids belong to its own string table */
+static GBytes *transform_row_key( LibmsiTableView *tv, unsigned row )
+{
+    GByteArray *key = g_byte_array_new();
+    const char *str;
+    unsigned i, val;
 
-    r = tv->view.ops->execute( &tv->view, NULL );
-    if( r != LIBMSI_RESULT_SUCCESS )
-        goto err;
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (~tv->columns[i].type & MSITYPE_KEY)
+            continue;
 
-    TRACE("name = %s columns = %u row_size = %u raw size = %u\n",
-          debugstr_a(name), tv->num_cols, tv->row_size, rawsize );
+        val = 0;
+        table_view_fetch_int( &tv->view, row, i + 1, &val );
+        str = NULL;
+        if ((tv->columns[i].type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(tv->columns[i].type))
+            str = msi_string_lookup_id( tv->db->strings, val );
+        transform_key_append( key, &tv->columns[i], str, val );
+    }
+    return g_byte_array_free_to_bytes( key );
+}
 
-    /* interpret the data */
-    for (n = 0; n < rawsize;)
-    {
-        mask = rawdata[n] | (rawdata[n + 1] << 8);
-        if (mask & 1)
+/* key of a transform record, encoded as msi_record_to_row does */
+static GBytes *transform_record_key( const LibmsiTableView *tv, LibmsiRecord *rec )
+{
+    GByteArray *key = g_byte_array_new();
+    const char *str;
+    unsigned i, val;
+
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        if (~tv->columns[i].type & MSITYPE_KEY)
+            continue;
+
+        str = NULL;
+        val = 0;
+        if ((tv->columns[i].type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(tv->columns[i].type))
+            str = _libmsi_record_get_string_raw( rec, i + 1 );
+        else
+        {
+            val = libmsi_record_get_int( rec, i + 1 );
+            if (val == LIBMSI_NULL_INT)
+                val = 0;
+            else if ((tv->columns[i].type & 0xff) == 2)
+                val += 0x8000;
+            else
+                val += 0x80000000;
+        }
+        transform_key_append( key, &tv->columns[i], str, val );
+    }
+    return g_byte_array_free_to_bytes( key );
+}
+
+static bool transform_has_keys( const LibmsiTableView *tv )
+{
+    unsigned i;
+
+    for (i = 0; i < tv->num_cols; i++)
+        if (tv->columns[i].type & MSITYPE_KEY)
+            return true;
+    return false;
+}
+
+/* a row inserted earlier in the same transform is modified again */
+static LibmsiRecord *transform_merge_record( const LibmsiTableView *tv, LibmsiRecord *old,
+                                             LibmsiRecord *rec, unsigned mask )
+{
+    LibmsiRecord *merged;
+    unsigned i;
+
+    merged = libmsi_record_new( tv->num_cols );
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        bool present = (mask & 1) || (tv->columns[i].type & MSITYPE_KEY) || (mask & (1 << i));
+
+        _libmsi_record_copy_field( present ? rec : old, i + 1, merged, i + 1 );
+    }
+    return merged;
+}
+
+/* drop the rows flagged for deletion in one pass over the table */
+static void transform_delete_rows( LibmsiTableView *tv, const bool *deleted )
+{
+    unsigned i, n = 0;
+
+    for (i = 0; i < tv->table->row_count; i++)
+    {
+        if (deleted[i])
+        {
+            table_free_row( tv->table, tv->table->data[i] );
+            continue;
+        }
+        tv->table->data[n] = tv->table->data[i];
+        tv->table->data_persistent[n] = tv->table->data_persistent[i];
+        n++;
+    }
+    tv->table->row_count = n;
+    tv->table->modified = true;
+
+    /* reset the hash tables */
+    for (i = 0; i < tv->num_cols; i++)
+    {
+        msi_free( tv->columns[i].hash_table );
+        tv->columns[i].hash_table = NULL;
+    }
+}
+
+/*
+ * Apply a batch of transform rows to a table.  The rows of the table
+ * are indexed on their primary key once; updates are made in place,
+ * deletions are flagged and swept in a single pass, and the new rows
+ * are added together at the end.
+ */
+static void transform_apply_rows( LibmsiDatabase *db, LibmsiTableView *tv,
+                                  GArray *batch )
+{
+    GHashTable *index = NULL;
+    GPtrArray *inserts;
+    bool *deleted = NULL;
+    unsigned i, n, r, row, num_deleted = 0;
+    gpointer value;
+
+    inserts = g_ptr_array_new_with_free_func( g_object_unref );
+
+    /* without a key, every record is a new row */
+    if (transform_has_keys( tv ))
+    {
+        index = g_hash_table_new_full( g_bytes_hash, g_bytes_equal,
+                                       (GDestroyNotify)g_bytes_unref, NULL );
+        for (i = 0; i < tv->table->row_count; i++)
+            g_hash_table_replace( index, transform_row_key( tv, i ), TRANSFORM_EXISTING(i) );
+        db->n_index_builds++;
+
+        deleted = msi_alloc_zero( (tv->table->row_count + 1) * sizeof(bool) );
+    }
+
+    for (i = 0; i < batch->len; i++)
+    {
+        TRANSFORMROW *tr = &g_array_index( batch, TRANSFORMROW, i );
+        GBytes *key = NULL;
+
+        if (index)
+            key = transform_record_key( tv, tr->rec );
+
+        if (!key || !g_hash_table_lookup_extended( index, key, NULL, &value ))
+        {
+            TRACE("inserting row\n");
+            g_ptr_array_add( inserts, g_object_ref( tr->rec ) );
+            if (key)
+                g_hash_table_insert( index, key, TRANSFORM_PENDING(inserts->len - 1) );
+            continue;
+        }
+
+        n = GPOINTER_TO_UINT(value) >> 1;
+        if (GPOINTER_TO_UINT(value) & 1)
+        {
+            if (!tr->mask)
+            {
+                TRACE("dropping new row [%d]:\n", n);
+                g_object_unref( g_ptr_array_index( inserts, n ) );
+                g_ptr_array_index( inserts, n ) = NULL;
+                g_hash_table_remove( index, key );
+            }
+            else
+            {
+                LibmsiRecord *merged;
+
+                TRACE("modifying new row [%d]:\n", n);
+                merged = transform_merge_record( tv, g_ptr_array_index( inserts, n ),
+                                                 tr->rec, tr->mask );
+                g_object_unref( g_ptr_array_index( inserts, n ) );
+                g_ptr_array_index( inserts, n ) = merged;
+            }
+        }
+        else
+        {
+            row = n;
+            if (!tr->mask)
+            {
+                TRACE("deleting row [%d]:\n", row);
+                deleted[row] = true;
+                num_deleted++;
+                g_hash_table_remove( index, key );
+            }
+            else
+            {
+                TRACE("modifying %s row [%d]:\n", tr->mask & 1 ? "full" : "masked", row);
+                r = table_view_set_row( &tv->view, row, tr->rec,
+                                        tr->mask & 1 ? (1 << tv->num_cols) - 1 : tr->mask );
+                if (r != LIBMSI_RESULT_SUCCESS)
+                    g_warning("failed to modify row %u\n", r);
+            }
+        }
+        g_bytes_unref( key );
+    }
+
+    if (num_deleted)
+        transform_delete_rows( tv, deleted );
+
+    /* rows dropped again by a later delete leave holes */
+    for (i = n = 0; i < inserts->len; i++)
+        if (g_ptr_array_index( inserts, i ))
+            g_ptr_array_index( inserts, n++ ) = g_ptr_array_index( inserts, i );
+    g_ptr_array_set_size( inserts, n );
+
+    r = msi_table_insert_rows( db, tv->name, (LibmsiRecord **)inserts->pdata, inserts->len, false );
+    if (r != LIBMSI_RESULT_SUCCESS)
+    {
+        /* a bad row fails the whole batch, insert them one by one */
+        for (i = 0; i < inserts->len; i++)
+        {
+            r = table_view_insert_row( &tv->view, g_ptr_array_index( inserts, i ), -1, false );
+            if (r != LIBMSI_RESULT_SUCCESS)
+                g_warning("failed to insert row %u\n", r);
+        }
+    }
+
+    g_ptr_array_unref( inserts );
+    if (index)
+        g_hash_table_destroy( index );
+    msi_free( deleted );
+}
+
+static unsigned msi_table_load_transform( LibmsiDatabase *db, GsfInfile *stg,
+                                      string_table *st, TRANSFORMDATA *transform,
+                                      unsigned bytes_per_strref )
+{
+    uint8_t *rawdata = NULL;
+    LibmsiTableView *tv = NULL;
+    unsigned r, n, sz, i, mask, num_cols, colcol = 0, rawsize = 0;
+    unsigned ret = LIBMSI_RESULT_SUCCESS;
+    LibmsiRecord *rec = NULL;
+    GArray *batch = NULL;
+    GPtrArray *updated = NULL;
+    char coltable[32];
+    const char *name;
+
+    if (!transform)
+        return LIBMSI_RESULT_SUCCESS;
+
+    name = transform->name;
+
+    coltable[0] = 0;
+    TRACE("%p %p %p %s\n", db, stg, st, debugstr_a(name) );
+
+    /* read the transform data */
+    read_stream_data( stg, name, &rawdata, &rawsize );
+    if ( !rawdata )
+    {
+        TRACE("table %s empty\n", debugstr_a(name) );
+        return LIBMSI_RESULT_INVALID_TABLE;
+    }
+
+    /* create a table view */
+    r = table_view_create( db, name, (LibmsiView**) &tv );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        goto err;
+
+    r = tv->view.ops->execute( &tv->view, NULL );
+    if( r != LIBMSI_RESULT_SUCCESS )
+        goto err;
+
+    TRACE("name = %s columns = %u row_size = %u raw size = %u\n",
+          debugstr_a(name), tv->num_cols, tv->row_size, rawsize );
+
+    batch = g_array_new( FALSE, FALSE, sizeof(TRANSFORMROW) );
+    updated = g_ptr_array_new_with_free_func( g_free );
+
+    /* interpret the data */
+    for (n = 0; n < rawsize;)
+    {
+        mask = rawdata[n] | (rawdata[n + 1] << 8);
+        if (mask & 1)
         {
             /*
              * if the low bit is set, columns are continuous and
@@ -2458,13 +3561,14 @@ static unsigned msi_table_load_transform( LibmsiDatabase *db, GsfInfile *stg,
         rec = msi_get_transform_record( tv, st, stg, &rawdata[n], bytes_per_strref );
         if (rec)
         {
-            char table[32];
-            unsigned number = LIBMSI_NULL_INT;
-            unsigned row = 0;
+            TRANSFORMROW tr;
 
             if (!strcmp( name, szColumns ))
             {
+                char table[32];
                 unsigned tablesz = 32;
+                unsigned number;
+
                 _libmsi_record_get_string( rec, 1, table, &tablesz );
                 number = libmsi_record_get_int( rec, 2 );
 
@@ -2484,59 +3588,48 @@ static unsigned msi_table_load_transform( LibmsiDatabase *db, GsfInfile *stg,
                     /* fix nul column numbers */
                     libmsi_record_set_int( rec, 2, ++colcol );
                 }
-            }
-
-            if (TRACE_ON) dump_record( rec );
-
-            r = msi_table_find_row( tv, rec, &row, NULL );
-            if (r == LIBMSI_RESULT_SUCCESS)
-            {
-                if (!mask)
-                {
-                    TRACE("deleting row [%d]:\n", row);
-                    r = table_view_delete_row( &tv->view, row );
-                    if (r != LIBMSI_RESULT_SUCCESS)
-                        g_warning("failed to delete row %u\n", r);
-                }
-                else if (mask & 1)
-                {
-                    TRACE("modifying full row [%d]:\n", row);
-                    r = table_view_set_row( &tv->view, row, rec, (1 << tv->num_cols) - 1 );
-                    if (r != LIBMSI_RESULT_SUCCESS)
-                        g_warning("failed to modify row %u\n", r);
-                }
                 else
-                {
-                    TRACE("modifying masked row [%d]:\n", row);
-                    r = table_view_set_row( &tv->view, row, rec, mask );
-                    if (r != LIBMSI_RESULT_SUCCESS)
-                        g_warning("failed to modify row %u\n", r);
-                }
-            }
-            else
-            {
-                TRACE("inserting row\n");
-                r = table_view_insert_row( &tv->view, rec, -1, false );
-                if (r != LIBMSI_RESULT_SUCCESS)
-                    g_warning("failed to insert row %u\n", r);
+                    g_ptr_array_add( updated, g_strdup( table ) );
             }
 
-            if (number != LIBMSI_NULL_INT && !strcmp( name, szColumns ))
-                msi_update_table_columns( db, table );
+            if (TRACE_ON) dump_record( rec );
 
-            g_object_unref(rec);
+            tr.rec = rec;
+            tr.mask = mask;
+            g_array_append_val( batch, tr );
         }
 
         n += sz;
+        if (!msi_progress_update( db, sz, 1 ))
+        {
+            ret = LIBMSI_RESULT_FUNCTION_FAILED;
+            break;
+        }
+    }
+
+    if (ret == LIBMSI_RESULT_SUCCESS)
+    {
+        transform_apply_rows( db, tv, batch );
+
+        for (i = 0; i < updated->len; i++)
+            msi_update_table_columns( db, g_ptr_array_index( updated, i ) );
     }
 
 err:
+    if (batch)
+    {
+        for (i = 0; i < batch->len; i++)
+            g_object_unref( g_array_index( batch, TRANSFORMROW, i ).rec );
+        g_array_free( batch, TRUE );
+    }
+    if (updated)
+        g_ptr_array_unref( updated );
     /* no need to free the table, it's associated with the database */
     msi_free( rawdata );
     if( tv )
         tv->view.ops->delete( &tv->view );
 
-    return LIBMSI_RESULT_SUCCESS;
+    return ret;
 }
 
 /*
@@ -2648,3 +3741,535 @@ end:
 
     return ret;
 }
+
+/*
+ * Transform generation
+ *
+ * The two databases are walked table by table.  String ids mean
+ * nothing across string tables, so the persistent rows of each table
+ * are sorted on the values of their primary keys, and the two sides
+ * are then merge joined: rows only in the new database are inserted,
+ * rows only in the reference are deleted, and rows found in both give
+ * an update carrying the columns that changed.  Rows are written in
+ * the format read back by msi_table_load_transform.
+ */
+
+typedef struct
+{
+    struct list entry;
+    char *name;
+    LibmsiColumnInfo *columns;
+    unsigned num_cols;
+    GArray *data;               /* each row: its mask, then its values */
+} TRANSFORMTABLE;
+
+static TRANSFORMTABLE *transform_table_new( struct list *tables, const char *name,
+                                            const LibmsiColumnInfo *columns, unsigned num_cols )
+{
+    TRANSFORMTABLE *tt;
+
+    tt = msi_alloc_zero( sizeof(TRANSFORMTABLE) );
+    if (!tt)
+        return NULL;
+
+    tt->name = strdup( name );
+    tt->columns = msi_alloc( num_cols * sizeof(LibmsiColumnInfo) );
+    memcpy( tt->columns, columns, num_cols * sizeof(LibmsiColumnInfo) );
+    tt->num_cols = num_cols;
+    tt->data = g_array_new( FALSE, FALSE, sizeof(unsigned) );
+    list_add_tail( tables, &tt->entry );
+    return tt;
+}
+
+static void transform_table_free( TRANSFORMTABLE *tt )
+{
+    list_remove( &tt->entry );
+    g_array_free( tt->data, TRUE );
+    msi_free( tt->columns );
+    msi_free( tt->name );
+    msi_free( tt );
+}
+
+static bool transform_row_has_column( const LibmsiColumnInfo *col, unsigned i, unsigned mask )
+{
+    if (mask & 1)
+        return i < (mask >> 8);
+
+    return (col->type & MSITYPE_KEY) || (i < 16 && (mask & (1 << i)));
+}
+
+static unsigned transform_string( string_table *st, const char *str )
+{
+    int id = _libmsi_add_string( st, str, -1, 1, StringPersistent );
+
+    return id < 0 ? 0 : id;
+}
+
+static const char *transform_row_string( LibmsiTableView *tv, unsigned row, unsigned col )
+{
+    unsigned val = 0;
+
+    table_view_fetch_int( &tv->view, row, col + 1, &val );
+    return msi_string_lookup_id( tv->db->strings, val );
+}
+
+static int transform_compare_keys( LibmsiTableView *a, unsigned ra,
+                                   LibmsiTableView *b, unsigned rb )
+{
+    unsigned i, x = 0, y = 0;
+    int c;
+
+    for (i = 0; i < a->num_cols; i++)
+    {
+        if (!(a->columns[i].type & MSITYPE_KEY))
+            continue;
+
+        if ((a->columns[i].type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(a->columns[i].type))
+            c = g_strcmp0( transform_row_string( a, ra, i ), transform_row_string( b, rb, i ) );
+        else
+        {
+            table_view_fetch_int( &a->view, ra, i + 1, &x );
+            table_view_fetch_int( &b->view, rb, i + 1, &y );
+            c = x < y ? -1 : x > y;
+        }
+        if (c)
+            return c;
+    }
+    return 0;
+}
+
+static int transform_compare_rows( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+    LibmsiTableView *tv = user_data;
+
+    return transform_compare_keys( tv, *(const unsigned *)a, tv, *(const unsigned *)b );
+}
+
+static unsigned *transform_sorted_rows( LibmsiTableView *tv, unsigned *count )
+{
+    unsigned *rows, i, n = 0;
+
+    rows = msi_alloc( (tv->table->row_count + 1) * sizeof(unsigned) );
+    if (!rows)
+        return NULL;
+
+    for (i = 0; i < tv->table->row_count; i++)
+        if (tv->table->data_persistent[i])
+            rows[n++] = i;
+
+    g_qsort_with_data( rows, n, sizeof(unsigned), transform_compare_rows, tv );
+    *count = n;
+    return rows;
+}
+
+static unsigned transform_persistent_cols( const LibmsiTableView *tv )
+{
+    unsigned n = tv->num_cols;
+
+    while (n && tv->columns[n - 1].temporary)
+        n--;
+    return n;
+}
+
+static bool transform_streams_equal( LibmsiTableView *a, unsigned ra,
+                                     LibmsiTableView *b, unsigned rb, unsigned col )
+{
+    GsfInput *x = NULL, *y = NULL;
+    bool equal = false;
+    gsf_off_t size;
+
+    if (table_view_fetch_stream( &a->view, ra, col + 1, &x ) != LIBMSI_RESULT_SUCCESS ||
+        table_view_fetch_stream( &b->view, rb, col + 1, &y ) != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    size = gsf_input_size( x );
+    if (size != gsf_input_size( y ))
+        goto done;
+
+    gsf_input_seek( x, 0, G_SEEK_SET );
+    gsf_input_seek( y, 0, G_SEEK_SET );
+    while (size > 0)
+    {
+        size_t count = MIN( size, 0x10000 );
+        const guint8 *dx = gsf_input_read( x, count, NULL );
+        const guint8 *dy = gsf_input_read( y, count, NULL );
+
+        if (!dx || !dy || memcmp( dx, dy, count ))
+            goto done;
+        size -= count;
+    }
+    equal = true;
+
+done:
+    if (x)
+        g_object_unref( G_OBJECT(x) );
+    if (y)
+        g_object_unref( G_OBJECT(y) );
+    return equal;
+}
+
+/* columns the reference doesn't have are unchanged only when null */
+static bool transform_values_equal( LibmsiTableView *a, unsigned ra,
+                                    LibmsiTableView *b, unsigned rb,
+                                    unsigned col, unsigned ref_cols )
+{
+    unsigned type = a->columns[col].type;
+    unsigned x = 0, y = 0;
+
+    table_view_fetch_int( &a->view, ra, col + 1, &x );
+    if (col >= ref_cols)
+        return !x;
+
+    if (MSITYPE_IS_BINARY(type))
+    {
+        table_view_fetch_int( &b->view, rb, col + 1, &y );
+        if (!x || !y)
+            return !x == !y;
+        return transform_streams_equal( a, ra, b, rb, col );
+    }
+
+    if (type & MSITYPE_STRING)
+        return !g_strcmp0( transform_row_string( a, ra, col ),
+                           transform_row_string( b, rb, col ) );
+
+    table_view_fetch_int( &b->view, rb, col + 1, &y );
+    return x == y;
+}
+
+static unsigned transform_copy_stream( LibmsiTableView *tv, unsigned row, unsigned col,
+                                       GsfOutfile *outfile )
+{
+    GsfInput *in = NULL;
+    GsfOutput *out;
+    const char *stname;
+    char *encname;
+    unsigned r;
+
+    r = table_view_fetch_stream( &tv->view, row, col + 1, &in );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    stname = g_object_get_data( G_OBJECT(in), "stname" );
+    encname = encode_streamname( false, stname );
+    out = gsf_outfile_new_child( outfile, encname, false );
+    msi_free( encname );
+
+    if (!out || !copy_stream_data( tv->db, in, out ))
+        r = LIBMSI_RESULT_FUNCTION_FAILED;
+
+    if (out)
+    {
+        gsf_output_close( out );
+        g_object_unref( G_OBJECT(out) );
+    }
+    g_object_unref( G_OBJECT(in) );
+    return r;
+}
+
+static unsigned transform_add_row( TRANSFORMTABLE *tt, string_table *st, GsfOutfile *outfile,
+                                   LibmsiTableView *tv, unsigned row, unsigned mask )
+{
+    unsigned i, r, val;
+
+    g_array_append_val( tt->data, mask );
+    for (i = 0; i < tt->num_cols; i++)
+    {
+        if (!transform_row_has_column( &tt->columns[i], i, mask ))
+            continue;
+
+        val = 0;
+        table_view_fetch_int( &tv->view, row, i + 1, &val );
+        if (MSITYPE_IS_BINARY(tv->columns[i].type))
+        {
+            if (val)
+            {
+                r = transform_copy_stream( tv, row, i, outfile );
+                if (r != LIBMSI_RESULT_SUCCESS)
+                    return r;
+            }
+        }
+        else if (tv->columns[i].type & MSITYPE_STRING)
+            val = transform_string( st, msi_string_lookup_id( tv->db->strings, val ) );
+
+        g_array_append_val( tt->data, val );
+    }
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+static unsigned transform_diff_table( LibmsiDatabase *db, LibmsiDatabase *ref, const char *name,
+                                      string_table *st, GsfOutfile *outfile,
+                                      struct list *tables, TRANSFORMTABLE *columns_tt )
+{
+    LibmsiTableView *tv = NULL, *rtv = NULL;
+    TRANSFORMTABLE *tt;
+    unsigned *rows = NULL, *rrows = NULL;
+    unsigned r, i, j, k, n = 0, rn = 0, num_cols, ref_cols = 0, mask;
+    bool full;
+    int c;
+
+    TRACE("%s\n", debugstr_a(name));
+
+    r = table_view_create( db, name, (LibmsiView **)&tv );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+    num_cols = transform_persistent_cols( tv );
+
+    if (ref)
+    {
+        r = table_view_create( ref, name, (LibmsiView **)&rtv );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto done;
+
+        /* columns can only be added at the end of a table */
+        ref_cols = transform_persistent_cols( rtv );
+        r = LIBMSI_RESULT_DATATYPE_MISMATCH;
+        if (ref_cols > num_cols)
+            goto done;
+        for (i = 0; i < ref_cols; i++)
+            if (strcmp( tv->columns[i].colname, rtv->columns[i].colname ) ||
+                tv->columns[i].type != rtv->columns[i].type)
+                goto done;
+    }
+
+    /* native msi leaves the number out for the columns of new tables */
+    for (i = ref_cols; i < num_cols; i++)
+    {
+        unsigned values[4];
+
+        mask = (4 << 8) | 1;
+        values[0] = transform_string( st, name );
+        values[1] = ref ? 0x8000 + i + 1 : 0;
+        values[2] = transform_string( st, tv->columns[i].colname );
+        values[3] = 0x8000 + tv->columns[i].type;
+        g_array_append_val( columns_tt->data, mask );
+        g_array_append_vals( columns_tt->data, values, 4 );
+    }
+
+    r = LIBMSI_RESULT_OUTOFMEMORY;
+    rows = transform_sorted_rows( tv, &n );
+    if (!rows)
+        goto done;
+    if (rtv && !(rrows = transform_sorted_rows( rtv, &rn )))
+        goto done;
+
+    tt = transform_table_new( tables, name, tv->columns, num_cols );
+    if (!tt)
+        goto done;
+
+    r = LIBMSI_RESULT_SUCCESS;
+    for (i = j = 0; i < n || j < rn;)
+    {
+        if (i == n)
+            c = 1;
+        else if (j == rn)
+            c = -1;
+        else
+            c = transform_compare_keys( tv, rows[i], rtv, rrows[j] );
+
+        if (c < 0)
+            r = transform_add_row( tt, st, outfile, tv, rows[i++], (num_cols << 8) | 1 );
+        else if (c > 0)
+            r = transform_add_row( tt, st, outfile, rtv, rrows[j++], 0 );
+        else
+        {
+            mask = 0;
+            full = false;
+            for (k = 0; k < num_cols; k++)
+            {
+                if (tv->columns[k].type & MSITYPE_KEY)
+                    continue;
+                if (transform_values_equal( tv, rows[i], rtv, rrows[j], k, ref_cols ))
+                    continue;
+
+                /* the low bit flags a full row, and the mask has 16 bits */
+                if (k == 0 || k >= 16)
+                    full = true;
+                else
+                    mask |= 1 << k;
+            }
+            if (full)
+                mask = (num_cols << 8) | 1;
+            if (mask)
+                r = transform_add_row( tt, st, outfile, tv, rows[i], mask );
+            i++;
+            j++;
+        }
+
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+        if (!msi_progress_update( db, 0, 1 ))
+        {
+            r = LIBMSI_RESULT_FUNCTION_FAILED;
+            break;
+        }
+    }
+
+done:
+    msi_free( rows );
+    msi_free( rrows );
+    if (rtv)
+        rtv->view.ops->delete( &rtv->view );
+    tv->view.ops->delete( &tv->view );
+    return r;
+}
+
+static unsigned transform_write_table( LibmsiDatabase *db, TRANSFORMTABLE *tt,
+                                       GsfOutfile *outfile, unsigned bytes_per_strref )
+{
+    GByteArray *buf;
+    unsigned n = 0, i, k, mask, val, width, r;
+    guint8 b;
+
+    if (!tt->data->len)
+        return LIBMSI_RESULT_SUCCESS;
+
+    buf = g_byte_array_new();
+    while (n < tt->data->len)
+    {
+        mask = g_array_index( tt->data, unsigned, n++ );
+        b = mask;
+        g_byte_array_append( buf, &b, 1 );
+        b = mask >> 8;
+        g_byte_array_append( buf, &b, 1 );
+
+        for (i = 0; i < tt->num_cols; i++)
+        {
+            if (!transform_row_has_column( &tt->columns[i], i, mask ))
+                continue;
+
+            val = g_array_index( tt->data, unsigned, n++ );
+            if ((tt->columns[i].type & MSITYPE_STRING) && !MSITYPE_IS_BINARY(tt->columns[i].type))
+                width = bytes_per_strref;
+            else
+                width = bytes_per_column( db, &tt->columns[i], bytes_per_strref );
+
+            for (k = 0; k < width; k++)
+            {
+                b = val >> (k * 8);
+                g_byte_array_append( buf, &b, 1 );
+            }
+        }
+    }
+
+    TRACE("%s: %u bytes\n", debugstr_a(tt->name), buf->len);
+    r = write_outfile_stream_data( outfile, tt->name, buf->data, buf->len );
+    g_byte_array_free( buf, TRUE );
+    return r;
+}
+
+static int transform_compare_names( gconstpointer a, gconstpointer b )
+{
+    return strcmp( *(const char **)a, *(const char **)b );
+}
+
+static unsigned transform_table_names( LibmsiDatabase *db, GPtrArray **names )
+{
+    LibmsiTable *t;
+    unsigned r, i, id;
+
+    r = get_table( db, szTables, &t );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        return r;
+
+    *names = g_ptr_array_new();
+    for (i = 0; i < t->row_count; i++)
+    {
+        if (!t->data_persistent[i])
+            continue;
+        id = read_table_int( t->data, i, 0, LONG_STR_BYTES );
+        g_ptr_array_add( *names, (gpointer)msi_string_lookup_id( db->strings, id ) );
+    }
+    g_ptr_array_sort( *names, transform_compare_names );
+    return LIBMSI_RESULT_SUCCESS;
+}
+
+unsigned msi_table_generate_transform( LibmsiDatabase *db, LibmsiDatabase *ref,
+                                       GsfOutfile *outfile )
+{
+    struct list tables = LIST_INIT( tables );
+    TRANSFORMTABLE *tables_tt, *columns_tt, *tt, *tt2;
+    GPtrArray *names = NULL, *rnames = NULL;
+    string_table *st;
+    unsigned bytes_per_strref, r, i, j, mask, val;
+    int c;
+
+    TRACE("%p %p %p\n", db, ref, outfile);
+
+    st = msi_init_string_table( &bytes_per_strref );
+    if (!st)
+        return LIBMSI_RESULT_OUTOFMEMORY;
+    msi_set_string_table_codepage( st, msi_get_string_table_codepage( db->strings ) );
+
+    r = LIBMSI_RESULT_OUTOFMEMORY;
+    tables_tt = transform_table_new( &tables, szTables, _Tables_cols, 1 );
+    columns_tt = transform_table_new( &tables, szColumns, _Columns_cols, 4 );
+    if (!tables_tt || !columns_tt)
+        goto done;
+
+    r = transform_table_names( db, &names );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+    r = transform_table_names( ref, &rnames );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    for (i = j = 0; i < names->len || j < rnames->len;)
+    {
+        if (i == names->len)
+            c = 1;
+        else if (j == rnames->len)
+            c = -1;
+        else
+            c = strcmp( g_ptr_array_index( names, i ), g_ptr_array_index( rnames, j ) );
+
+        if (c < 0)
+        {
+            const char *name = g_ptr_array_index( names, i++ );
+
+            mask = (1 << 8) | 1;
+            val = transform_string( st, name );
+            g_array_append_val( tables_tt->data, mask );
+            g_array_append_val( tables_tt->data, val );
+            r = transform_diff_table( db, NULL, name, st, outfile, &tables, columns_tt );
+        }
+        else if (c > 0)
+        {
+            /* deleting the _Tables row drops the table */
+            mask = 0;
+            val = transform_string( st, g_ptr_array_index( rnames, j++ ) );
+            g_array_append_val( tables_tt->data, mask );
+            g_array_append_val( tables_tt->data, val );
+        }
+        else
+        {
+            r = transform_diff_table( db, ref, g_ptr_array_index( names, i ),
+                                      st, outfile, &tables, columns_tt );
+            i++;
+            j++;
+        }
+        if (r != LIBMSI_RESULT_SUCCESS)
+            goto done;
+    }
+
+    /* the size of string references is only known once all are in */
+    r = msi_save_string_table( st, outfile, &bytes_per_strref );
+    if (r != LIBMSI_RESULT_SUCCESS)
+        goto done;
+
+    LIST_FOR_EACH_ENTRY( tt, &tables, TRANSFORMTABLE, entry )
+    {
+        r = transform_write_table( db, tt, outfile, bytes_per_strref );
+        if (r != LIBMSI_RESULT_SUCCESS)
+            break;
+    }
+
+done:
+    LIST_FOR_EACH_ENTRY_SAFE( tt, tt2, &tables, TRANSFORMTABLE, entry )
+        transform_table_free( tt );
+    if (names)
+        g_ptr_array_unref( names );
+    if (rnames)
+        g_ptr_array_unref( rnames );
+    msi_destroy_stringtable( st );
+    return r;
+}
@@ -1069,6 +1069,576 @@ static void test_longstrings(void)
     unlink(msifile);
 }
 
+static void test_partial_commit(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *hrec = 0;
+    unsigned r;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb,
+        "CREATE TABLE `two` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `two` ( `id`, `val` ) VALUES( 1, 'pear' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+
+    /* nothing changed: everything is copied over as is */
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+
+    /* only `two` and the string table are rewritten */
+    r = try_query( hdb, "INSERT INTO `two` ( `id`, `val` ) VALUES( 2, 'plum' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    g_object_unref(hdb);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+
+    r = do_query(hdb, "SELECT `val` FROM `two` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "pear");
+    g_object_unref(hrec);
+
+    r = do_query(hdb, "SELECT `val` FROM `two` WHERE `id` = 2", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "plum");
+    g_object_unref(hrec);
+
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void async_ready(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    GAsyncResult **result = user_data;
+
+    *result = g_object_ref(res);
+}
+
+static GAsyncResult *wait_async_result(GAsyncResult **result)
+{
+    while (!*result)
+        g_main_context_iteration(NULL, TRUE);
+
+    return *result;
+}
+
+/* a commit that is cancelled must not replace the file it was to
+ * write, even the first one of a database created over it */
+static void test_cancel_first_commit(void)
+{
+    LibmsiDatabase *hdb;
+    GCancellable *cancellable;
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gsize size = 0;
+    unsigned r;
+
+    unlink(msifile);
+    g_file_set_contents(msifile, "placeholder", 11, NULL);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_new failed\n");
+
+    r = try_query(hdb, "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    libmsi_database_set_cancellable(hdb, cancellable);
+    r = libmsi_database_commit(hdb, &error);
+    ok(!r, "cancelled commit succeeded\n");
+    ok(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED), "expected cancellation\n");
+    g_clear_error(&error);
+    libmsi_database_set_cancellable(hdb, NULL);
+    g_object_unref(cancellable);
+
+    ok(g_file_get_contents(msifile, &contents, &size, NULL), "target is gone\n");
+    ok(size == 11 && !memcmp(contents, "placeholder", 11), "target was replaced\n");
+    g_free(contents);
+
+    /* and the next one still goes through */
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    g_object_unref(hdb);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "libmsi_database_new failed\n");
+    ok(libmsi_database_is_table_persistent(hdb, "one", NULL), "table is missing\n");
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_async(void)
+{
+    LibmsiDatabase *hdb = 0;
+    GAsyncResult *result = NULL;
+    GCancellable *cancellable;
+    GError *error = NULL;
+    unsigned r;
+
+    unlink(msifile);
+    libmsi_database_new_async(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL,
+                              async_ready, &result);
+    hdb = libmsi_database_new_finish(wait_async_result(&result), NULL);
+    ok(hdb, "libmsi_database_new_async failed\n");
+    g_clear_object(&result);
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    libmsi_database_commit_async(hdb, cancellable, async_ready, &result);
+    r = libmsi_database_commit_finish(hdb, wait_async_result(&result), &error);
+    ok(!r, "cancelled commit succeeded\n");
+    ok(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED), "expected cancellation\n");
+    g_clear_error(&error);
+    g_clear_object(&result);
+    g_object_unref(cancellable);
+
+    libmsi_database_commit_async(hdb, NULL, async_ready, &result);
+    r = libmsi_database_commit_finish(hdb, wait_async_result(&result), NULL);
+    ok(r, "libmsi_database_commit_async failed\n");
+    g_clear_object(&result);
+    g_object_unref(hdb);
+
+    libmsi_database_new_async(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL,
+                              async_ready, &result);
+    hdb = libmsi_database_new_finish(wait_async_result(&result), NULL);
+    ok(hdb, "libmsi_database_new_async failed\n");
+    g_clear_object(&result);
+
+    ok(libmsi_database_is_table_persistent(hdb, "one", NULL), "table is missing\n");
+    g_object_unref(hdb);
+
+    unlink(msifile);
+    libmsi_database_new_async(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL,
+                              async_ready, &result);
+    hdb = libmsi_database_new_finish(wait_async_result(&result), &error);
+    ok(!hdb, "opened a missing file\n");
+    ok(error != NULL, "expected an error\n");
+    g_clear_error(&error);
+    g_clear_object(&result);
+}
+
+struct progress_data
+{
+    LibmsiProgressOperation operation;
+    guint64 rows;
+    GCancellable *cancel;
+};
+
+static void progress_cb(LibmsiDatabase *db, LibmsiProgressOperation operation,
+                        guint64 bytes, guint64 rows, gpointer user_data)
+{
+    struct progress_data *data = user_data;
+
+    data->operation = operation;
+    data->rows = rows;
+    if (data->cancel)
+        g_cancellable_cancel(data->cancel);
+}
+
+static void test_progress(void)
+{
+    struct progress_data data = { 0 };
+    LibmsiDatabase *hdb = 0, *hdb2;
+    LibmsiRecord *hrec = NULL;
+    GCancellable *cancellable;
+    GError *error = NULL;
+    unsigned r;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    libmsi_database_set_progress_callback(hdb, progress_cb, &data, NULL);
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    ok(data.operation == LIBMSI_PROGRESS_OPERATION_COMMIT, "wrong operation %d\n", data.operation);
+    ok(data.rows > 0, "no rows reported\n");
+
+    /* cancelled from the callback, the file on disk is left alone */
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 2, 'pear' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    cancellable = g_cancellable_new();
+    libmsi_database_set_cancellable(hdb, cancellable);
+    data.cancel = cancellable;
+    r = libmsi_database_commit(hdb, &error);
+    ok(!r, "cancelled commit succeeded\n");
+    ok(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED), "expected cancellation\n");
+    g_clear_error(&error);
+    g_object_unref(cancellable);
+
+    hdb2 = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb2, "libmsi_database_open failed\n");
+    r = do_query(hdb2, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+    hrec = NULL;
+    r = do_query(hdb2, "SELECT `val` FROM `one` WHERE `id` = 2", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(hrec == NULL, "cancelled commit reached the file\n");
+    g_object_unref(hdb2);
+
+    /* the handle is still good, and a second try saves everything */
+    libmsi_database_set_cancellable(hdb, NULL);
+    data.cancel = NULL;
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 3, 'plum' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed after a cancelled one\n");
+    g_object_unref(hdb);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 2", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "row lost by the cancelled commit\n");
+    check_record_string(hrec, 1, "pear");
+    g_object_unref(hrec);
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 3", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "plum");
+    g_object_unref(hrec);
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_memory(void)
+{
+    LibmsiDatabase *hdb = 0;
+    LibmsiRecord *hrec = 0;
+    GOutputStream *out;
+    GInputStream *in;
+    GBytes *bytes;
+    GError *error = NULL;
+    unsigned r;
+
+    out = g_memory_output_stream_new_resizable();
+    hdb = libmsi_database_new_from_bytes(NULL, LIBMSI_DB_FLAGS_CREATE, out, NULL);
+    ok(hdb, "libmsi_database_new_from_bytes failed\n");
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+
+    /* the committed data can be read back right away */
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+
+    /* a second commit replaces the first image in the output stream */
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 2, 'pear' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "second libmsi_database_commit failed\n");
+    g_object_get(hdb, "bytes", &bytes, NULL);
+    ok(g_memory_output_stream_get_data_size(G_MEMORY_OUTPUT_STREAM(out)) ==
+       g_bytes_get_size(bytes), "output stream holds more than one image\n");
+    g_bytes_unref(bytes);
+    g_object_unref(hdb);
+
+    g_output_stream_close(out, NULL, NULL);
+    bytes = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(out));
+    g_object_unref(out);
+    ok(g_bytes_get_size(bytes) > 0, "nothing written to the output stream\n");
+
+    in = g_memory_input_stream_new_from_bytes(bytes);
+    hdb = libmsi_database_new_from_stream(in, LIBMSI_DB_FLAGS_READONLY, NULL, NULL, NULL);
+    ok(hdb, "libmsi_database_new_from_stream failed\n");
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 2", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "pear");
+    g_object_unref(hrec);
+    g_object_unref(hdb);
+    g_object_unref(in);
+    g_bytes_unref(bytes);
+
+    bytes = g_bytes_new_static("not a database", 14);
+    hdb = libmsi_database_new_from_bytes(bytes, LIBMSI_DB_FLAGS_READONLY, NULL, &error);
+    ok(!hdb, "opened garbage\n");
+    ok(error != NULL, "expected an error\n");
+    g_clear_error(&error);
+    g_bytes_unref(bytes);
+}
+
+static void test_stats(void)
+{
+    LibmsiDatabaseStats *stats;
+    LibmsiDatabase *hdb = 0;
+    unsigned r, i;
+    bool found = false;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    ok(stats != NULL, "libmsi_database_get_stats failed\n");
+    ok(stats->query_parses >= 2, "got %u query parses\n", (unsigned)stats->query_parses);
+    ok(stats->commits == 1, "got %u commits\n", (unsigned)stats->commits);
+    ok(stats->string_count > 0, "empty string table\n");
+    ok(stats->string_pool_bytes > 0, "empty string pool\n");
+    libmsi_database_stats_free(stats);
+
+    r = try_query( hdb, "SELECT * FROM `one` WHERE `id` = 1");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    for (i = 0; i < stats->n_tables; i++)
+    {
+        if (strcmp(stats->tables[i].name, "one"))
+            continue;
+        found = true;
+        ok(stats->tables[i].row_count == 1, "got %u rows\n", stats->tables[i].row_count);
+        ok(stats->tables[i].row_bytes > 0, "no row bytes\n");
+    }
+    ok(found, "table one not reported\n");
+    libmsi_database_stats_free(stats);
+
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_snapshot(void)
+{
+    static const char snapshot[] = "winetest-snapshot.bin";
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    LibmsiQuery *query;
+    GInputStream *in;
+    GError *error = NULL;
+    char buf[32];
+    unsigned r;
+    int i;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 2, 'banana' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    create_file( "test.txt" );
+    rec = libmsi_record_new( 2 );
+    libmsi_record_set_string( rec, 1, "data" );
+    r = libmsi_record_load_stream( rec, 2, "test.txt" );
+    ok(r, "Failed to add stream data to the record: %d\n", r);
+    unlink("test.txt");
+    query = libmsi_query_new( hdb,
+            "INSERT INTO `_Streams` ( `Name`, `Data` ) VALUES ( ?, ? )", NULL );
+    r = libmsi_query_execute( query, rec, NULL );
+    ok(r, "Failed to execute query\n");
+    g_object_unref( rec );
+    g_object_unref( query );
+
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    g_object_unref(hdb);
+
+    /* only a database without pending changes can be saved */
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_TRANSACT, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 3, 'cherry' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_save_snapshot(hdb, snapshot, NULL);
+    ok(!r, "saved a snapshot with pending changes\n");
+    g_object_unref(hdb);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = libmsi_database_save_snapshot(hdb, snapshot, NULL);
+    ok(r, "libmsi_database_save_snapshot failed\n");
+    g_object_unref(hdb);
+
+    /* reopen it a few times, the snapshot is not changed by queries */
+    for (i = 0; i < 2; i++)
+    {
+        hdb = libmsi_database_open_snapshot(msifile, snapshot, NULL);
+        ok(hdb, "libmsi_database_open_snapshot failed\n");
+
+        r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 2", &rec);
+        ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+        check_record_string(rec, 1, "banana");
+        g_object_unref(rec);
+
+        r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &rec);
+        ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+        check_record_string(rec, 1, "apple");
+        g_object_unref(rec);
+        try_query( hdb, "UPDATE `one` SET `val` = 'pear' WHERE `id` = 1");
+
+        r = do_query(hdb, "SELECT `Data` FROM `_Streams` WHERE `Name` = 'data'", &rec);
+        ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+        memset(buf, 0, sizeof(buf));
+        in = libmsi_record_get_stream(rec, 1);
+        ok(in, "Failed to get stream\n");
+        g_input_stream_read(in, buf, sizeof(buf), NULL, NULL);
+        ok(g_str_equal(buf, "test.txt\n"), "Expected 'test.txt\\n', got %s\n", buf);
+        g_object_unref(in);
+        g_object_unref(rec);
+
+        g_object_unref(hdb);
+    }
+
+    /* a changed source file makes the snapshot stale */
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_TRANSACT, NULL, NULL);
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 3, 'cherry' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    g_object_unref(hdb);
+
+    hdb = libmsi_database_open_snapshot(msifile, snapshot, &error);
+    ok(!hdb, "opened a stale snapshot\n");
+    ok(g_error_matches(error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_DATA),
+       "unexpected error\n");
+    g_clear_error(&error);
+
+    unlink(snapshot);
+    unlink(msifile);
+}
+
+static void test_generate_transform(void)
+{
+    LibmsiDatabase *hdb = 0, *hdb2 = 0;
+    LibmsiRecord *hrec = 0;
+    GError *error = NULL;
+    unsigned r;
+
+    unlink(msifile);
+    unlink(msifile2);
+    unlink(mstfile);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = try_query( hdb,
+        "CREATE TABLE `one` ( `id` INT, `val` CHAR(32) PRIMARY KEY `id`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 1, 'apple' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 2, 'pear' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb, "INSERT INTO `one` ( `id`, `val` ) VALUES( 3, 'plum' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "libmsi_database_commit failed\n");
+    g_object_unref(hdb);
+
+    /* the new database: one row changed, one added, one removed, one new table */
+    hdb2 = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_TRANSACT, msifile2, NULL);
+    ok(hdb2, "libmsi_database_open failed\n");
+    r = try_query( hdb2, "UPDATE `one` SET `val` = 'peach' WHERE `id` = 2");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb2, "DELETE FROM `one` WHERE `id` = 3");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb2, "INSERT INTO `one` ( `id`, `val` ) VALUES( 4, 'fig' )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb2,
+        "CREATE TABLE `two` ( `name` CHAR(32), `num` INT PRIMARY KEY `name`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = try_query( hdb2, "INSERT INTO `two` ( `name`, `num` ) VALUES( 'lemon', 7 )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = libmsi_database_generate_transform(hdb2, hdb, mstfile, &error);
+    ok(r, "libmsi_database_generate_transform failed\n");
+    g_clear_error(&error);
+    g_object_unref(hdb);
+    g_object_unref(hdb2);
+
+    /* applying it to the reference gives the new database */
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_TRANSACT, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+    r = libmsi_database_apply_transform(hdb, mstfile, NULL);
+    ok(r, "libmsi_database_apply_transform failed\n");
+
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 1", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "apple");
+    g_object_unref(hrec);
+
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 2", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "peach");
+    g_object_unref(hrec);
+
+    hrec = NULL;
+    do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 3", &hrec);
+    ok(hrec == NULL, "deleted row still present\n");
+
+    r = do_query(hdb, "SELECT `val` FROM `one` WHERE `id` = 4", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(hrec, 1, "fig");
+    g_object_unref(hrec);
+
+    r = do_query(hdb, "SELECT `num` FROM `two` WHERE `name` = 'lemon'", &hrec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    r = libmsi_record_get_int(hrec, 1);
+    ok(r == 7, "got %d\n", r);
+    g_object_unref(hrec);
+    g_object_unref(hdb);
+
+    unlink(msifile);
+    unlink(msifile2);
+    unlink(mstfile);
+}
+
 static void create_file_data(const char *name, const char *data, unsigned size)
 {
     int file;
@@ -1386,28 +1956,89 @@ static void test_binary(void)
     ok( g_str_equal(buf, "test.txt\n"), "Expected 'test.txt\\n', got %s\n", buf );
     g_object_unref(in);
 
-    g_object_unref( rec );
+    g_object_unref( rec );
+
+    /* read file from the Binary table */
+    sql = "SELECT * FROM `Binary`";
+    r = do_query( hdb, sql, &rec );
+    ok( r == LIBMSI_RESULT_SUCCESS, "SELECT query failed: %d\n", r );
+
+    check_record_string (rec, 1, "filename1");
+
+    size = sizeof(buf);
+    memset( buf, 0, sizeof(buf) );
+    in = libmsi_record_get_stream(rec, 3);
+    ok(in, "Failed to get stream\n");
+    size = g_input_stream_read(in, buf, sizeof(buf), NULL, NULL);
+    ok( g_str_equal(buf, "test.txt\n"), "Expected 'test.txt\\n', got %s\n", buf );
+    g_object_unref(in);
+
+    g_object_unref( rec );
+
+    g_object_unref( hdb );
+
+    unlink( msifile );
+}
+
+/* a lazily loaded file is read at commit time rather than on load */
+static void test_load_stream_lazy(void)
+{
+    static const unsigned size = 1024 * 1024 + 1;
+    GInputStream *in;
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    char *data, *buf;
+    gsize total;
+    gssize n;
+    unsigned r, i;
+
+    data = malloc(size);
+    buf = malloc(size);
+    for (i = 0; i < size; i++)
+        data[i] = i % 251;
+    create_file_data("large.bin", data, size);
+
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "Failed to open database\n");
+
+    r = run_query(hdb, 0, "CREATE TABLE `Binary` ( `Name` CHAR(72) NOT NULL, "
+                          "`Data` OBJECT PRIMARY KEY `Name`)");
+    ok(r == LIBMSI_RESULT_SUCCESS, "Cannot create Binary table: %d\n", r);
+
+    rec = libmsi_record_new(1);
+    r = libmsi_record_load_stream_lazy(rec, 1, "large.bin");
+    ok(r, "Failed to add stream data to the record\n");
+
+    r = run_query(hdb, rec, "INSERT INTO `Binary` ( `Name`, `Data` ) VALUES ( 'large', ? )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "Insert into Binary table failed: %d\n", r);
+    g_object_unref(rec);
+
+    /* the file has to stay until here */
+    r = libmsi_database_commit(hdb, NULL);
+    ok(r, "Failed to commit database\n");
+    g_object_unref(hdb);
+    unlink("large.bin");
 
-    /* read file from the Binary table */
-    sql = "SELECT * FROM `Binary`";
-    r = do_query( hdb, sql, &rec );
-    ok( r == LIBMSI_RESULT_SUCCESS, "SELECT query failed: %d\n", r );
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_READONLY, NULL, NULL);
+    ok(hdb, "Failed to open database\n");
 
-    check_record_string (rec, 1, "filename1");
+    r = do_query(hdb, "SELECT `Data` FROM `Binary` WHERE `Name` = 'large'", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "SELECT query failed: %d\n", r);
 
-    size = sizeof(buf);
-    memset( buf, 0, sizeof(buf) );
-    in = libmsi_record_get_stream(rec, 3);
+    in = libmsi_record_get_stream(rec, 1);
     ok(in, "Failed to get stream\n");
-    size = g_input_stream_read(in, buf, sizeof(buf), NULL, NULL);
-    ok( g_str_equal(buf, "test.txt\n"), "Expected 'test.txt\\n', got %s\n", buf );
+    total = 0;
+    while ((n = g_input_stream_read(in, buf + total, size - total, NULL, NULL)) > 0)
+        total += n;
+    ok(total == size, "Expected %u bytes, got %" G_GSIZE_FORMAT "\n", size, total);
+    ok(!memcmp(buf, data, size), "Stream data differs\n");
     g_object_unref(in);
+    g_object_unref(rec);
 
-    g_object_unref( rec );
-
-    g_object_unref( hdb );
-
-    unlink( msifile );
+    g_object_unref(hdb);
+    unlink(msifile);
+    free(data);
+    free(buf);
 }
 
 static void test_where_not_in_selected(void)
@@ -1811,6 +2442,204 @@ static void test_suminfo_import(void)
     unlink(msifile);
 }
 
+static void test_import_large(void)
+{
+    LibmsiDatabase *hdb;
+    LibmsiQuery *query;
+    LibmsiRecord *rec;
+    GString *data;
+    unsigned r, count;
+    int i;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    /* more rows than one batch, out of key order */
+    data = g_string_new("id\tval\r\ni4\ts32\r\nbig\tid\r\n");
+    for (i = 3000; i > 0; i--)
+        g_string_append_printf(data, "%d\tvalue %d\r\n", i, i);
+    g_string_append_c(data, '\n');
+    r = add_table_to_db(hdb, data->str);
+    ok(r == LIBMSI_RESULT_SUCCESS, "Expected LIBMSI_RESULT_SUCCESS, got %d\n", r);
+    g_string_free(data, TRUE);
+
+    r = do_query(hdb, "SELECT `val` FROM `big` WHERE `id` = 1500", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "value 1500");
+    g_object_unref(rec);
+
+    query = libmsi_query_new(hdb, "SELECT `id` FROM `big`", NULL);
+    ok(query != NULL, "query failed\n");
+    r = libmsi_query_execute(query, NULL, NULL);
+    ok(r, "query failed\n");
+    count = 0;
+    while ((rec = libmsi_query_fetch(query, NULL)))
+    {
+        i = libmsi_record_get_int(rec, 1);
+        ok(i == count + 1, "row %u: got id %d\n", count, i);
+        g_object_unref(rec);
+        count++;
+    }
+    ok(count == 3000, "Expected 3000 rows, got %u\n", count);
+    g_object_unref(query);
+
+    /* a duplicate key fails the import */
+    r = add_table_to_db(hdb, "id\tval\r\ni4\ts32\r\nbig\tid\r\n1\ta\r\n2\tb\r\n1\tc\r\n\n");
+    ok(r == LIBMSI_RESULT_FUNCTION_FAILED, "Expected LIBMSI_RESULT_FUNCTION_FAILED, got %d\n", r);
+
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_import_files(void)
+{
+    const char *paths[24];
+    char names[22][16];
+    GError *error = NULL;
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    GString *data;
+    unsigned r, i, j;
+    gboolean ret;
+    char sql[64];
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    /* more files than threads, and more rows than one batch */
+    for (i = 0; i < 20; i++)
+    {
+        data = g_string_new("id\tval\r\ni4\ts32\r\n");
+        g_string_append_printf(data, "t%u\tid\r\n", i);
+        for (j = 1500; j > 0; j--)
+            g_string_append_printf(data, "%u\tvalue %u %u\r\n", j, i, j);
+        sprintf(names[i], "t%u.idt", i);
+        write_file(names[i], data->str, data->len);
+        g_string_free(data, TRUE);
+        paths[i] = names[i];
+    }
+
+    /* a later file for the same table replaces the earlier one */
+    strcpy(names[20], "t0b.idt");
+    data = g_string_new("id\tval\r\ni4\ts32\r\nt0\tid\r\n2\ttwo\r\n1\tone\r\n");
+    write_file(names[20], data->str, data->len);
+    g_string_free(data, TRUE);
+    paths[20] = names[20];
+
+    strcpy(names[21], "codepage.idt");
+    data = g_string_new("\r\n\r\n850\t_ForceCodepage\r\n");
+    write_file(names[21], data->str, data->len);
+    g_string_free(data, TRUE);
+    paths[21] = names[21];
+    paths[22] = NULL;
+
+    ret = libmsi_database_import_files(hdb, paths, 4, &error);
+    ok(ret, "libmsi_database_import_files failed\n");
+    ok(!error, "Unexpected error\n");
+
+    for (i = 1; i < 20; i++)
+    {
+        sprintf(sql, "SELECT `val` FROM `t%u` WHERE `id` = 1000", i);
+        r = do_query(hdb, sql, &rec);
+        ok(r == LIBMSI_RESULT_SUCCESS, "query failed on t%u\n", i);
+        sprintf(sql, "value %u 1000", i);
+        check_record_string(rec, 1, sql);
+        g_object_unref(rec);
+    }
+
+    r = do_query(hdb, "SELECT `val` FROM `t0` WHERE `id` = 1000", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "Expected the old rows to be gone\n");
+    r = do_query(hdb, "SELECT `val` FROM `t0` WHERE `id` = 2", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "two");
+    g_object_unref(rec);
+
+    /* a missing file stops the import and is named in the error */
+    paths[0] = "missing.idt";
+    paths[1] = NULL;
+    ret = libmsi_database_import_files(hdb, paths, 0, &error);
+    ok(!ret, "libmsi_database_import_files succeeded\n");
+    ok(error && strstr(error->message, "missing.idt"), "Expected the file in the error\n");
+    g_clear_error(&error);
+
+    for (i = 0; i < 22; i++)
+        unlink(names[i]);
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_export_all(void)
+{
+    LibmsiDatabase *hdb;
+    char *dir, *path, *name, *all, *one;
+    gsize all_len, one_len;
+    unsigned r;
+    int fd, i;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    for (i = 0; i < 40; i++)
+    {
+        GString *data = g_string_new("id\tval\r\ni2\ts32\r\n");
+        int j;
+
+        g_string_append_printf(data, "t%d\tid\r\n", i);
+        for (j = 0; j < i * 10; j++)
+            g_string_append_printf(data, "%d\tvalue %d\r\n", j, j);
+        g_string_append_c(data, '\n');
+        r = add_table_to_db(hdb, data->str);
+        ok(r == LIBMSI_RESULT_SUCCESS, "Expected LIBMSI_RESULT_SUCCESS, got %d\n", r);
+        g_string_free(data, TRUE);
+    }
+
+    dir = g_dir_make_tmp("msiexportXXXXXX", NULL);
+    ok(dir != NULL, "failed to create directory\n");
+    r = libmsi_database_export_all(hdb, dir, 4, NULL);
+    ok(r, "libmsi_database_export_all failed\n");
+
+    /* every file matches what a single export writes */
+    for (i = -2; i < 40; i++)
+    {
+        if (i == -2)
+            name = g_strdup("_SummaryInformation");
+        else if (i == -1)
+            name = g_strdup("_ForceCodepage");
+        else
+            name = g_strdup_printf("t%d", i);
+
+        path = g_strdup_printf("%s/%s.idt", dir, name);
+        r = g_file_get_contents(path, &all, &all_len, NULL);
+        ok(r, "%s was not written\n", path);
+        unlink(path);
+        g_free(path);
+
+        path = g_strdup_printf("%s/single.idt", dir);
+        fd = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_BINARY, 0644);
+        r = libmsi_database_export(hdb, name, fd, NULL);
+        ok(r, "libmsi_database_export failed\n");
+        close(fd);
+        g_file_get_contents(path, &one, &one_len, NULL);
+        unlink(path);
+        g_free(path);
+
+        ok(all && one && all_len == one_len && !memcmp(all, one, one_len),
+           "%s differs from a single export\n", name);
+        g_free(all);
+        g_free(one);
+        g_free(name);
+    }
+
+    rmdir(dir);
+    g_free(dir);
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
 static void test_msiimport(void)
 {
     LibmsiDatabase *hdb;
@@ -2022,6 +2851,270 @@ static const char bin_import_dat[] = "Name\tData\r\n"
                                      "Binary\tName\r\n"
                                      "filename1\tfilename1.ibd\r\n";
 
+static void test_execute_script(void)
+{
+    LibmsiDatabaseStats *stats;
+    GError *error = NULL;
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    guint64 parses;
+    GString *script;
+    unsigned r, i, count;
+    gboolean ret;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    parses = stats->query_parses;
+    libmsi_database_stats_free(stats);
+
+    /* the inserts differ only in their values, and the last two
+     * statements have no semicolon between them */
+    script = g_string_new("CREATE TABLE `t` ( `id` INT NOT NULL, `val` CHAR(32) PRIMARY KEY `id` );\r\n");
+    for (i = 1; i <= 500; i++)
+        g_string_append_printf(script, "INSERT INTO `t` ( `id`, `val` ) VALUES ( %u, 'value %u' );\n", i, i);
+    g_string_append(script, "INSERT INTO `t` ( `id`, `val` ) VALUES ( -1, 'neg' );\n");
+    g_string_append(script, "UPDATE `t` SET `val` = 'three' WHERE `id` = 3\n");
+    g_string_append(script, "DELETE FROM `t` WHERE `id` = 4");
+
+    ret = libmsi_database_execute_script(hdb, script->str, &error);
+    ok(ret, "libmsi_database_execute_script failed\n");
+    ok(!error, "Unexpected error\n");
+    g_clear_error(&error);
+    g_string_free(script, TRUE);
+
+    stats = libmsi_database_get_stats(hdb);
+    ok(stats->query_parses - parses < 10, "got %u query parses\n",
+       (unsigned)(stats->query_parses - parses));
+    libmsi_database_stats_free(stats);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 250", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "value 250");
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 3", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "three");
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = -1", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec != NULL, "negative value not inserted\n");
+    if (rec)
+        g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 4", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "row 4 not deleted\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    count = stats->string_count;
+    libmsi_database_stats_free(stats);
+
+    /* the failing statement is reported, and the ones before it are
+     * rolled back */
+    ret = libmsi_database_execute_script(hdb,
+        "INSERT INTO `t` ( `id`, `val` ) VALUES ( 1000, 'new' );\n"
+        "UPDATE `t` SET `val` = 'changed' WHERE `id` = 3;\n"
+        "DELETE FROM `t` WHERE `id` = 5;\n"
+        "CREATE TABLE `u` ( `id` INT NOT NULL PRIMARY KEY `id` );\n"
+        "INSERT INTO `u` ( `id` ) VALUES ( 1 );\n"
+        "INSERT INTO `t` ( `id`, `val` ) VALUES ( 1, 'dup' );\n"
+        "INSERT INTO `t` ( `id`, `val` ) VALUES ( 1001, 'never' )", &error);
+    ok(!ret, "libmsi_database_execute_script succeeded\n");
+    ok(error && strstr(error->message, "statement 6, line 6"),
+       "unexpected error %s\n", error ? error->message : "(none)");
+    g_clear_error(&error);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 1000", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "insert before the failure not rolled back\n");
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 3", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "three");
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 5", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "value 5");
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 1001", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "statement after the failure ran\n");
+
+    r = do_query(hdb, "SELECT * FROM `u`", &rec);
+    ok(r != LIBMSI_RESULT_SUCCESS, "created table not rolled back\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    ok(stats->string_count == count, "expected %u strings, got %u\n",
+       count, stats->string_count);
+    libmsi_database_stats_free(stats);
+
+    /* the database is still usable */
+    ret = libmsi_database_execute_script(hdb,
+        "INSERT INTO `t` ( `id`, `val` ) VALUES ( 1000, 'new' )", &error);
+    ok(ret, "libmsi_database_execute_script failed\n");
+    g_clear_error(&error);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 1000", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "new");
+    g_object_unref(rec);
+
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
+static void test_insert_records(void)
+{
+    static const char *columns[] = { "val", "id", NULL };
+    static const char *bad_columns[] = { "id", "nope", NULL };
+    LibmsiRecord *recs[100];
+    GError *error = NULL;
+    GInputStream *in;
+    char buf[32];
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    char val[32];
+    unsigned r, i;
+    gboolean ret;
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "libmsi_database_open failed\n");
+
+    r = run_query(hdb, 0, "CREATE TABLE `t` ( `id` INT NOT NULL, `val` CHAR(32), "
+                          "`extra` CHAR(32) PRIMARY KEY `id` )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "failed to create table\n");
+
+    /* out of key order, and in a column order of their own */
+    for (i = 0; i < 100; i++)
+    {
+        recs[i] = libmsi_record_new(2);
+        sprintf(val, "value %u", 100 - i);
+        libmsi_record_set_string(recs[i], 1, val);
+        libmsi_record_set_int(recs[i], 2, 100 - i);
+    }
+
+    ret = libmsi_database_insert_records(hdb, "t", columns, recs, 100, &error);
+    ok(ret, "libmsi_database_insert_records failed\n");
+    ok(!error, "Unexpected error\n");
+    g_clear_error(&error);
+
+    r = do_query(hdb, "SELECT `val`, `extra` FROM `t` WHERE `id` = 42", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "value 42");
+    ok(libmsi_record_is_null(rec, 2), "extra column not null\n");
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `id` FROM `t`", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(libmsi_record_get_int(rec, 1) == 1, "table not sorted\n");
+    g_object_unref(rec);
+
+    /* a key already in the table fails the whole batch */
+    for (i = 0; i < 100; i++)
+        g_object_unref(recs[i]);
+    for (i = 0; i < 2; i++)
+    {
+        recs[i] = libmsi_record_new(3);
+        libmsi_record_set_int(recs[i], 1, i ? 7 : 500);
+        libmsi_record_set_string(recs[i], 2, "dup");
+    }
+
+    ret = libmsi_database_insert_records(hdb, "t", NULL, recs, 2, &error);
+    ok(!ret, "libmsi_database_insert_records succeeded\n");
+    ok(error != NULL, "Expected error\n");
+    g_clear_error(&error);
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 500", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "row of a failed batch added\n");
+
+    r = do_query(hdb, "SELECT `val` FROM `t` WHERE `id` = 7", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    check_record_string(rec, 1, "value 7");
+    g_object_unref(rec);
+
+    /* unknown columns and tables, and records of the wrong size */
+    ret = libmsi_database_insert_records(hdb, "t", bad_columns, recs, 1, &error);
+    ok(!ret, "libmsi_database_insert_records succeeded\n");
+    ok(error && strstr(error->message, "nope"),
+       "unexpected error %s\n", error ? error->message : "(none)");
+    g_clear_error(&error);
+
+    ret = libmsi_database_insert_records(hdb, "nosuchtable", NULL, recs, 1, &error);
+    ok(!ret, "libmsi_database_insert_records succeeded\n");
+    ok(error && error->code == LIBMSI_RESULT_INVALID_TABLE,
+       "unexpected error %s\n", error ? error->message : "(none)");
+    g_clear_error(&error);
+
+    ret = libmsi_database_insert_records(hdb, "t", columns, recs, 1, &error);
+    ok(!ret, "libmsi_database_insert_records succeeded\n");
+    ok(error && error->code == LIBMSI_RESULT_INVALID_PARAMETER,
+       "unexpected error %s\n", error ? error->message : "(none)");
+    g_clear_error(&error);
+
+    for (i = 0; i < 2; i++)
+        g_object_unref(recs[i]);
+
+    /* a duplicate key must not touch the stream of the row it clashes with */
+    r = run_query(hdb, 0, "CREATE TABLE `b` ( `name` CHAR(72) NOT NULL, "
+                          "`data` OBJECT PRIMARY KEY `name` )");
+    ok(r == LIBMSI_RESULT_SUCCESS, "failed to create table\n");
+
+    create_file_data("original.bin", "original data", 13);
+    recs[0] = libmsi_record_new(2);
+    libmsi_record_set_string(recs[0], 1, "blob");
+    ret = libmsi_record_load_stream(recs[0], 2, "original.bin");
+    ok(ret, "Failed to add stream data to the record\n");
+    unlink("original.bin");
+
+    ret = libmsi_database_insert_records(hdb, "b", NULL, recs, 1, &error);
+    ok(ret, "libmsi_database_insert_records failed\n");
+    g_clear_error(&error);
+    g_object_unref(recs[0]);
+
+    create_file_data("clobber.bin", "clobbered", 9);
+    for (i = 0; i < 2; i++)
+    {
+        recs[i] = libmsi_record_new(2);
+        libmsi_record_set_string(recs[i], 1, i ? "blob" : "other");
+        ret = libmsi_record_load_stream(recs[i], 2, "clobber.bin");
+        ok(ret, "Failed to add stream data to the record\n");
+    }
+    unlink("clobber.bin");
+
+    ret = libmsi_database_insert_records(hdb, "b", NULL, recs, 2, &error);
+    ok(!ret, "libmsi_database_insert_records succeeded\n");
+    ok(error != NULL, "Expected error\n");
+    g_clear_error(&error);
+    for (i = 0; i < 2; i++)
+        g_object_unref(recs[i]);
+
+    r = do_query(hdb, "SELECT `data` FROM `b` WHERE `name` = 'blob'", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    in = libmsi_record_get_stream(rec, 1);
+    ok(in, "Failed to get stream\n");
+    memset(buf, 0, sizeof(buf));
+    g_input_stream_read(in, buf, sizeof(buf), NULL, NULL);
+    ok(g_str_equal(buf, "original data"), "stream overwritten: %s\n", buf);
+    g_object_unref(in);
+    g_object_unref(rec);
+
+    r = do_query(hdb, "SELECT `Name` FROM `_Streams` WHERE `Name` = 'b.other'", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "stream of a failed batch added\n");
+
+    g_object_unref(hdb);
+    unlink(msifile);
+}
+
 static void test_binary_import(void)
 {
     GInputStream *in;
@@ -2070,6 +3163,114 @@ static void test_binary_import(void)
     unlink("bin_import.idt");
 }
 
+static const char bin_dup_import_dat[] = "Name\tData\r\n"
+                                         "s72\tV0\r\n"
+                                         "Binary\tName\r\n"
+                                         "fresh\tfilename1.ibd\r\n"
+                                         "fresh\tfilename1.ibd\r\n";
+
+static void test_import_rollback(void)
+{
+    LibmsiDatabaseStats *stats;
+    LibmsiDatabase *hdb;
+    LibmsiRecord *rec;
+    GString *data;
+    unsigned r, count, i;
+
+    write_file("bin_import.idt", bin_import_dat,
+          (sizeof(bin_import_dat) - 1) * sizeof(char));
+    write_file("bin_dup_import.idt", bin_dup_import_dat,
+          (sizeof(bin_dup_import_dat) - 1) * sizeof(char));
+    mkdir("Binary", 0755);
+    create_file_data("Binary/filename1.ibd", "just some words", 15);
+
+    unlink(msifile);
+    hdb = libmsi_database_new(msifile, LIBMSI_DB_FLAGS_CREATE, NULL, NULL);
+    ok(hdb, "Failed to open database\n");
+
+    r = libmsi_database_import(hdb, "bin_import.idt", NULL);
+    ok(r, "Failed to import Binary table\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    count = stats->string_count;
+    libmsi_database_stats_free(stats);
+
+    /* a duplicate key fails the import, and takes back the strings
+     * and streams of the rows already added */
+    r = libmsi_database_import(hdb, "bin_dup_import.idt", NULL);
+    ok(!r, "imported a duplicate key\n");
+
+    stats = libmsi_database_get_stats(hdb);
+    ok(stats->string_count == count, "expected %u strings, got %u\n",
+       count, stats->string_count);
+    libmsi_database_stats_free(stats);
+
+    r = do_query(hdb, "SELECT * FROM `Binary`", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "row of a failed import added\n");
+
+    r = do_query(hdb, "SELECT `Name` FROM `_Streams` WHERE `Name` = 'Binary.fresh'", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "stream of a failed import added\n");
+
+    /* the same once whole batches went in before a row fails to load */
+    r = add_table_to_db(hdb, "id\tval\tdata\r\ni4\ts32\tv0\r\nmany\tid\r\n\n");
+    ok(r == LIBMSI_RESULT_SUCCESS, "Expected LIBMSI_RESULT_SUCCESS, got %d\n", r);
+
+    stats = libmsi_database_get_stats(hdb);
+    count = stats->string_count;
+    libmsi_database_stats_free(stats);
+
+    data = g_string_new("id\tval\tdata\r\ni4\ts32\tv0\r\nmany\tid\r\n");
+    for (i = 1; i <= 2500; i++)
+        g_string_append_printf(data, "%u\tword %u\t%s\r\n", i, i,
+                               i == 2400 ? "missing.ibd" : "");
+    g_string_append_c(data, '\n');
+    r = add_table_to_db(hdb, data->str);
+    ok(r != LIBMSI_RESULT_SUCCESS, "imported a row with a missing file\n");
+    g_string_free(data, TRUE);
+
+    stats = libmsi_database_get_stats(hdb);
+    ok(stats->string_count == count, "expected %u strings, got %u\n",
+       count, stats->string_count);
+    libmsi_database_stats_free(stats);
+
+    r = do_query(hdb, "SELECT * FROM `many`", &rec);
+    ok(r == LIBMSI_RESULT_SUCCESS, "query failed\n");
+    ok(rec == NULL, "row of a failed import added\n");
+
+    g_object_unref(hdb);
+    unlink(msifile);
+    unlink("Binary/filename1.ibd");
+    rmdir("Binary");
+    unlink("bin_import.idt");
+    unlink("bin_dup_import.idt");
+}
+
+static void test_import_read_fault(void)
+{
+#ifndef _WIN32
+    GError *error = NULL;
+    LibmsiDatabase *hdb;
+    gboolean ret;
+
+    hdb = create_db();
+    ok(hdb, "failed to create db\n");
+
+    /* a directory opens, but can't be read */
+    mkdir("not_a_table.idt", 0755);
+    ret = libmsi_database_import(hdb, "not_a_table.idt", &error);
+    ok(!ret, "imported a directory\n");
+    ok(error && error->code == LIBMSI_RESULT_READ_FAULT,
+       "expected LIBMSI_RESULT_READ_FAULT, got %d\n", error ? error->code : 0);
+    g_clear_error(&error);
+    rmdir("not_a_table.idt");
+
+    g_object_unref(hdb);
+    unlink(msifile);
+#endif
+}
+
 static void test_markers(void)
 {
     LibmsiDatabase *hdb;
@@ -7480,12 +8681,28 @@ void main()
     test_getcolinfo();
     test_msiexport();
     test_longstrings();
+    test_partial_commit();
+    test_async();
+    test_cancel_first_commit();
+    test_progress();
+    test_memory();
+    test_stats();
+    test_generate_transform();
+    test_snapshot();
     test_streamtable();
     test_binary();
+    test_load_stream_lazy();
     test_where_not_in_selected();
     test_where();
     test_msiimport();
+    test_import_large();
+    test_import_files();
+    test_export_all();
+    test_execute_script();
+    test_insert_records();
     test_binary_import();
+    test_import_rollback();
+    test_import_read_fault();
     test_markers();
     test_handle_limit();
 #if 0
@@ -28,8 +28,6 @@
 #include <limits.h>
 #include <uuid.h>
 
-#include "sqldelim.h"
-
 static gboolean init_suminfo(LibmsiSummaryInfo *si, GError **error)
 {
     uuid_t uu;
@@ -125,13 +123,13 @@ end:
 
 static LibmsiDatabase *db;
 
-static gboolean import_table(char *table, GError **error)
+static gboolean import_tables(const char **tables, GError **error)
 {
     gboolean success = TRUE;
 
-    if (!libmsi_database_import(db, table, error))
+    if (!libmsi_database_import_files(db, tables, 0, error))
     {
-        fprintf(stderr, "failed to import table %s\n", table);
+        fprintf(stderr, "failed to import tables\n");
         success = FALSE;
     }
 
@@ -211,32 +209,20 @@ end:
     return r;
 }
 
-static int do_query(const char *sql, void *opaque)
+static gboolean run_script(const char **sql, GError **error)
 {
-    GError **error = opaque;
-    gboolean success = FALSE;
-    LibmsiQuery *query;
-
-    query = libmsi_query_new(db, sql, error);
-    if (!query) {
-        fprintf(stderr, "failed to open query\n");
-        goto end;
-    }
+    gboolean success = TRUE;
+    char *script;
 
-    if (!libmsi_query_execute(query, NULL, error)) {
+    script = g_strjoinv("\n", (char **)sql);
+    if (!libmsi_database_execute_script(db, script, error))
+    {
         fprintf(stderr, "failed to execute query\n");
-        goto end;
-    }
-
-    success = TRUE;
-
-end:
-    if (query) {
-        libmsi_query_close(query, error);
-        g_object_unref(query);
+        success = FALSE;
     }
+    g_free(script);
 
-    return !success;
+    return success;
 }
 
 static void show_usage(void)
@@ -246,7 +232,7 @@ static void show_usage(void)
         "Options:\n"
         "  -s name [author] [template] [uuid] Set summary information.\n"
         "  -q query         Execute SQL query/queries.\n"
-        "  -i table1.idt    Import one table into the database.\n"
+        "  -i table1.idt... Import tables into the database.\n"
         "  -a stream file   Add 'stream' to storage with contents of 'file'.\n"
         "\nExisting tables or streams will be overwritten. If package.msi does not exist a new file\n"
         "will be created with an empty database.\n"
@@ -257,6 +243,7 @@ int main(int argc, char *argv[])
 {
     GError *error = NULL;
     gboolean success = FALSE;
+    const char **args;
     int n;
 
 #if !GLIB_CHECK_VERSION(2,35,1)
@@ -280,7 +267,6 @@ int main(int argc, char *argv[])
 
     argc -= 2, argv += 2;
     while (argc > 0) {
-        int ret;
         if (argc < 2 || argv[0][0] != '-' || argv[0][2])
         {
             show_usage();
@@ -302,26 +288,33 @@ int main(int argc, char *argv[])
             argc -= 3, argv += 3;
             break;
         case 'i':
-            do {
-                if (!import_table(argv[1], &error))
-                    break;
+            /* all the tables are read at once, on every core */
+            n = 1;
+            while (argv[n + 1] && argv[n + 1][0] != '-')
+                n++;
+
+            args = g_new0(const char *, n + 1);
+            memcpy(args, argv + 1, n * sizeof(char *));
+            success = import_tables(args, &error);
+            g_free(args);
+            if (!success)
+                goto end;
 
-                argc--, argv++;
-            } while (argv[1] && argv[1][0] != '-');
-            argc--, argv++;
+            argc -= n + 1, argv += n + 1;
             break;
         case 'q':
-            do {
-                ret = sql_get_statement(argv[1], do_query, &error);
-                if (ret == 0) {
-                    ret = sql_get_statement("", do_query, &error);
-                }
-                if (ret) {
-                    break;
-                }
-                argc--, argv++;
-            } while (argv[1] && argv[1][0] != '-');
-            argc--, argv++;
+            n = 1;
+            while (argv[n + 1] && argv[n + 1][0] != '-')
+                n++;
+
+            args = g_new0(const char *, n + 1);
+            memcpy(args, argv + 1, n * sizeof(char *));
+            success = run_script(args, &error);
+            g_free(args);
+            if (!success)
+                goto end;
+
+            argc -= n + 1, argv += n + 1;
             break;
         case 'a':
             if (argc < 3) break;
@@ -0,0 +1,939 @@
+/*
+ * msidiff - compare the tables and streams of two MSI files
+ *
+ * Copyright 2013 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "config.h"
+#include "libmsi.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every cell is turned into its JSON text: null, a number, a quoted
+ * string, or the size and hash of a stream.  Cells then compare with
+ * strcmp, and the rows of a table are sorted and merge joined on the
+ * JSON array of their primary key values.  The summary information
+ * goes through the same code, as a table of property ids and values.
+ *
+ * The file lists of -l and -L come from msiextract run on both files.
+ */
+
+typedef struct {
+    gchar *key;                 /* JSON array of the key values */
+    gchar **cells;
+} Row;
+
+typedef struct {
+    guint n_cols;
+    guint n_keys;
+    guint *keys;                /* column index of each key */
+    gchar **names;
+    gchar **types;
+    GPtrArray *rows;            /* of Row *, sorted on key */
+} Table;
+
+typedef struct {
+    const char *from, *to;
+    GPtrArray *tables;          /* names of the tables in both files */
+    GString **results;          /* one JSON object per table, or NULL */
+    gint next;
+    GMutex lock;
+    GError *error;              /* the first one, under lock */
+    gint failed;                /* set with it, read without the lock */
+} DiffContext;
+
+static gint jobs;
+static gboolean tables;
+static gboolean list;
+static gboolean long_list;
+static gboolean version;
+static gchar **files;
+
+static GOptionEntry options[] = {
+    { "tables", 't', 0, G_OPTION_ARG_NONE, &tables,
+      "Compare the tables (the default)", NULL },
+    { "list", 'l', 0, G_OPTION_ARG_NONE, &list,
+      "Compare the lists of installed files", NULL },
+    { "long-list", 'L', 0, G_OPTION_ARG_NONE, &long_list,
+      "Compare the lists of installed files, with their size and hash", NULL },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+      "Number of tables to compare in parallel", "N" },
+    { "version", 'v', 0, G_OPTION_ARG_NONE, &version,
+      "Display program version", NULL },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files,
+      NULL, "FROM-MSI TO-MSI" },
+    { NULL }
+};
+
+static void json_append_string(GString *json, const char *s)
+{
+    g_string_append_c(json, '"');
+    for (; *s; s++) {
+        switch (*s) {
+        case '"': g_string_append(json, "\\\""); break;
+        case '\\': g_string_append(json, "\\\\"); break;
+        case '\n': g_string_append(json, "\\n"); break;
+        case '\r': g_string_append(json, "\\r"); break;
+        case '\t': g_string_append(json, "\\t"); break;
+        default:
+            if ((unsigned char)*s < 0x20)
+                g_string_append_printf(json, "\\u%04x", *s);
+            else
+                g_string_append_c(json, *s);
+        }
+    }
+    g_string_append_c(json, '"');
+}
+
+static void json_append_names(GString *json, GPtrArray *names)
+{
+    guint i;
+
+    g_string_append_c(json, '[');
+    for (i = 0; i < names->len; i++) {
+        if (i)
+            g_string_append(json, ", ");
+        json_append_string(json, g_ptr_array_index(names, i));
+    }
+    g_string_append_c(json, ']');
+}
+
+static gchar *stream_json(GInputStream *in, GError **error)
+{
+    GChecksum *sum;
+    guint8 buffer[65536];
+    guint64 size = 0;
+    gssize n_read;
+    gchar *cell = NULL;
+
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+    while ((n_read = g_input_stream_read(in, buffer, sizeof(buffer), NULL, error)) > 0) {
+        g_checksum_update(sum, buffer, n_read);
+        size += n_read;
+    }
+
+    if (n_read == 0)
+        cell = g_strdup_printf("{\"size\": %" G_GUINT64_FORMAT ", \"sha256\": \"%s\"}",
+                               size, g_checksum_get_string(sum));
+
+    g_checksum_free(sum);
+    return cell;
+}
+
+static gchar *stream_cell(LibmsiRecord *rec, guint field, GError **error)
+{
+    GInputStream *in;
+    gchar *cell;
+
+    in = G_INPUT_STREAM(libmsi_record_get_stream(rec, field));
+    if (!in)
+        return g_strdup("null");
+
+    cell = stream_json(in, error);
+    g_object_unref(in);
+    return cell;
+}
+
+static gchar *record_cell(LibmsiRecord *rec, guint field, const char *type, GError **error)
+{
+    GString *json;
+    gchar *str;
+
+    if (libmsi_record_is_null(rec, field))
+        return g_strdup("null");
+
+    switch (type[0]) {
+    case 'i': case 'I':
+        return g_strdup_printf("%d", libmsi_record_get_int(rec, field));
+
+    case 'v': case 'V':
+        return stream_cell(rec, field, error);
+
+    default:
+        str = libmsi_record_get_string(rec, field);
+        json = g_string_new(NULL);
+        json_append_string(json, str ? str : "");
+        g_free(str);
+        return g_string_free(json, FALSE);
+    }
+}
+
+static void row_free(gpointer data)
+{
+    Row *row = data;
+
+    g_free(row->key);
+    g_strfreev(row->cells);
+    g_free(row);
+}
+
+static gint row_compare(gconstpointer a, gconstpointer b)
+{
+    const Row *ra = *(Row **)a, *rb = *(Row **)b;
+
+    return strcmp(ra->key, rb->key);
+}
+
+static void table_free(Table *t)
+{
+    if (t->rows)
+        g_ptr_array_unref(t->rows);
+    g_free(t->keys);
+    g_strfreev(t->names);
+    g_strfreev(t->types);
+    g_free(t);
+}
+
+static gchar **record_strings(LibmsiRecord *rec)
+{
+    guint i, n = libmsi_record_get_field_count(rec);
+    gchar **strv = g_new0(gchar *, n + 1);
+
+    for (i = 0; i < n; i++)
+        strv[i] = libmsi_record_get_string(rec, i + 1);
+    return strv;
+}
+
+static gint column_index(Table *t, const char *name)
+{
+    guint i;
+
+    for (i = 0; i < t->n_cols; i++)
+        if (!strcmp(t->names[i], name))
+            return i;
+    return -1;
+}
+
+static void row_set_key(Table *t, Row *row)
+{
+    GString *key = g_string_new("[");
+    guint i;
+
+    for (i = 0; i < t->n_keys; i++) {
+        if (i)
+            g_string_append(key, ", ");
+        g_string_append(key, row->cells[t->keys[i]]);
+    }
+    g_string_append_c(key, ']');
+    row->key = g_string_free(key, FALSE);
+}
+
+/* the summary information, as a table keyed on the property id */
+static Table *summary_load(LibmsiDatabase *db, GError **error)
+{
+    LibmsiSummaryInfo *si;
+    LibmsiProperty prop;
+    const gchar *str;
+    GString *json;
+    GArray *props;
+    Table *t;
+    Row *row;
+    guint i;
+
+    si = libmsi_summary_info_new(db, 0, error);
+    if (!si)
+        return NULL;
+
+    t = g_new0(Table, 1);
+    t->rows = g_ptr_array_new_with_free_func(row_free);
+    t->names = g_strsplit("Property Value", " ", -1);
+    t->types = g_strsplit("i2 l0", " ", -1);
+    t->n_cols = 2;
+    t->keys = g_new0(guint, 1);
+    t->n_keys = 1;
+
+    props = libmsi_summary_info_get_properties(si);
+    for (i = 0; i < props->len; i++) {
+        prop = g_array_index(props, LibmsiProperty, i);
+        row = g_new0(Row, 1);
+        row->cells = g_new0(gchar *, 3);
+        row->cells[0] = g_strdup_printf("%d", prop);
+
+        switch (libmsi_summary_info_get_property_type(si, prop, NULL)) {
+        case LIBMSI_PROPERTY_TYPE_INT:
+            row->cells[1] = g_strdup_printf("%d",
+                libmsi_summary_info_get_int(si, prop, NULL));
+            break;
+        case LIBMSI_PROPERTY_TYPE_FILETIME:
+            row->cells[1] = g_strdup_printf("%" G_GUINT64_FORMAT,
+                libmsi_summary_info_get_filetime(si, prop, NULL));
+            break;
+        case LIBMSI_PROPERTY_TYPE_STRING:
+            str = libmsi_summary_info_get_string(si, prop, NULL);
+            json = g_string_new(NULL);
+            json_append_string(json, str ? str : "");
+            row->cells[1] = g_string_free(json, FALSE);
+            break;
+        default:
+            row->cells[1] = g_strdup("null");
+        }
+
+        row_set_key(t, row);
+        g_ptr_array_add(t->rows, row);
+    }
+
+    g_array_unref(props);
+    g_object_unref(si);
+    g_ptr_array_sort(t->rows, row_compare);
+    return t;
+}
+
+static Table *table_load(LibmsiDatabase *db, const char *name, GError **error)
+{
+    LibmsiQuery *query = NULL;
+    LibmsiRecord *rec;
+    GError *err = NULL;
+    Table *t;
+    gchar *sql, *key;
+    gint col;
+    guint i;
+
+    if (!strcmp(name, "_SummaryInformation"))
+        return summary_load(db, error);
+
+    t = g_new0(Table, 1);
+    t->rows = g_ptr_array_new_with_free_func(row_free);
+
+    sql = g_strdup_printf("SELECT * FROM `%s`", name);
+    query = libmsi_query_new(db, sql, error);
+    g_free(sql);
+    if (!query)
+        goto fail;
+
+    rec = libmsi_query_get_column_info(query, LIBMSI_COL_INFO_NAMES, error);
+    if (!rec)
+        goto fail;
+    t->names = record_strings(rec);
+    t->n_cols = libmsi_record_get_field_count(rec);
+    g_object_unref(rec);
+
+    rec = libmsi_query_get_column_info(query, LIBMSI_COL_INFO_TYPES, error);
+    if (!rec)
+        goto fail;
+    t->types = record_strings(rec);
+    g_object_unref(rec);
+
+    /* the key columns need not come first; _Streams has no entry in
+     * _Columns to take its key from */
+    t->keys = g_new0(guint, MAX(t->n_cols, 1));
+    if (!strcmp(name, "_Streams"))
+        t->keys[t->n_keys++] = MAX(column_index(t, "Name"), 0);
+    else {
+        rec = libmsi_database_get_primary_keys(db, name, error);
+        if (!rec)
+            goto fail;
+        for (i = 1; i <= libmsi_record_get_field_count(rec); i++) {
+            key = libmsi_record_get_string(rec, i);
+            col = column_index(t, key);
+            if (col < 0)
+                g_set_error(error, LIBMSI_RESULT_ERROR, LIBMSI_RESULT_INVALID_TABLE,
+                            "%s: no column for key %s", name, key);
+            g_free(key);
+            if (col < 0) {
+                g_object_unref(rec);
+                goto fail;
+            }
+            t->keys[t->n_keys++] = col;
+        }
+        g_object_unref(rec);
+    }
+
+    /* without a primary key, rows are told apart by all their values */
+    if (!t->n_keys)
+        for (; t->n_keys < t->n_cols; t->n_keys++)
+            t->keys[t->n_keys] = t->n_keys;
+
+    if (!libmsi_query_execute(query, NULL, error))
+        goto fail;
+
+    while ((rec = libmsi_query_fetch(query, &err))) {
+        Row *row = g_new0(Row, 1);
+
+        row->cells = g_new0(gchar *, t->n_cols + 1);
+        g_ptr_array_add(t->rows, row);
+        for (i = 0; i < t->n_cols; i++) {
+            row->cells[i] = record_cell(rec, i + 1, t->types[i], &err);
+            if (!row->cells[i])
+                break;
+        }
+        g_object_unref(rec);
+        if (err)
+            break;
+
+        row_set_key(t, row);
+    }
+
+    if (err) {
+        g_propagate_error(error, err);
+        goto fail;
+    }
+
+    g_ptr_array_sort(t->rows, row_compare);
+    g_object_unref(query);
+    return t;
+
+fail:
+    if (query)
+        g_object_unref(query);
+    table_free(t);
+    return NULL;
+}
+
+/* compare the columns both tables have; NULL if nothing changed */
+static GString *table_diff(const char *name, Table *a, Table *b)
+{
+    GPtrArray *added = g_ptr_array_new(), *removed = g_ptr_array_new();
+    GPtrArray *retyped = g_ptr_array_new();
+    GString *rows_added = g_string_new(NULL), *rows_removed = g_string_new(NULL);
+    GString *rows_changed = g_string_new(NULL), *json = NULL;
+    GString *changes;
+    guint i, j, k;
+    gint *map, c;
+
+    /* map the columns of the new table to those of the old one */
+    map = g_new(gint, b->n_cols);
+    for (k = 0; k < b->n_cols; k++) {
+        map[k] = column_index(a, b->names[k]);
+        if (map[k] < 0)
+            g_ptr_array_add(added, b->names[k]);
+        else if (strcmp(a->types[map[k]], b->types[k]))
+            g_ptr_array_add(retyped, b->names[k]);
+    }
+    for (k = 0; k < a->n_cols; k++)
+        if (column_index(b, a->names[k]) < 0)
+            g_ptr_array_add(removed, a->names[k]);
+
+    for (i = j = 0; i < a->rows->len || j < b->rows->len;) {
+        Row *ra = i < a->rows->len ? g_ptr_array_index(a->rows, i) : NULL;
+        Row *rb = j < b->rows->len ? g_ptr_array_index(b->rows, j) : NULL;
+
+        c = !ra ? 1 : !rb ? -1 : strcmp(ra->key, rb->key);
+        if (c < 0) {
+            g_string_append_printf(rows_removed, "%s%s", rows_removed->len ? ", " : "", ra->key);
+            i++;
+            continue;
+        }
+        if (c > 0) {
+            g_string_append_printf(rows_added, "%s%s", rows_added->len ? ", " : "", rb->key);
+            j++;
+            continue;
+        }
+
+        changes = NULL;
+        for (k = 0; k < b->n_cols; k++) {
+            if (map[k] < 0 || !strcmp(ra->cells[map[k]], rb->cells[k]))
+                continue;
+
+            if (!changes)
+                changes = g_string_new(NULL);
+            else
+                g_string_append(changes, ", ");
+            json_append_string(changes, b->names[k]);
+            g_string_append_printf(changes, ": {\"from\": %s, \"to\": %s}",
+                                   ra->cells[map[k]], rb->cells[k]);
+        }
+        if (changes) {
+            g_string_append_printf(rows_changed, "%s\n        {\"key\": %s, \"columns\": {%s}}",
+                                   rows_changed->len ? "," : "", rb->key, changes->str);
+            g_string_free(changes, TRUE);
+        }
+        i++;
+        j++;
+    }
+
+    if (added->len || removed->len || retyped->len ||
+        rows_added->len || rows_removed->len || rows_changed->len) {
+        json = g_string_new("    {\"name\": ");
+        json_append_string(json, name);
+        g_string_append(json, ",\n      \"columns\": {\"added\": ");
+        json_append_names(json, added);
+        g_string_append(json, ", \"removed\": ");
+        json_append_names(json, removed);
+        g_string_append(json, ", \"changed\": ");
+        json_append_names(json, retyped);
+        g_string_append_printf(json, "},\n      \"rows\": {\"added\": [%s], \"removed\": [%s], "
+                               "\"changed\": [%s%s]}}",
+                               rows_added->str, rows_removed->str, rows_changed->str,
+                               rows_changed->len ? "\n      " : "");
+    }
+
+    g_free(map);
+    g_ptr_array_unref(added);
+    g_ptr_array_unref(removed);
+    g_ptr_array_unref(retyped);
+    g_string_free(rows_added, TRUE);
+    g_string_free(rows_removed, TRUE);
+    g_string_free(rows_changed, TRUE);
+    return json;
+}
+
+static void set_error(DiffContext *ctx, GError *error)
+{
+    g_mutex_lock(&ctx->lock);
+    if (!ctx->error)
+        ctx->error = error;
+    else
+        g_error_free(error);
+    g_atomic_int_set(&ctx->failed, 1);
+    g_mutex_unlock(&ctx->lock);
+}
+
+/* each worker opens the files itself: a database is not thread safe */
+static gpointer diff_worker(gpointer data)
+{
+    DiffContext *ctx = data;
+    LibmsiDatabase *a = NULL, *b = NULL;
+    GError *error = NULL;
+    Table *ta, *tb;
+    const char *name;
+    guint i;
+
+    a = libmsi_database_new(ctx->from, LIBMSI_DB_FLAGS_READONLY, NULL, &error);
+    if (a)
+        b = libmsi_database_new(ctx->to, LIBMSI_DB_FLAGS_READONLY, NULL, &error);
+    if (!b)
+        goto end;
+
+    while ((i = g_atomic_int_add(&ctx->next, 1)) < ctx->tables->len &&
+           !g_atomic_int_get(&ctx->failed)) {
+        name = g_ptr_array_index(ctx->tables, i);
+
+        ta = table_load(a, name, &error);
+        if (!ta)
+            break;
+        tb = table_load(b, name, &error);
+        if (!tb) {
+            table_free(ta);
+            break;
+        }
+
+        ctx->results[i] = table_diff(name, ta, tb);
+        table_free(ta);
+        table_free(tb);
+    }
+
+end:
+    if (error)
+        set_error(ctx, error);
+    if (a)
+        g_object_unref(a);
+    if (b)
+        g_object_unref(b);
+    return NULL;
+}
+
+static GPtrArray *table_names(const char *path, GError **error)
+{
+    LibmsiDatabase *db;
+    LibmsiQuery *query = NULL;
+    LibmsiRecord *rec;
+    GPtrArray *names = NULL;
+    GError *err = NULL;
+
+    db = libmsi_database_new(path, LIBMSI_DB_FLAGS_READONLY, NULL, error);
+    if (!db)
+        return NULL;
+
+    query = libmsi_query_new(db, "SELECT `Name` FROM `_Tables`", error);
+    if (!query || !libmsi_query_execute(query, NULL, error))
+        goto end;
+
+    names = g_ptr_array_new_with_free_func(g_free);
+    while ((rec = libmsi_query_fetch(query, &err))) {
+        g_ptr_array_add(names, libmsi_record_get_string(rec, 1));
+        g_object_unref(rec);
+    }
+
+    if (err) {
+        g_propagate_error(error, err);
+        g_ptr_array_unref(names);
+        names = NULL;
+    }
+
+end:
+    if (query)
+        g_object_unref(query);
+    g_object_unref(db);
+    return names;
+}
+
+static gint name_compare(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* the "tables" and "changed" members of the output */
+static GString *tables_diff(gboolean *differ, GError **error)
+{
+    GPtrArray *from = NULL, *to = NULL, *added, *removed;
+    GString *json = NULL;
+    GThread **threads;
+    DiffContext ctx = { 0 };
+    guint i, j, n;
+    int c;
+
+    from = table_names(files[0], error);
+    if (from)
+        to = table_names(files[1], error);
+    if (!to) {
+        if (from)
+            g_ptr_array_unref(from);
+        return NULL;
+    }
+
+    g_ptr_array_sort(from, name_compare);
+    g_ptr_array_sort(to, name_compare);
+
+    /* tables in both files get their contents compared */
+    ctx.from = files[0];
+    ctx.to = files[1];
+    ctx.tables = g_ptr_array_new();
+    added = g_ptr_array_new();
+    removed = g_ptr_array_new();
+    for (i = j = 0; i < from->len || j < to->len;) {
+        c = i == from->len ? 1 : j == to->len ? -1 :
+            strcmp(g_ptr_array_index(from, i), g_ptr_array_index(to, j));
+        if (c < 0)
+            g_ptr_array_add(removed, g_ptr_array_index(from, i++));
+        else if (c > 0)
+            g_ptr_array_add(added, g_ptr_array_index(to, j++));
+        else {
+            g_ptr_array_add(ctx.tables, g_ptr_array_index(from, i));
+            i++;
+            j++;
+        }
+    }
+    g_ptr_array_add(ctx.tables, "_Streams");
+    g_ptr_array_add(ctx.tables, "_SummaryInformation");
+
+    ctx.results = g_new0(GString *, ctx.tables->len);
+    g_mutex_init(&ctx.lock);
+
+    n = jobs > 0 ? jobs : g_get_num_processors();
+    n = MIN(n, ctx.tables->len);
+    threads = g_new(GThread *, n);
+    for (i = 0; i < n; i++)
+        threads[i] = g_thread_new("msidiff", diff_worker, &ctx);
+    for (i = 0; i < n; i++)
+        g_thread_join(threads[i]);
+    g_free(threads);
+
+    if (ctx.error) {
+        g_propagate_error(error, ctx.error);
+        for (i = 0; i < ctx.tables->len; i++)
+            if (ctx.results[i])
+                g_string_free(ctx.results[i], TRUE);
+        goto end;
+    }
+
+    *differ = *differ || added->len || removed->len;
+    json = g_string_new("\"tables\": {\"added\": ");
+    json_append_names(json, added);
+    g_string_append(json, ", \"removed\": ");
+    json_append_names(json, removed);
+
+    g_string_append(json, "},\n  \"changed\": [");
+    for (i = j = 0; i < ctx.tables->len; i++) {
+        if (!ctx.results[i])
+            continue;
+        g_string_append_printf(json, "%s\n%s", j++ ? "," : "", ctx.results[i]->str);
+        g_string_free(ctx.results[i], TRUE);
+        *differ = TRUE;
+    }
+    g_string_append_printf(json, "%s]", j ? "\n  " : "");
+
+end:
+    g_free(ctx.results);
+    g_mutex_clear(&ctx.lock);
+    g_ptr_array_unref(ctx.tables);
+    g_ptr_array_unref(added);
+    g_ptr_array_unref(removed);
+    g_ptr_array_unref(from);
+    g_ptr_array_unref(to);
+    return json;
+}
+
+typedef struct {
+    gchar *name;                /* path under the extraction directory */
+    gchar *info;                /* size and hash with -L, or NULL */
+} FileEntry;
+
+static void file_entry_free(gpointer data)
+{
+    FileEntry *entry = data;
+
+    g_free(entry->name);
+    g_free(entry->info);
+    g_free(entry);
+}
+
+static gint file_entry_compare(gconstpointer a, gconstpointer b)
+{
+    const FileEntry *ea = *(FileEntry **)a, *eb = *(FileEntry **)b;
+
+    return strcmp(ea->name, eb->name);
+}
+
+static gboolean list_dir(const char *root, const char *rel, GPtrArray *entries,
+                         GError **error)
+{
+    GFileInputStream *in;
+    FileEntry *entry;
+    const gchar *base;
+    gchar *path, *child;
+    gboolean success = TRUE;
+    GFile *file;
+    GDir *dir;
+
+    path = rel ? g_build_filename(root, rel, NULL) : g_strdup(root);
+    dir = g_dir_open(path, 0, error);
+    g_free(path);
+    if (!dir)
+        return FALSE;
+
+    while (success && (base = g_dir_read_name(dir))) {
+        child = rel ? g_build_filename(rel, base, NULL) : g_strdup(base);
+        path = g_build_filename(root, child, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            success = list_dir(root, child, entries, error);
+            g_free(child);
+            g_free(path);
+            continue;
+        }
+
+        entry = g_new0(FileEntry, 1);
+        entry->name = child;
+        g_ptr_array_add(entries, entry);
+        if (long_list) {
+            file = g_file_new_for_path(path);
+            in = g_file_read(file, NULL, error);
+            if (in) {
+                entry->info = stream_json(G_INPUT_STREAM(in), error);
+                g_object_unref(in);
+            }
+            g_object_unref(file);
+            success = entry->info != NULL;
+        }
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+    return success;
+}
+
+static void remove_tree(const char *path)
+{
+    const gchar *base;
+    gchar *child;
+    GDir *dir;
+
+    dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        while ((base = g_dir_read_name(dir))) {
+            child = g_build_filename(path, base, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+                !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+                remove_tree(child);
+            else
+                g_remove(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+/* the files msiextract installs from @path, sorted on their name */
+static GPtrArray *file_list(const char *path, GError **error)
+{
+    GPtrArray *entries = NULL;
+    gchar *argv[5];
+    gchar *tmpdir;
+    gint status;
+
+    tmpdir = g_dir_make_tmp("msidiff-XXXXXX", error);
+    if (!tmpdir)
+        return NULL;
+
+    argv[0] = "msiextract";
+    argv[1] = "--directory";
+    argv[2] = tmpdir;
+    argv[3] = (gchar *)path;
+    argv[4] = NULL;
+    if (!g_spawn_sync(NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                      NULL, NULL, NULL, NULL, &status, error) ||
+        !g_spawn_check_exit_status(status, error))
+        goto end;
+
+    entries = g_ptr_array_new_with_free_func(file_entry_free);
+    if (!list_dir(tmpdir, NULL, entries, error)) {
+        g_ptr_array_unref(entries);
+        entries = NULL;
+        goto end;
+    }
+    g_ptr_array_sort(entries, file_entry_compare);
+
+end:
+    remove_tree(tmpdir);
+    g_free(tmpdir);
+    return entries;
+}
+
+/* the "files" member of the output */
+static GString *files_diff(gboolean *differ, GError **error)
+{
+    GPtrArray *from, *to = NULL;
+    GString *added, *removed, *changed, *json;
+    FileEntry *ea, *eb;
+    guint i, j;
+    int c;
+
+    from = file_list(files[0], error);
+    if (from)
+        to = file_list(files[1], error);
+    if (!to) {
+        if (from)
+            g_ptr_array_unref(from);
+        return NULL;
+    }
+
+    added = g_string_new(NULL);
+    removed = g_string_new(NULL);
+    changed = g_string_new(NULL);
+    for (i = j = 0; i < from->len || j < to->len;) {
+        ea = i < from->len ? g_ptr_array_index(from, i) : NULL;
+        eb = j < to->len ? g_ptr_array_index(to, j) : NULL;
+
+        c = !ea ? 1 : !eb ? -1 : strcmp(ea->name, eb->name);
+        if (c < 0) {
+            g_string_append(removed, removed->len ? ", " : "");
+            json_append_string(removed, ea->name);
+            i++;
+        } else if (c > 0) {
+            g_string_append(added, added->len ? ", " : "");
+            json_append_string(added, eb->name);
+            j++;
+        } else {
+            if (ea->info && strcmp(ea->info, eb->info)) {
+                g_string_append(changed, changed->len ? ",\n    {\"name\": " : "\n    {\"name\": ");
+                json_append_string(changed, ea->name);
+                g_string_append_printf(changed, ", \"from\": %s, \"to\": %s}",
+                                       ea->info, eb->info);
+            }
+            i++;
+            j++;
+        }
+    }
+
+    *differ = *differ || added->len || removed->len || changed->len;
+    json = g_string_new(NULL);
+    g_string_append_printf(json, "\"files\": {\"added\": [%s], \"removed\": [%s], "
+                           "\"changed\": [%s%s]}",
+                           added->str, removed->str, changed->str,
+                           changed->len ? "\n  " : "");
+
+    g_string_free(added, TRUE);
+    g_string_free(removed, TRUE);
+    g_string_free(changed, TRUE);
+    g_ptr_array_unref(from);
+    g_ptr_array_unref(to);
+    return json;
+}
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context;
+    GString *parts[2] = { NULL, NULL };
+    GError *error = NULL;
+    gboolean differ = FALSE;
+    guint i;
+
+#if !GLIB_CHECK_VERSION(2,35,1)
+    g_type_init ();
+#endif
+    g_set_prgname ("msidiff");
+
+    context = g_option_context_new("- compare the contents of two MSI files");
+    g_option_context_set_summary(context,
+        "Print the tables, columns, rows and streams added, removed or changed\n"
+        "between two MSI files as JSON, along with the summary information.\n"
+        "With -l or -L, compare the files that msiextract gets out of them.\n"
+        "The exit status is 0 if the files have the same contents, 1 if they\n"
+        "differ and 2 on errors.");
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s: %s\n", g_get_prgname (), error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 2;
+    }
+
+    if (version) {
+        printf("%s (%s) version %s\n", g_get_prgname (), PACKAGE, VERSION);
+        g_option_context_free(context);
+        return 0;
+    }
+
+    if (!files || g_strv_length(files) != 2) {
+        gchar *help = g_option_context_get_help(context, TRUE, NULL);
+        g_printerr("%s", help);
+        g_free(help);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    /* tables mode is the default */
+    if (!list && !long_list)
+        tables = TRUE;
+
+    if (tables && !(parts[0] = tables_diff(&differ, &error)))
+        goto error;
+    if ((list || long_list) && !(parts[1] = files_diff(&differ, &error)))
+        goto error;
+
+    printf("{\"from\": ");
+    for (i = 0; i < 2; i++) {
+        GString *name = g_string_new(NULL);
+
+        json_append_string(name, files[i]);
+        printf("%s%s", i ? ", \"to\": " : "", name->str);
+        g_string_free(name, TRUE);
+    }
+    for (i = 0; i < 2; i++) {
+        if (!parts[i])
+            continue;
+        printf(",\n  %s", parts[i]->str);
+        g_string_free(parts[i], TRUE);
+    }
+    printf("}\n");
+
+    g_strfreev(files);
+    return differ ? 1 : 0;
+
+error:
+    g_printerr("%s: %s\n", g_get_prgname (), error->message);
+    g_clear_error(&error);
+    return 2;
+}
@@ -5,11 +5,13 @@ static bool list_only;
 [CCode (array_length = false, array_null_terminated = true)]
 static string[] files;
 static string? directory = null;
+static int jobs = 0;
 
 private const OptionEntry[] options = {
     { "version", 0, 0, OptionArg.NONE, ref version, N_("Display version number"), null },
     { "directory", 'C', 0, OptionArg.FILENAME, ref directory, N_("Extract to directory"), null },
     { "list", 'l', 0, OptionArg.NONE, ref list_only, N_("List files only"), null },
+    { "jobs", 'j', 0, OptionArg.INT, ref jobs, N_("Extract up to N cabinets at once"), "N" },
     { "", 0, 0, OptionArg.FILENAME_ARRAY, ref files, null, N_("MSI_FILE...") },
     { null }
 };
@@ -41,21 +43,30 @@ public string lookup_cab (string dir, string cab) throws GLib.Error
     return path.get_child (cab).get_path ();
 }
 
-public void extract_cab (Libmsi.Database db, string cab,
-                         HashTable<string, string> cab_to_name) throws GLib.Error
+// Returns the names of the files extracted, one per line, for the
+// caller to print in cabinet order.
+public string extract_cab (string filename, string cab,
+                           HashTable<string, string> cab_to_name) throws GLib.Error
 {
     var cabinet = new GCab.Cabinet ();
+    var extracted = new StringBuilder ();
 
     if (cab.has_prefix ("#")) {
+        // The streams of a database all read through the one file
+        // position, so each cabinet gets a database of its own; the
+        // stream is then read in place as the cabinet is extracted.
+        var db = new Libmsi.Database (filename, Libmsi.DbFlags.READONLY, null);
         var name = cab.substring (1);
         var query = new Libmsi.Query (db, "SELECT `Data` FROM `_Streams` WHERE `Name` = '%s'".printf (name));
         query.execute ();
         var rec = query.fetch ();
+        if (rec == null)
+            throw new GLib.IOError.NOT_FOUND ("%s: no such stream", cab);
         cabinet.load (rec.get_stream (1));
     }
     else {
         // Look for the cab file in the directory the MSI file resides in.
-        var dbpath = File.new_for_path (db.path).get_parent ();
+        var dbpath = File.new_for_path (filename).get_parent ();
         cab = lookup_cab (dbpath.get_path (), cab);
 
         try {
@@ -73,9 +84,11 @@ public void extract_cab (Libmsi.Database db, string cab,
                 warning ("couldn't lookup MSI name, fallback on cab name %s", extname);
             }
             current.set_extract_name (extname);
-            GLib.stdout.printf ("%s\n", extname);
+            extracted.append (extname + "\n");
             return true;
         }, null);
+
+    return extracted.str;
 }
 
 public string? get_directory_name (Libmsi.Record rec) throws GLib.Error {
@@ -139,6 +152,7 @@ public void extract (string filename) throws GLib.Error {
     if (list_only)
         exit (0);
 
+    string[] cabs = {};
     query = new Libmsi.Query (db, "SELECT * FROM `Media`");
     query.execute ();
     while ((rec = query.fetch ()) != null) {
@@ -147,7 +161,27 @@ public void extract (string filename) throws GLib.Error {
             // Ignore empty cab names
             continue;
         }
-        extract_cab (db, cab, cab_to_name);
+        cabs += cab;
+    }
+
+    if (cabs.length > 1) {
+        // so that cabinets extracted side by side don't race to
+        // create the same directories
+        foreach (var file in cab_to_name.get_values ())
+            DirUtils.create_with_parents (Path.build_filename (directory, Path.get_dirname (file)), 0755);
+    }
+
+    // the names are printed once all are extracted, so that the output
+    // is the same however many cabinets were extracted at once
+    var extracted = new string?[cabs.length];
+    try {
+        Wixl.parallel_for (cabs.length, (i) => {
+                extracted[i] = extract_cab (filename, cabs[i], cab_to_name);
+            }, jobs);
+    } finally {
+        foreach (var names in extracted)
+            if (names != null)
+                GLib.stdout.printf ("%s", names);
     }
 }
 
@@ -128,6 +128,9 @@ static void print_libmsi_error(LibmsiResultError r)
     case LIBMSI_RESULT_INVALID_DATATYPE:
         fprintf(stderr, "%s: invalid datatype\n", g_get_prgname ());
         exit(1);
+    case LIBMSI_RESULT_READ_FAULT:
+        fprintf(stderr, "%s: read error\n", g_get_prgname ());
+        exit(1);
     default:
         g_warn_if_reached ();
     }
@@ -637,14 +640,19 @@ static int cmd_export(struct Command *cmd, int argc, char **argv, GError **error
 {
     LibmsiDatabase *db = NULL;
     gboolean sql = FALSE;
+    const char *dir = NULL;
 
     if (argc > 1 && !strcmp(argv[1], "-s")) {
         sql = TRUE;
         argc--;
         argv++;
+    } else if (argc > 2 && !strcmp(argv[1], "-d")) {
+        dir = argv[2];
+        argc -= 2;
+        argv += 2;
     }
 
-    if (argc != 3) {
+    if (argc != (dir ? 2 : 3)) {
         cmd_usage(stderr, cmd);
     }
 
@@ -652,7 +660,10 @@ static int cmd_export(struct Command *cmd, int argc, char **argv, GError **error
     if (!db)
         return 1;
 
-    if (sql) {
+    if (dir) {
+        if (!libmsi_database_export_all(db, dir, 0, error))
+            goto end;
+    } else if (sql) {
         if (!export_sql(db, argv[2], error))
             return 1;
     } else {
@@ -717,8 +728,10 @@ static struct Command cmds[] = {
     },
     {
         .cmd = "export",
-        .opts = "[-s] FILE TABLE\n\nOptions:\n"
-                "  -s                Format output as an SQL query",
+        .opts = "[-s] FILE TABLE\n"
+                "msiinfo export -d DIR FILE\n\nOptions:\n"
+                "  -s                Format output as an SQL query\n"
+                "  -d DIR            Export every table to DIR",
         .desc = "Export a table in text form from an .msi file",
         .func = cmd_export,
     },
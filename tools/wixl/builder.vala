@@ -41,6 +41,8 @@ namespace Wixl {
             path.append (file);
         }
 
+        public Timings timings = new Timings ();
+
         List<WixRoot> roots;
         public void load_doc (Xml.Doc doc) throws GLib.Error {
             for (var child = doc.children; child != null; child = child->next) {
@@ -51,6 +53,7 @@ namespace Wixl {
                     var root = new WixRoot ();
                     root.load (child);
                     roots.append (root);
+                    index = null;
                     break;
                 }
             }
@@ -60,30 +63,90 @@ namespace Wixl {
             string data;
             FileUtils.get_contents (file.get_path (), out data);
 
+            timings.begin ("preprocess");
             var p = new Preprocessor (variables, includedirs);
             var doc = p.preprocess (data, file);
             if (preproc_only) {
+                timings.end ();
                 doc.dump_format (FileStream.fdopen (1, "w"));
                 return;
             }
 
+            timings.begin ("load");
             load_doc (doc);
+            timings.end ();
+
+            if (keep_docs)
+                docs.append ((owned) doc);
         }
 
-        public G? find_element<G> (string Id) {
-            foreach (var r in roots) {
-                var e = r.find_element<G> (Id);
-                if (e != null)
-                    return e;
-            }
+        // the preprocessed documents, kept for builders whose variables
+        // are the same
+        public bool keep_docs;
+        List<Xml.Doc> docs;
+
+        public void load_docs_of (WixBuilder other) throws GLib.Error {
+            timings.begin ("load");
+            foreach (var doc in other.docs)
+                load_doc (doc);
+            timings.end ();
+        }
+
+        // every element with an Id, by its exact type and Id, and
+        // every node in document order; built on first use after
+        // loading, so lookups don't walk the trees
+        HashTable<string, WixElement>? index;
+        WixNode[] nodes;
+
+        static string index_key (Type type, string Id) {
+            return type.name () + ":" + Id;
+        }
+
+        void index_element (WixElement e) {
+            if (e.Id == null)
+                return;
+
+            // the first in document order wins, as with a walk
+            var key = index_key (e.get_type (), e.Id);
+            if (!index.contains (key))
+                index.insert (key, e);
+        }
+
+        void index_node (WixNode node) {
+            nodes += node;
+
+            var e = node as WixElement;
+            if (e == null)
+                return;
+
+            index_element (e);
+            foreach (var c in e.children)
+                index_node (c);
+        }
+
+        void ensure_index () {
+            if (index != null)
+                return;
+
+            index = new HashTable<string, WixElement> (str_hash, str_equal);
+            nodes = {};
+            foreach (var r in roots)
+                index_node (r);
+        }
 
-            return null;
+        public G? find_element<G> (string Id) {
+            ensure_index ();
+            return index.lookup (index_key (typeof (G), Id));
         }
 
         public G[] get_elements<G> () {
             G[] elems = {};
-            foreach (var r in roots)
-                elems = r.add_elements<G> (elems);
+            var type = typeof (G);
+
+            ensure_index ();
+            foreach (var n in nodes)
+                if (n.get_type ().is_a (type))
+                    elems += n;
 
             return elems;
         }
@@ -198,22 +261,75 @@ namespace Wixl {
         }
 
         List<WixMedia> medias;
+        public BuildCache? cache;
+        // the stamp and digest of each file, to tell its cabinet apart
+        HashTable<string, string> file_keys;
+
         private void hash_files () throws GLib.Error {
+            WixFile[] files = {};
+            int[] todo = {};
+
             foreach (var rec in db.table_file.records) {
                 var f = rec.get_data<WixFile> ("wixfile");
                 var component = f.parent as WixComponent;
                 if (component.in_feature.length () == 0)
                     continue;
 
-                db.table_file_hash.add_with_file (f.Id, f.file);
+                files += f;
+            }
+
+            var hashes = new int[files.length * 4];
+            var stamps = new string[files.length];
+            for (var i = 0; i < files.length; i++) {
+                if (cache != null) {
+                    var info = files[i].file.query_info (BuildCache.FILE_ATTRIBUTES, 0);
+                    stamps[i] = BuildCache.stamp (files[i].file, info);
+                    if (cache.lookup_md5 (files[i].file, stamps[i], hashes[i * 4:i * 4 + 4]))
+                        continue;
+                }
+                todo += i;
+            }
+
+            // hash on every core, then add the rows in file order
+            parallel_for (todo.length, (j) => {
+                var i = todo[j];
+                compute_md5 (files[i].file, ref hashes[i * 4], ref hashes[i * 4 + 1],
+                             ref hashes[i * 4 + 2], ref hashes[i * 4 + 3]);
+            });
+
+            file_keys = new HashTable<string, string> (str_hash, str_equal);
+            for (var i = 0; i < files.length; i++) {
+                db.table_file_hash.add (files[i].Id, hashes[i * 4], hashes[i * 4 + 1],
+                                        hashes[i * 4 + 2], hashes[i * 4 + 3]);
+                if (cache == null)
+                    continue;
+
+                cache.store_md5 (files[i].file, stamps[i], hashes[i * 4:i * 4 + 4]);
+                file_keys.insert (files[i].Id, "%s %08x%08x%08x%08x".printf (
+                    stamps[i], hashes[i * 4], hashes[i * 4 + 1],
+                    hashes[i * 4 + 2], hashes[i * 4 + 3]));
             }
+
+            if (cache != null)
+                cache.save ();
         }
 
         private void build_cabinet () throws GLib.Error {
             var sequence = 0;
-
+            WixMedia[] embedded = {};
+            GCab.Cabinet?[] cabs = {};
+            File?[] cached = {};
+            string?[] digests = {};
+            uint[] counts = {};
+            int64[] sizes = {};
+
+            // sequence numbers follow the media order, so the folders
+            // are filled here and only the compression is spread out
             foreach (var m in medias) {
                 var folder = new GCab.Folder (GCab.Compression.MSZIP);
+                var key = new StringBuilder ("MSZIP\n");
+                uint count = 0;
+                int64 size = 0;
 
                 foreach (var rec in db.table_file.records) {
                     var f = rec.get_data<WixFile> ("wixfile");
@@ -225,19 +341,81 @@ namespace Wixl {
                         continue;
 
                     folder.add_file (new GCab.File.with_file (f.Id, f.file), false);
+                    count += 1;
+                    size += rec.get_int (4);
                     sequence += 1;
                     MsiTableFile.set_sequence (rec, sequence);
+                    if (cache != null)
+                        key.append ("%s %s\n".printf (f.Id, file_keys.lookup (f.Id)));
                 }
 
+                db.table_media.set_last_sequence (m.record, sequence);
+                if (!parse_yesno (m.EmbedCab))
+                    continue;
+
                 var cab = new GCab.Cabinet ();
                 cab.add_folder (folder);
-                var output = new MemoryOutputStream (null, realloc, free);
-                cab.write (output, null, null, null);
-                var input = new MemoryInputStream.from_data (output.get_data ()[0:output.data_size], null);
-                if (parse_yesno (m.EmbedCab))
-                    db.table_streams.add (m.Cabinet, input, output.data_size);
+                embedded += m;
+                cabs += cab;
+                counts += count;
+                sizes += size;
+                cached += cache != null ? cache.get_cabinet (key.str) : null;
+                digests += cache != null ? cache.lookup_cabinet (cached[cached.length - 1]) : null;
+            }
 
-                db.table_media.set_last_sequence (m.record, sequence);
+            // each cabinet that is not in the cache yet, or does not
+            // match the size and hash it was stored with, is compressed
+            // on its own core into a temporary file, which is read back
+            // when the MSI is written, or renamed into the cache
+            var files = new File[cabs.length];
+            try {
+                parallel_for (cabs.length, (i) => {
+                    if (digests[i] != null) {
+                        try {
+                            if (BuildCache.digest (cached[i]) == digests[i]) {
+                                files[i] = cached[i];
+                                digests[i] = null;
+                                return;
+                            }
+                        } catch (GLib.Error error) {
+                        }
+                    }
+
+                    FileIOStream stream;
+                    File tmp;
+                    if (cached[i] != null)
+                        tmp = BuildCache.new_cabinet_tmp (cached[i], out stream);
+                    else
+                        tmp = File.new_tmp ("wixl-XXXXXX.cab", out stream);
+                    files[i] = tmp;
+                    cabs[i].write (stream.output_stream, null, null, null);
+                    stream.close ();
+
+                    if (cached[i] != null) {
+                        digests[i] = BuildCache.digest (tmp);
+                        tmp.move (cached[i], FileCopyFlags.OVERWRITE);
+                        files[i] = cached[i];
+                    }
+                });
+            } catch (GLib.Error error) {
+                for (var i = 0; i < files.length; i++)
+                    if (files[i] != null && files[i] != cached[i])
+                        FileUtils.unlink (files[i].get_path ());
+                throw error;
+            }
+
+            // the cabinets built this time, by what they should hold
+            if (cache != null) {
+                for (var i = 0; i < cabs.length; i++)
+                    if (digests[i] != null)
+                        cache.store_cabinet (cached[i], digests[i]);
+                cache.save ();
+            }
+
+            for (var i = 0; i < embedded.length; i++) {
+                var info = files[i].query_info (FileAttribute.STANDARD_SIZE, 0);
+                timings.add_media (embedded[i].Cabinet, counts[i], sizes[i], info.get_size ());
+                db.table_streams.add_file (embedded[i].Cabinet, files[i], cached[i] == null);
             }
         }
 
@@ -263,6 +441,8 @@ namespace Wixl {
 
         public MsiDatabase build () throws GLib.Error {
             db = new MsiDatabase (arch);
+            timings.begin ("visit");
+            ensure_index ();
 
             foreach (var r in roots) {
                 root = r;
@@ -272,9 +452,13 @@ namespace Wixl {
 
             property_update ();
             shortcut_target ();
+            timings.begin ("sequence_actions");
             sequence_actions ();
+            timings.begin ("hash_files");
             hash_files ();
+            timings.begin ("build_cabinet");
             build_cabinet ();
+            timings.end ();
 
             return db;
         }
@@ -626,6 +810,7 @@ namespace Wixl {
                                       reg_root,
                                       reg_key,
                                       reg.Name != null ? reg.Name.down () : null);
+                index_element (reg);
             }
 
             switch (t) {
@@ -0,0 +1,136 @@
+namespace Wixl {
+
+    // Remembers the MD5 of each source file, by path, size and mtime,
+    // and keeps the cabinets built from them, by the files they hold,
+    // so that an unchanged payload is neither hashed nor compressed
+    // again.
+    public class BuildCache: Object {
+        public const string FILE_ATTRIBUTES = FileAttribute.STANDARD_SIZE + "," +
+            FileAttribute.TIME_MODIFIED + "," + FileAttribute.TIME_MODIFIED_USEC;
+
+        File dir;
+        File index;
+        KeyFile files;
+        bool dirty;
+
+        public BuildCache (string path) throws GLib.Error {
+            dir = File.new_for_commandline_arg (path);
+            try {
+                dir.make_directory_with_parents ();
+            } catch (IOError.EXISTS error) {
+            }
+
+            index = dir.get_child ("files.ini");
+            files = new KeyFile ();
+            try {
+                files.load_from_file (index.get_path (), KeyFileFlags.NONE);
+            } catch (FileError.NOENT error) {
+            } catch (KeyFileError error) {
+                // a damaged index only costs a rebuild
+                warning ("ignoring cache index %s: %s", index.get_path (), error.message);
+                files = new KeyFile ();
+            }
+        }
+
+        // a description of the file as it is now; when it matches, the
+        // file is taken to be unchanged
+        public static string stamp (File file, FileInfo info) {
+            return ("%s %" + int64.FORMAT + " %" + uint64.FORMAT + ".%06u").printf (
+                file.get_path (), info.get_size (),
+                info.get_attribute_uint64 (FileAttribute.TIME_MODIFIED),
+                info.get_attribute_uint32 (FileAttribute.TIME_MODIFIED_USEC));
+        }
+
+        static string group_name (File file) {
+            // paths may hold characters a group name can't
+            return Checksum.compute_for_string (ChecksumType.SHA1, file.get_path ());
+        }
+
+        public bool lookup_md5 (File file, string stamp, int[] hash) {
+            var name = group_name (file);
+
+            try {
+                if (files.get_string (name, "stamp") != stamp)
+                    return false;
+
+                var md5 = files.get_integer_list (name, "md5");
+                if (md5.length != hash.length)
+                    return false;
+                for (var i = 0; i < md5.length; i++)
+                    hash[i] = md5[i];
+            } catch (KeyFileError error) {
+                return false;
+            }
+
+            return true;
+        }
+
+        public void store_md5 (File file, string stamp, int[] hash) {
+            var name = group_name (file);
+
+            files.set_string (name, "stamp", stamp);
+            files.set_integer_list (name, "md5", hash);
+            dirty = true;
+        }
+
+        // where the cabinet described by key is, or goes once built
+        public File get_cabinet (string key) {
+            return dir.get_child (Checksum.compute_for_string (ChecksumType.SHA256, key) + ".cab");
+        }
+
+        // a new file next to cab, to write it in and then rename over
+        // it: a rename within the cache directory is atomic, where a
+        // move from the temporary directory may be a copy
+        public static File new_cabinet_tmp (File cab, out FileIOStream stream) throws GLib.Error {
+            while (true) {
+                var tmp = cab.get_parent ().get_child (
+                    "%s.%08x.tmp".printf (cab.get_basename (), Random.next_int ()));
+                try {
+                    stream = tmp.create_readwrite (FileCreateFlags.PRIVATE);
+                    return tmp;
+                } catch (IOError.EXISTS error) {
+                }
+            }
+        }
+
+        // the size and SHA-256 of a file, to tell a cabinet that was
+        // cut short or damaged from the one that was stored
+        public static string digest (File file) throws GLib.Error {
+            var checksum = new Checksum (ChecksumType.SHA256);
+            var stream = file.read ();
+            var buffer = new uint8[1024 * 1024];
+            int64 size = 0;
+            ssize_t n;
+
+            while ((n = stream.read (buffer)) > 0) {
+                checksum.update (buffer, n);
+                size += n;
+            }
+
+            return ("%" + int64.FORMAT + " %s").printf (size, checksum.get_string ());
+        }
+
+        // the digest of cab when it was stored, or null if it never was
+        public string? lookup_cabinet (File cab) {
+            try {
+                return files.get_string (cab.get_basename (), "digest");
+            } catch (KeyFileError error) {
+                return null;
+            }
+        }
+
+        public void store_cabinet (File cab, string digest) {
+            files.set_string (cab.get_basename (), "digest", digest);
+            dirty = true;
+        }
+
+        public void save () throws GLib.Error {
+            if (!dirty)
+                return;
+
+            FileUtils.set_contents (index.get_path (), files.to_data ());
+            dirty = false;
+        }
+    }
+
+} // Wixl
@@ -5,18 +5,21 @@ namespace Wixl {
         public List<Libmsi.Record> records;
 
         public class string sql_create;
-        public class string sql_insert;
+        // the columns each record fills, in order
+        public class string[] columns;
 
         public virtual void create (Libmsi.Database db) throws GLib.Error {
             var query = new Libmsi.Query (db, sql_create);
             query.execute ();
 
-            if (sql_insert == null)
+            if (columns == null)
                 return;
 
-            query = new Libmsi.Query (db, sql_insert);
+            // all the rows go in with a single call, sorted once
+            Libmsi.Record[] recs = {};
             foreach (var r in records)
-                query.execute (r);
+                recs += r;
+            db.insert_records (name, columns, recs);
         }
     }
 
@@ -24,7 +27,7 @@ namespace Wixl {
         static construct {
             name = "MsiFileHash";
             sql_create = "CREATE TABLE `MsiFileHash` (`File_` CHAR(72) NOT NULL, `Options` INT NOT NULL, `HashPart1` LONG NOT NULL, `HashPart2` LONG NOT NULL, `HashPart3` LONG NOT NULL, `HashPart4` LONG NOT NULL PRIMARY KEY `File_`)";
-            sql_insert = "INSERT INTO `MsiFileHash` (`File_`, `Options`, `HashPart1`, `HashPart2`, `HashPart3`, `HashPart4`) VALUES (?, ?, ?, ?, ?, ?)";
+            columns = { "File_", "Options", "HashPart1", "HashPart2", "HashPart3", "HashPart4" };
         }
 
         public void add (string file,
@@ -42,20 +45,13 @@ namespace Wixl {
 
             records.append (rec);
         }
-
-        public void add_with_file (string FileId, File file) throws GLib.Error {
-            int hash1 = 0, hash2 = 0, hash3 = 0, hash4 = 0;
-
-            compute_md5 (file, ref hash1, ref hash2, ref hash3, ref hash4);
-            add (FileId, hash1, hash2, hash3, hash4);
-        }
     }
 
     class MsiTableIcon: MsiTable {
         static construct {
             name = "Icon";
             sql_create = "CREATE TABLE `Icon` (`Name` CHAR(72) NOT NULL, `Data` OBJECT NOT NULL PRIMARY KEY `Name`)";
-            sql_insert = "INSERT INTO `Icon` (`Name`, `Data`) VALUES (?, ?)";
+            columns = { "Name", "Data" };
         }
 
         public void add (string id, string filename) throws GLib.Error {
@@ -73,7 +69,7 @@ namespace Wixl {
         static construct {
             name = "Binary";
             sql_create = "CREATE TABLE `Binary` (`Name` CHAR(72) NOT NULL, `Data` OBJECT NOT NULL PRIMARY KEY `Name`)";
-            sql_insert = "INSERT INTO `Binary` (`Name`, `Data`) VALUES (?, ?)";
+            columns = { "Name", "Data" };
         }
 
         public void add (string id, string filename) throws GLib.Error {
@@ -104,7 +100,7 @@ namespace Wixl {
         protected class void set_sequence_table_name (string table) {
             name = table;
             sql_create = "CREATE TABLE `%s` (`Action` CHAR(72) NOT NULL, `Condition` CHAR(255), `Sequence` INT PRIMARY KEY `Action`)".printf (table);
-            sql_insert = "INSERT INTO `%s` (`Action`, `Condition`, `Sequence`) VALUES (?, ?, ?)".printf (table);
+            columns = { "Action", "Condition", "Sequence" };
         }
 
         public class Action {
@@ -265,7 +261,7 @@ namespace Wixl {
         static construct {
             name = "File";
             sql_create = "CREATE TABLE `File` (`File` CHAR(72) NOT NULL, `Component_` CHAR(72) NOT NULL, `FileName` CHAR(255) NOT NULL LOCALIZABLE, `FileSize` LONG NOT NULL, `Version` CHAR(72), `Language` CHAR(20), `Attributes` INT, `Sequence` LONG NOT NULL PRIMARY KEY `File`)";
-            sql_insert = "INSERT INTO `File` (`File`, `Component_`, `FileName`, `FileSize`, `Attributes`, `Sequence`) VALUES (?, ?, ?, ?, ?, ?)";
+            columns = { "File", "Component_", "FileName", "FileSize", "Attributes", "Sequence" };
         }
 
         public Libmsi.Record add (string File, string Component, string FileName, int FileSize, int Attributes, int Sequence = 1) throws GLib.Error {
@@ -293,7 +289,7 @@ namespace Wixl {
         static construct {
             name = "Media";
             sql_create = "CREATE TABLE `Media` (`DiskId` INT NOT NULL, `LastSequence` LONG NOT NULL, `DiskPrompt` CHAR(64) LOCALIZABLE, `Cabinet` CHAR(255), `VolumeLabel` CHAR(32), `Source` CHAR(72) PRIMARY KEY `DiskId`)";
-            sql_insert = "INSERT INTO `Media` (`DiskId`, `LastSequence`, `DiskPrompt`, `Cabinet`) VALUES (?, ?, ?, ?)";
+            columns = { "DiskId", "LastSequence", "DiskPrompt", "Cabinet" };
         }
 
         public bool set_last_sequence (Libmsi.Record rec, int last_sequence) {
@@ -318,7 +314,7 @@ namespace Wixl {
         static construct {
             name = "Upgrade";
             sql_create = "CREATE TABLE `Upgrade` (`UpgradeCode` CHAR(38) NOT NULL, `VersionMin` CHAR(20), `VersionMax` CHAR(20), `Language` CHAR(255), `Attributes` LONG NOT NULL, `Remove` CHAR(255), `ActionProperty` CHAR(72) NOT NULL PRIMARY KEY `UpgradeCode`, `VersionMin`, `VersionMax`, `Language`, `Attributes`)";
-            sql_insert = "INSERT INTO `Upgrade` (`UpgradeCode`, `VersionMin`, `VersionMax`, `Attributes`, `ActionProperty`) VALUES (?, ?, ?, ?, ?)";
+            columns = { "UpgradeCode", "VersionMin", "VersionMax", "Attributes", "ActionProperty" };
         }
 
         public void add (string UpgradeCode, string VersionMin, string? VersionMax, int Attributes, string ActionProperty) throws GLib.Error {
@@ -339,7 +335,7 @@ namespace Wixl {
         static construct {
             name = "LaunchCondition";
             sql_create = "CREATE TABLE `LaunchCondition` (`Condition` CHAR(255) NOT NULL, `Description` CHAR(255) NOT NULL LOCALIZABLE PRIMARY KEY `Condition`)";
-            sql_insert = "INSERT INTO `LaunchCondition` (`Condition`, `Description`) VALUES (?, ?)";
+            columns = { "Condition", "Description" };
         }
 
         public void add (string condition, string description) throws GLib.Error {
@@ -357,7 +353,7 @@ namespace Wixl {
         static construct {
             name = "Property";
             sql_create = "CREATE TABLE `Property` (`Property` CHAR(72) NOT NULL, `Value` CHAR(0) NOT NULL LOCALIZABLE PRIMARY KEY `Property`)";
-            sql_insert = "INSERT INTO `Property` (`Property`, `Value`) VALUES (?, ?)";
+            columns = { "Property", "Value" };
         }
 
         public void add (string prop, string value) throws GLib.Error {
@@ -375,7 +371,7 @@ namespace Wixl {
         static construct {
             name = "Directory";
             sql_create = "CREATE TABLE `Directory` (`Directory` CHAR(72) NOT NULL, `Directory_Parent` CHAR(72), `DefaultDir` CHAR(255) NOT NULL LOCALIZABLE PRIMARY KEY `Directory`)";
-            sql_insert = "INSERT INTO `Directory` (`Directory`, `Directory_Parent`, `DefaultDir`) VALUES (?, ?, ?)";
+            columns = { "Directory", "Directory_Parent", "DefaultDir" };
         }
 
         public void add (string Directory, string? Parent, string DefaultDir) throws GLib.Error {
@@ -393,7 +389,7 @@ namespace Wixl {
         static construct {
             name = "Component";
             sql_create = "CREATE TABLE `Component` (`Component` CHAR(72) NOT NULL, `ComponentId` CHAR(38), `Directory_` CHAR(72) NOT NULL, `Attributes` INT NOT NULL, `Condition` CHAR(255), `KeyPath` CHAR(72) PRIMARY KEY `Component`)";
-            sql_insert = "INSERT INTO `Component` (`Component`, `ComponentId`, `Directory_`, `Attributes`, `KeyPath`) VALUES (?, ?, ?, ?, ?)";
+            columns = { "Component", "ComponentId", "Directory_", "Attributes", "KeyPath" };
         }
 
         public void add (string Component, string ComponentId, string Directory, int Attributes, string? KeyPath = null) throws GLib.Error {
@@ -413,7 +409,7 @@ namespace Wixl {
         static construct {
             name = "FeatureComponents";
             sql_create = "CREATE TABLE `FeatureComponents` (`Feature_` CHAR(38) NOT NULL, `Component_` CHAR(72) NOT NULL PRIMARY KEY `Feature_`, `Component_`)";
-            sql_insert = "INSERT INTO `FeatureComponents` (`Feature_`, `Component_`) VALUES (?, ?)";
+            columns = { "Feature_", "Component_" };
         }
 
         public void add (string Feature, string Component) throws GLib.Error {
@@ -430,7 +426,7 @@ namespace Wixl {
         static construct {
             name = "Registry";
             sql_create = "CREATE TABLE `Registry` (`Registry` CHAR(72) NOT NULL, `Root` INT NOT NULL, `Key` CHAR(255) NOT NULL LOCALIZABLE, `Name` CHAR(255) LOCALIZABLE, `Value` CHAR(0) LOCALIZABLE, `Component_` CHAR(72) NOT NULL PRIMARY KEY `Registry`)";
-            sql_insert = "INSERT INTO `Registry` (`Registry`, `Root`, `Key`, `Component_`, `Name`, `Value`) VALUES (?, ?, ?, ?, ?, ?)";
+            columns = { "Registry", "Root", "Key", "Component_", "Name", "Value" };
         }
 
         public void add (string Registry, int Root, string Key, string Component, string? Name, string? Value) throws GLib.Error {
@@ -451,7 +447,7 @@ namespace Wixl {
         static construct {
             name = "Shortcut";
             sql_create = "CREATE TABLE `Shortcut` (`Shortcut` CHAR(72) NOT NULL, `Directory_` CHAR(72) NOT NULL, `Name` CHAR(128) NOT NULL LOCALIZABLE, `Component_` CHAR(72) NOT NULL, `Target` CHAR(72) NOT NULL, `Arguments` CHAR(255), `Description` CHAR(255) LOCALIZABLE, `Hotkey` INT, `Icon_` CHAR(72), `IconIndex` INT, `ShowCmd` INT, `WkDir` CHAR(72), `DisplayResourceDLL` CHAR(255), `DisplayResourceId` INT, `DescriptionResourceDLL` CHAR(255), `DescriptionResourceId` INT PRIMARY KEY `Shortcut`)";
-            sql_insert = "INSERT INTO `Shortcut` (`Shortcut`, `Directory_`, `Name`, `Component_`, `Target`, `Icon_`, `IconIndex`, `WkDir`, `Description`, `Arguments`) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+            columns = { "Shortcut", "Directory_", "Name", "Component_", "Target", "Icon_", "IconIndex", "WkDir", "Description", "Arguments" };
         }
 
         public Libmsi.Record add (string Shortcut, string Directory, string Name, string Component) throws GLib.Error {
@@ -503,7 +499,7 @@ namespace Wixl {
         static construct {
             name = "CreateFolder";
             sql_create = "CREATE TABLE `CreateFolder` (`Directory_` CHAR(72) NOT NULL, `Component_` CHAR(72) NOT NULL PRIMARY KEY `Directory_`, `Component_`)";
-            sql_insert = "INSERT INTO `CreateFolder` (`Directory_`, `Component_`) VALUES (?, ?)";
+            columns = { "Directory_", "Component_" };
         }
 
         public void add (string Directory, string Component) throws GLib.Error {
@@ -520,7 +516,7 @@ namespace Wixl {
         static construct {
             name = "RemoveFile";
             sql_create = "CREATE TABLE `RemoveFile` (`FileKey` CHAR(72) NOT NULL, `Component_` CHAR(72) NOT NULL, `FileName` CHAR(255) LOCALIZABLE, `DirProperty` CHAR(72) NOT NULL, `InstallMode` INT NOT NULL PRIMARY KEY `FileKey`)";
-            sql_insert = "INSERT INTO `RemoveFile` (`FileKey`, `Component_`, `DirProperty`, `InstallMode`) VALUES (?, ?, ?, ?)";
+            columns = { "FileKey", "Component_", "DirProperty", "InstallMode" };
         }
 
         public void add (string FileKey, string Component, string DirProperty, int InstallMode) throws GLib.Error {
@@ -539,7 +535,7 @@ namespace Wixl {
         static construct {
             name = "Feature";
             sql_create = "CREATE TABLE `Feature` (`Feature` CHAR(38) NOT NULL, `Feature_Parent` CHAR(38), `Title` CHAR(64) LOCALIZABLE, `Description` CHAR(255) LOCALIZABLE, `Display` INT, `Level` INT NOT NULL, `Directory_` CHAR(72), `Attributes` INT NOT NULL PRIMARY KEY `Feature`)";
-            sql_insert = "INSERT INTO `Feature` (`Feature`, `Display`, `Level`, `Attributes`, `Feature_Parent`, `Title`, `Description`, `Directory_`) VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
+            columns = { "Feature", "Display", "Level", "Attributes", "Feature_Parent", "Title", "Description", "Directory_" };
         }
 
         public void add (string Feature, int Display, int Level, int Attributes, string? Parent = null, string? Title = null, string? Description = null, string? ConfigurableDirectory = null) throws GLib.Error {
@@ -562,7 +558,7 @@ namespace Wixl {
         static construct {
             name = "ServiceControl";
             sql_create = "CREATE TABLE `ServiceControl` (`ServiceControl` CHAR(72) NOT NULL, `Name` CHAR(255) NOT NULL LOCALIZABLE, `Event` INT NOT NULL, `Arguments` CHAR(255) LOCALIZABLE, `Wait` INT, `Component_` CHAR(72) NOT NULL PRIMARY KEY `ServiceControl`)";
-            sql_insert = "INSERT INTO `ServiceControl` (`ServiceControl`, `Name`, `Event`, `Arguments`, `Wait`, `Component_`) VALUES (?, ?, ?, ?, ?, ?)";
+            columns = { "ServiceControl", "Name", "Event", "Arguments", "Wait", "Component_" };
         }
 
         public void add (string ServiceControl, string Name, int Event, string? Arguments, bool? Wait, string Component) throws GLib.Error {
@@ -583,7 +579,7 @@ namespace Wixl {
         static construct {
             name = "ServiceInstall";
             sql_create = "CREATE TABLE `ServiceInstall` (`ServiceInstall` CHAR(72) NOT NULL, `Name` CHAR(255) NOT NULL, `DisplayName` CHAR(255) LOCALIZABLE, `ServiceType` LONG NOT NULL, `StartType` LONG NOT NULL, `ErrorControl` LONG NOT NULL, `LoadOrderGroup` CHAR(255), `Dependencies` CHAR(255), `StartName` CHAR(255), `Password` CHAR(255), `Arguments` CHAR(255), `Component_` CHAR(72) NOT NULL, `Description` CHAR(255) LOCALIZABLE PRIMARY KEY `ServiceInstall`)";
-            sql_insert = "INSERT INTO `ServiceInstall` (`ServiceInstall`, `Name`, `DisplayName`, `ServiceType`, `StartType`, `ErrorControl`, `LoadOrderGroup`, `Dependencies`, `StartName`, `Password`, `Arguments`, `Component_`, `Description`) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+            columns = { "ServiceInstall", "Name", "DisplayName", "ServiceType", "StartType", "ErrorControl", "LoadOrderGroup", "Dependencies", "StartName", "Password", "Arguments", "Component_", "Description" };
         }
 
         public void add (string ServiceInstall, string Name, string? DisplayName, int ServiceType, int StartType, int ErrorControl, string? LoadOrderGroup, string? Dependencies, string? StartName, string? Password, string? Arguments, string Component, string? Description = null) throws GLib.Error {
@@ -619,7 +615,7 @@ namespace Wixl {
         static construct {
             name = "AppSearch";
             sql_create = "CREATE TABLE `AppSearch` (`Property` CHAR(72) NOT NULL, `Signature_` CHAR(72) NOT NULL PRIMARY KEY `Property`, `Signature_`)";
-            sql_insert = "INSERT INTO `AppSearch` (`Property`, `Signature_`) VALUES (?, ?)";
+            columns = { "Property", "Signature_" };
         }
 
         public void add (string Property, string Signature) throws GLib.Error {
@@ -636,7 +632,7 @@ namespace Wixl {
         static construct {
             name = "CustomAction";
             sql_create = "CREATE TABLE `CustomAction` (`Action` CHAR(72) NOT NULL, `Type` INT NOT NULL, `Source` CHAR(72), `Target` CHAR(255), `ExtendedType` LONG PRIMARY KEY `Action`)";
-            sql_insert = "INSERT INTO `CustomAction` (`Action`, `Type`, `Source`, `Target`, `ExtendedType`) VALUES (?, ?, ?, ?, ?)";
+            columns = { "Action", "Type", "Source", "Target", "ExtendedType" };
         }
 
         public void add (string Action, int Type, string Source, string Target, int? ExtendedType = null) throws GLib.Error {
@@ -656,7 +652,7 @@ namespace Wixl {
         static construct {
             name = "RegLocator";
             sql_create = "CREATE TABLE `RegLocator` (`Signature_` CHAR(72) NOT NULL, `Root` INT NOT NULL, `Key` CHAR(255) NOT NULL, `Name` CHAR(255), `Type` INT PRIMARY KEY `Signature_`)";
-            sql_insert = "INSERT INTO `RegLocator` (`Signature_`, `Root`, `Key`, `Name`, `Type`) VALUES (?, ?, ?, ?, ?)";
+            columns = { "Signature_", "Root", "Key", "Name", "Type" };
         }
 
         public void add (string Signature, int Root, string Key, string Name, int Type) throws GLib.Error {
@@ -695,6 +691,28 @@ namespace Wixl {
             records.append (rec);
         }
 
+        List<File> temporary;
+
+        // A temporary file is removed once the database has been
+        // written.
+        public void add_file (string name, File file, bool temporary = true) throws GLib.Error {
+            if (temporary)
+                this.temporary.append (file);
+
+            var rec = new Libmsi.Record (2);
+            if (!rec.set_string (1, name) ||
+                !rec.load_stream_lazy (2, file.get_path ()))
+                throw new Wixl.Error.FAILED ("failed to add record");
+
+            records.append (rec);
+        }
+
+        public void remove_temporary () {
+            foreach (var f in temporary)
+                FileUtils.unlink (f.get_path ());
+            temporary = null;
+        }
+
         public override void create (Libmsi.Database db) throws GLib.Error {
             var query = new Libmsi.Query (db, "INSERT INTO `_Streams` (`Name`, `Data`) VALUES (?, ?)");
             foreach (var r in records)
@@ -907,18 +925,31 @@ namespace Wixl {
             Object (arch: arch);
         }
 
-        public void build (string filename) throws GLib.Error {
+        public void build (string filename, Timings? timings = null) throws GLib.Error {
             string name;
             MsiTable table;
 
-            var db = new Libmsi.Database (filename, Libmsi.DbFlags.CREATE, null);
-            info.save (db);
-
-            var it = HashTableIter <string, MsiTable> (tables);
-            while (it.next (out name, out table))
-                table.create (db);
-
-            db.commit ();
+            try {
+                if (timings != null)
+                    timings.begin ("create_tables");
+                var db = new Libmsi.Database (filename, Libmsi.DbFlags.CREATE, null);
+                info.save (db);
+
+                var it = HashTableIter <string, MsiTable> (tables);
+                while (it.next (out name, out table)) {
+                    table.create (db);
+                    if (timings != null)
+                        timings.add_table (name, table.records.length ());
+                }
+
+                if (timings != null)
+                    timings.begin ("commit");
+                db.commit ();
+            } finally {
+                if (timings != null)
+                    timings.end ();
+                table_streams.remove_temporary ();
+            }
         }
     }
 
@@ -55,33 +55,36 @@ namespace Wixl {
         }
 
         public string eval (string str, File? file) throws GLib.Error {
-            var result = "";
             int end = 0;
-            int pos = 0;
+            int pos = str.index_of_char ('$');
 
-            while ((pos = str.index_of ("$", end)) != -1) {
-                if (end < pos)
-                    result += str[end:pos];
+            if (pos == -1)
+                return str;
+
+            // one pass over str, appending to a single buffer
+            var result = new StringBuilder.sized (str.length);
+            for (; pos != -1; pos = str.index_of_char ('$', end)) {
+                result.append_len (str.offset (end), pos - end);
                 end = pos + 1;
-                var remainder = str[end:str.length];
-                if (remainder.has_prefix ("$"))
-                    result += "$";
-                else if (remainder.has_prefix ("(")) {
-                    var closing = find_closing_paren (remainder);
+                if (str[end] == '$')
+                    result.append_c ('$');
+                else if (str[end] == '(') {
+                    var closing = find_closing_paren (str, end);
                     if (closing == -1)
                         throw new Wixl.Error.FAILED ("no matching closing parenthesis");
-                    var substring = remainder[1:closing];
-                    if (substring.index_of ("(") != -1)
+                    var substring = str[end + 1:closing];
+                    if (substring.index_of_char ('(') != -1)
                         throw new Wixl.Error.FIXME ("unsupported function");
                     var val = eval_variable (substring, file);
                     if (val == null)
                         throw new Wixl.Error.FAILED ("Undefined variable %s", substring);
-                    result += val;
-                    end += closing + 1;
+                    result.append (val);
+                    end = closing + 1;
                 }
             }
 
-            return result + str[end:str.length];
+            result.append (str.offset (end));
+            return result.str;
         }
 
         class EvalCondition: Object {
@@ -491,16 +494,32 @@ namespace Wixl {
                 throw new Wixl.Error.FAILED ("Missing endif");
         }
 
+        // the contents of each file tried for an include, or null when
+        // it can't be read, shared by every preprocessor
+        static HashTable<string, string?> include_cache;
+
+        static construct {
+            include_cache = new HashTable<string, string?> (str_hash, str_equal);
+        }
+
         bool include_try (string filename, Xml.TextWriter writer) throws GLib.Error {
-            string data;
+            unowned string? data;
             var file = File.new_for_path (filename);
 
-            try {
-                FileUtils.get_contents (filename, out data);
-            } catch (GLib.FileError error) {
-                return false;
+            if (!include_cache.lookup_extended (filename, null, out data)) {
+                string? contents = null;
+                try {
+                    FileUtils.get_contents (filename, out contents);
+                } catch (GLib.FileError error) {
+                }
+
+                include_cache.insert (filename, contents);
+                data = include_cache.lookup (filename);
             }
 
+            if (data == null)
+                return false;
+
             var reader = new Xml.TextReader.for_doc (data, "");
             preprocess_xml (reader, writer, file, true);
             return true;
@@ -0,0 +1,220 @@
+namespace Wixl {
+
+#if HAVE_RUSAGE_THREAD
+    [CCode (cname = "struct rusage", cheader_filename = "sys/resource.h", has_type_id = false, destroy_function = "")]
+    struct RUsage {
+        public Posix.timeval ru_utime;
+        public Posix.timeval ru_stime;
+    }
+    [CCode (cname = "RUSAGE_THREAD", cheader_filename = "sys/resource.h")]
+    extern const int RUSAGE_THREAD;
+    [CCode (cname = "getrusage", cheader_filename = "sys/resource.h")]
+    extern int getrusage (int who, out RUsage usage);
+#endif
+
+    // Where a build spent its time and memory, phase by phase, and how
+    // much it produced, for --timings and --timings-json.
+    public class Timings: Object {
+        class Phase {
+            public string name;
+            public int64 wall;
+            public int64 cpu;
+            public int64 peak_rss;
+        }
+
+        class Table {
+            public string name;
+            public uint rows;
+        }
+
+        class Media {
+            public string cabinet;
+            public uint files;
+            public int64 size;
+            public int64 compressed;
+        }
+
+        List<Phase> phases;
+        List<Table> tables;
+        List<Media> medias;
+
+        // Set when other builds run in the process at the same time.
+        // The peak RSS is the process's, so it is left out then.
+        public bool concurrent;
+
+        Phase? current;
+        int64 wall_start;
+        int64 cpu_start;
+
+        // the CPU time of the calling thread in microseconds, or -1
+        // where the system does not count it per thread
+        static int64 cpu_time () {
+#if HAVE_RUSAGE_THREAD
+            RUsage usage;
+
+            if (getrusage (RUSAGE_THREAD, out usage) == 0)
+                return ((int64) usage.ru_utime.tv_sec + (int64) usage.ru_stime.tv_sec) * 1000000 +
+                       usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+            return -1;
+        }
+
+        // the high-water mark of the process so far, where the system
+        // tells it, or 0
+        static int64 peak_rss () {
+            string status;
+
+            try {
+                FileUtils.get_contents ("/proc/self/status", out status);
+            } catch (GLib.FileError error) {
+                return 0;
+            }
+
+            foreach (var line in status.split ("\n"))
+                if (line.has_prefix ("VmHWM:"))
+                    return int64.parse (line.substring (6).strip ()) * 1024;
+
+            return 0;
+        }
+
+        // Starts timing name, ending the phase before it. Phases of
+        // the same name add up, such as loading several files.
+        public void begin (string name) {
+            end ();
+
+            foreach (var p in phases)
+                if (p.name == name)
+                    current = p;
+            if (current == null) {
+                current = new Phase ();
+                current.name = name;
+                phases.append (current);
+            }
+
+            wall_start = get_monotonic_time ();
+            cpu_start = cpu_time ();
+        }
+
+        public void end () {
+            if (current == null)
+                return;
+
+            current.wall += get_monotonic_time () - wall_start;
+            if (cpu_start < 0 || current.cpu < 0)
+                current.cpu = -1;
+            else
+                current.cpu += cpu_time () - cpu_start;
+            if (!concurrent)
+                current.peak_rss = int64.max (current.peak_rss, peak_rss ());
+            current = null;
+        }
+
+        public void add_table (string name, uint rows) {
+            var t = new Table ();
+            t.name = name;
+            t.rows = rows;
+            tables.insert_sorted (t, (a, b) => { return strcmp (a.name, b.name); });
+        }
+
+        public void add_media (string cabinet, uint files, int64 size, int64 compressed) {
+            var m = new Media ();
+            m.cabinet = cabinet;
+            m.files = files;
+            m.size = size;
+            m.compressed = compressed;
+            medias.append (m);
+        }
+
+        static string seconds (int64 usec) {
+            return ("%" + int64.FORMAT + ".%03d").printf (usec / 1000000, (int) (usec / 1000 % 1000));
+        }
+
+        public string to_text () {
+            var str = new StringBuilder ();
+
+            str.append_printf ("%-20s %10s %14s", "Phase", "Wall (s)", "Thread CPU (s)");
+            if (!concurrent)
+                str.append_printf (" %21s", "Process peak RSS (kB)");
+            str.append_c ('\n');
+            foreach (var p in phases) {
+                str.append_printf ("%-20s %10s %14s", p.name, seconds (p.wall),
+                                   p.cpu >= 0 ? seconds (p.cpu) : "-");
+                if (!concurrent)
+                    str.append_printf (" %21" + int64.FORMAT, p.peak_rss / 1024);
+                str.append_c ('\n');
+            }
+
+            str.append_printf ("\n%-32s %10s\n", "Table", "Rows");
+            foreach (var t in tables)
+                str.append_printf ("%-32s %10u\n", t.name, t.rows);
+
+            if (medias != null) {
+                str.append_printf ("\n%-20s %6s %14s %14s %6s\n", "Media", "Files", "Size", "Compressed", "Ratio");
+                foreach (var m in medias)
+                    str.append_printf ("%-20s %6u %14" + int64.FORMAT + " %14" + int64.FORMAT +
+                                       " %5" + int64.FORMAT + "%%\n", m.cabinet, m.files,
+                                       m.size, m.compressed,
+                                       m.size > 0 ? m.compressed * 100 / m.size : 100);
+            }
+
+            return str.str;
+        }
+
+        static string json_string (string s) {
+            var str = new StringBuilder ("\"");
+
+            for (var i = 0; s[i] != '\0'; i++) {
+                var c = s[i];
+                if (c == '"' || c == '\\')
+                    str.append_printf ("\\%c", c);
+                else if ((uchar) c < 0x20)
+                    str.append_printf ("\\u%04x", (uint) c);
+                else
+                    str.append_c (c);
+            }
+
+            str.append_c ('"');
+            return str.str;
+        }
+
+        // times in microseconds and sizes in bytes, so nothing depends
+        // on the locale; cpu_us and peak_rss are left out like the
+        // columns of to_text
+        public string to_json () {
+            var str = new StringBuilder ("{\n  \"phases\": [");
+            var sep = "";
+
+            foreach (var p in phases) {
+                str.append_printf ("%s\n    { \"name\": %s, \"wall_us\": %" + int64.FORMAT,
+                                   sep, json_string (p.name), p.wall);
+                if (p.cpu >= 0)
+                    str.append_printf (", \"cpu_us\": %" + int64.FORMAT, p.cpu);
+                if (!concurrent)
+                    str.append_printf (", \"peak_rss\": %" + int64.FORMAT, p.peak_rss);
+                str.append (" }");
+                sep = ",";
+            }
+
+            str.append ("\n  ],\n  \"tables\": [");
+            sep = "";
+            foreach (var t in tables) {
+                str.append_printf ("%s\n    { \"name\": %s, \"rows\": %u }",
+                                   sep, json_string (t.name), t.rows);
+                sep = ",";
+            }
+
+            str.append ("\n  ],\n  \"media\": [");
+            sep = "";
+            foreach (var m in medias) {
+                str.append_printf ("%s\n    { \"cabinet\": %s, \"files\": %u, \"size\": %" + int64.FORMAT +
+                                   ", \"compressed\": %" + int64.FORMAT + " }",
+                                   sep, json_string (m.cabinet), m.files, m.size, m.compressed);
+                sep = ",";
+            }
+
+            str.append ("\n  ]\n}\n");
+            return str.str;
+        }
+    }
+
+} // Wixl
@@ -150,12 +150,13 @@ namespace Wixl {
         return str;
     }
 
-    public int find_closing_paren (string str) {
-        return_val_if_fail (str[0] == '(', -1);
+    // the position in str of the parenthesis closing the one at start
+    public int find_closing_paren (string str, int start = 0) {
+        return_val_if_fail (str[start] == '(', -1);
 
         var open_count = 1;
         var close_count = 0;
-        for (var pos = 1;  pos < str.length; pos++) {
+        for (var pos = start + 1; str[pos] != '\0'; pos++) {
             if (str[pos] == '(')
                 open_count++;
             else if (str[pos] == ')') {
@@ -170,12 +171,20 @@ namespace Wixl {
 
     public void compute_md5 (File file, ref int hash1, ref int hash2, ref int hash3, ref int hash4) throws GLib.Error {
         var checksum = new Checksum (ChecksumType.MD5);
-        var stream = file.read ();
-        uint8 fbuf[4096];
-        size_t size;
-
-        while ((size = stream.read (fbuf)) > 0) {
-            checksum.update (fbuf, size);
+        var path = file.get_path ();
+
+        if (path != null) {
+            // local files are hashed straight from the page cache
+            var mapped = new MappedFile (path, false);
+            checksum.update ((uchar[]) mapped.get_contents (), mapped.get_length ());
+        } else {
+            var stream = file.read ();
+            var fbuf = new uint8[1024 * 1024];
+            ssize_t size;
+
+            while ((size = stream.read (fbuf)) > 0) {
+                checksum.update (fbuf, size);
+            }
         }
 
         int buffer[4];
@@ -187,6 +196,65 @@ namespace Wixl {
         hash4 = buffer[3];
     }
 
+    public delegate void ParallelFunc (int i) throws GLib.Error;
+
+    class ParallelJob {
+        ParallelFunc func;
+        int n;
+        int next;
+        Mutex mutex;
+        public GLib.Error? error;
+
+        public ParallelJob (int n, owned ParallelFunc func) {
+            this.n = n;
+            this.func = (owned) func;
+            mutex = Mutex ();
+        }
+
+        public void* run () {
+            int i;
+
+            while ((i = AtomicInt.add (ref next, 1)) < n) {
+                try {
+                    func (i);
+                } catch (GLib.Error e) {
+                    mutex.lock ();
+                    if (error == null)
+                        error = e.copy ();
+                    mutex.unlock ();
+                    // leave the rest undone
+                    AtomicInt.set (ref next, n);
+                }
+            }
+
+            return null;
+        }
+    }
+
+    // Calls func for 0..n-1 on a pool of threads, one per processor
+    // unless n_threads says otherwise. The calls may run in any order;
+    // the first error is thrown once they are all done.
+    public void parallel_for (int n, owned ParallelFunc func, int n_threads = 0) throws GLib.Error {
+        var job = new ParallelJob (n, (owned) func);
+
+        if (n_threads <= 0)
+            n_threads = (int) get_num_processors ();
+        n_threads = int.min (n_threads, n);
+
+        if (n_threads <= 1) {
+            job.run ();
+        } else {
+            Thread<void*>[] threads = {};
+            for (var t = 0; t < n_threads; t++)
+                threads += new Thread<void*> ("wixl-worker", job.run);
+            foreach (var t in threads)
+                t.join ();
+        }
+
+        if (job.error != null)
+            throw job.error.copy ();
+    }
+
     public class UnixInputStream : GLib.InputStream {
         public int fd { get; set construct; }
 
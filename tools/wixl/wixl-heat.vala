@@ -7,6 +7,8 @@ static string vardir;
 [CCode (array_length = false, array_null_terminated = true)]
 static string[] exclude;
 static bool win64;
+static string directory;
+static string cachedir;
 
 private const OptionEntry[] options = {
     { "directory-ref", 0, 0, OptionArg.STRING, ref dr, N_("Directory Ref"), null },
@@ -15,9 +17,13 @@ private const OptionEntry[] options = {
     { "prefix", 'p', 0, OptionArg.STRING, ref prefix, N_("Prefix"), null },
     { "exclude", 'x', 0, OptionArg.STRING_ARRAY, ref exclude, N_("Exclude prefix"), null },
     { "win64", 0, 0, OptionArg.NONE, ref win64, N_("Add Win64 Component"), null },
+    { "directory", 'd', 0, OptionArg.FILENAME, ref directory, N_("Walk this directory instead of reading paths from stdin"), null },
+    { "cache-dir", 0, 0, OptionArg.FILENAME, ref cachedir, N_("Store file hashes for wixl in this build cache"), null },
     { null }
 };
 
+delegate void AddEntry (string line, HeatEntry? entry);
+
 bool filtered (string file) {
     foreach (var f in exclude)
         if (file.has_prefix (f))
@@ -30,6 +36,140 @@ string escape_filename(string filename) {
     return filename.replace("$", "$$");
 }
 
+class HeatEntry {
+    public File file;
+    public FileInfo info;
+    public List<HeatEntry> files;
+    public List<HeatEntry> dirs;
+
+    public HeatEntry (File file, FileInfo? info) {
+        this.file = file;
+        this.info = info;
+    }
+
+    public static int compare (HeatEntry a, HeatEntry b) {
+        return strcmp (a.info.get_name (), b.info.get_name ());
+    }
+}
+
+// Lists each directory on a pool of threads, one per processor. The
+// type, size and mtime of every entry come with the listing, so
+// nothing is stat'ed twice.
+class HeatWalker {
+    const string ATTRIBUTES = FileAttribute.STANDARD_NAME + "," +
+        FileAttribute.STANDARD_TYPE + "," + FileAttribute.STANDARD_IS_SYMLINK + "," +
+        BuildCache.FILE_ATTRIBUTES;
+    const int BATCH = 256;
+
+    ThreadPool<HeatEntry> pool;
+    int pending;
+    Mutex mutex = Mutex ();
+    Cond cond = Cond ();
+    GLib.Error? error;
+
+    void list (HeatEntry dir) {
+        try {
+            var e = dir.file.enumerate_children (ATTRIBUTES, FileQueryInfoFlags.NONE);
+            List<FileInfo> infos;
+
+            while ((infos = e.next_files (BATCH)) != null) {
+                foreach (var info in infos) {
+                    var child = new HeatEntry (dir.file.get_child (info.get_name ()), info);
+
+                    if (info.get_file_type () != FileType.DIRECTORY) {
+                        dir.files.prepend (child);
+                        continue;
+                    }
+
+                    // don't loop through links back up the tree
+                    if (info.get_is_symlink ())
+                        continue;
+
+                    dir.dirs.prepend (child);
+                    AtomicInt.inc (ref pending);
+                    pool.add (child);
+                }
+            }
+        } catch (GLib.Error e) {
+            mutex.lock ();
+            if (error == null)
+                error = e.copy ();
+            mutex.unlock ();
+        }
+
+        dir.files.sort (HeatEntry.compare);
+        dir.dirs.sort (HeatEntry.compare);
+
+        if (AtomicInt.dec_and_test (ref pending)) {
+            mutex.lock ();
+            cond.signal ();
+            mutex.unlock ();
+        }
+    }
+
+    public HeatEntry walk (string path) throws GLib.Error {
+        var root = new HeatEntry (File.new_for_commandline_arg (path), null);
+
+        pool = new ThreadPool<HeatEntry>.with_owned_data ((dir) => {
+            list (dir);
+        }, (int) get_num_processors (), false);
+
+        pending = 1;
+        pool.add (root);
+
+        mutex.lock ();
+        while (AtomicInt.get (ref pending) > 0)
+            cond.wait (mutex);
+        mutex.unlock ();
+
+        if (error != null)
+            throw error.copy ();
+
+        return root;
+    }
+}
+
+// the entries under dir in a stable order: each directory, then its
+// files, then its subdirectories, all sorted by name
+void flatten_entries (HeatEntry dir, ref HeatEntry[] entries) {
+    foreach (var f in dir.files)
+        entries += f;
+
+    foreach (var d in dir.dirs) {
+        entries += d;
+        flatten_entries (d, ref entries);
+    }
+}
+
+// hashes the files the cache doesn't know yet, for wixl to pick up
+void cache_hashes (BuildCache cache, HeatEntry[] entries) throws GLib.Error {
+    HeatEntry[] files = {};
+    string[] stamps = {};
+
+    foreach (var e in entries) {
+        if (e.info.get_file_type () == FileType.DIRECTORY)
+            continue;
+
+        var stamp = BuildCache.stamp (e.file, e.info);
+        var hash = new int[4];
+        if (cache.lookup_md5 (e.file, stamp, hash))
+            continue;
+
+        files += e;
+        stamps += stamp;
+    }
+
+    var hashes = new int[files.length * 4];
+    parallel_for (files.length, (i) => {
+        compute_md5 (files[i].file, ref hashes[i * 4], ref hashes[i * 4 + 1],
+                     ref hashes[i * 4 + 2], ref hashes[i * 4 + 3]);
+    });
+
+    for (var i = 0; i < files.length; i++)
+        cache.store_md5 (files[i].file, stamps[i], hashes[i * 4:i * 4 + 4]);
+    cache.save ();
+}
+
 public int main (string[] args) {
 
     var cmdline = string.joinv (" ", args);
@@ -50,6 +190,9 @@ public int main (string[] args) {
         warning (error.message);
     }
 
+    if (prefix == null && directory != null)
+        prefix = directory.has_suffix (Path.DIR_SEPARATOR_S) ?
+            directory : directory + Path.DIR_SEPARATOR_S;
     if (prefix == null) {
         GLib.stderr.printf ("Please specify source dir prefix\n");
         return 1;
@@ -66,51 +209,71 @@ public int main (string[] args) {
     List<string> cmpref = null;
     var indent = "      ";
 
-    try {
-        var dis = new DataInputStream (new UnixInputStream (0));
-        string line;
-
-        while ((line = dis.read_line (null)) != null) {
-            if (!line.has_prefix (prefix))
-                continue;
-
-            var file = line[prefix.length:line.length];
-            if (filtered (file))
-                continue;
-
-            var gfile = File.new_for_path (line);
-            var is_directory = gfile.query_file_type (FileQueryInfoFlags.NONE) == FileType.DIRECTORY;
-
-            var dir = is_directory ? file : Path.get_dirname (file);
-            var path = dir.split (Path.DIR_SEPARATOR_S, -1);
-            var i = 0;
-            if (last_path != null) {
-                while ((path[i] != null && last_path[i] != null) &&
-                       path[i] == last_path[i])
-                    i++;
-                for (var j = last_path.length - i; j > 0; j--) {
-                    indent = indent[0:-2];
-                    stdout.printf (indent + "</Directory>\n");
-                }
-            }
-            for (; i < path.length; i++) {
-                stdout.printf (indent + "<Directory Id=\"%s\" Name=\"%s\">\n".printf (random_id ("dir"), path[i]));
-                indent += "  ";
-            }
-            last_path = path;
-
-            if (!is_directory) {
-                var id = generate_id ("cmp", 1, file);
-                cmpref.append (id);
-                if (win64)
-                    stdout.printf (indent + "<Component Win64=\"$(var.Win64)\" Id=\"%s\" Guid=\"*\">\n".printf (id));
-                else
-                    stdout.printf (indent + "<Component Id=\"%s\" Guid=\"*\">\n".printf (id));
-                file = sourcedir + Path.DIR_SEPARATOR_S + escape_filename(file);
-                stdout.printf (indent + "  <File Id=\"%s\" KeyPath=\"yes\" Source=\"%s\"/>\n".printf (generate_id ("fil", 1, file), file));
-                stdout.printf (indent + "</Component>\n");
+    // entries from the walk know their type, lines from stdin don't
+    AddEntry add_entry = (line, entry) => {
+        if (!line.has_prefix (prefix))
+            return;
+
+        var file = line[prefix.length:line.length];
+        if (filtered (file))
+            return;
+
+        var type = entry != null ? entry.info.get_file_type () :
+            File.new_for_path (line).query_file_type (FileQueryInfoFlags.NONE);
+        var is_directory = type == FileType.DIRECTORY;
+
+        var dir = is_directory ? file : Path.get_dirname (file);
+        var path = dir.split (Path.DIR_SEPARATOR_S, -1);
+        var i = 0;
+        if (last_path != null) {
+            while ((path[i] != null && last_path[i] != null) &&
+                   path[i] == last_path[i])
+                i++;
+            for (var j = last_path.length - i; j > 0; j--) {
+                indent = indent[0:-2];
+                stdout.printf (indent + "</Directory>\n");
             }
         }
+        for (; i < path.length; i++) {
+            stdout.printf (indent + "<Directory Id=\"%s\" Name=\"%s\">\n".printf (random_id ("dir"), path[i]));
+            indent += "  ";
+        }
+        last_path = path;
+
+        if (!is_directory) {
+            var id = generate_id ("cmp", 1, file);
+            cmpref.append (id);
+            if (win64)
+                stdout.printf (indent + "<Component Win64=\"$(var.Win64)\" Id=\"%s\" Guid=\"*\">\n".printf (id));
+            else
+                stdout.printf (indent + "<Component Id=\"%s\" Guid=\"*\">\n".printf (id));
+            file = sourcedir + Path.DIR_SEPARATOR_S + escape_filename(file);
+            stdout.printf (indent + "  <File Id=\"%s\" KeyPath=\"yes\" Source=\"%s\"/>\n".printf (generate_id ("fil", 1, file), file));
+            stdout.printf (indent + "</Component>\n");
+        }
+    };
+
+    try {
+        if (directory != null) {
+            var root = new HeatWalker ().walk (directory);
+            HeatEntry[] entries = {};
+            flatten_entries (root, ref entries);
+
+            if (cachedir != null)
+                cache_hashes (new BuildCache (cachedir), entries);
+
+            // the paths as find would print them
+            var top = directory.has_suffix (Path.DIR_SEPARATOR_S) ?
+                directory[0:-1] : directory;
+            foreach (var e in entries)
+                add_entry (top + Path.DIR_SEPARATOR_S + root.file.get_relative_path (e.file), e);
+        } else {
+            var dis = new DataInputStream (new UnixInputStream (0));
+            string line;
+
+            while ((line = dis.read_line (null)) != null)
+                add_entry (line, null);
+        }
     } catch (GLib.Error error) {
         warning (error.message);
     }
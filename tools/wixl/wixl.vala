@@ -12,9 +12,14 @@ namespace Wixl {
     static string[] defines;
     [CCode (array_length = false, array_null_terminated = true)]
     static string[] opt_includedirs;
+    [CCode (array_length = false, array_null_terminated = true)]
+    static string[] opt_targets;
 
     static string[] includedirs;
     static string wxidir;
+    static string cachedir;
+    static bool timings;
+    static string timings_json;
     static Arch arch = Arch.X86;
 
     private const OptionEntry[] options = {
@@ -25,6 +30,10 @@ namespace Wixl {
         { "arch", 'a', 0, OptionArg.CALLBACK, (void*)parse_arch, N_("Target architecture"), null },
         { "includedir", 'I', 0, OptionArg.STRING_ARRAY, ref opt_includedirs, N_("Include directory"), null },
         { "wxidir", 0, 0, OptionArg.STRING, ref wxidir, N_("System include directory"), null },
+        { "cache-dir", 0, 0, OptionArg.FILENAME, ref cachedir, N_("Reuse file hashes and cabinets kept in this directory"), null },
+        { "timings", 0, 0, OptionArg.NONE, ref timings, N_("Report time and memory used by each build phase"), null },
+        { "timings-json", 0, 0, OptionArg.FILENAME, ref timings_json, N_("Write the timings report as JSON to FILE"), N_("FILE") },
+        { "target", 'T', 0, OptionArg.STRING_ARRAY, ref opt_targets, N_("Also build FILE, for another architecture or other variables"), N_("FILE[,arch=ARCH][,VAR=VALUE...]") },
         { "only-preproc", 'E', 0, OptionArg.NONE, ref preproc, N_("Stop after the preprocessing stage"), null },
         { "", 0, 0, OptionArg.FILENAME_ARRAY, ref files, null, N_("INPUT_FILE1 [INPUT_FILE2]...") },
         { null }
@@ -40,6 +49,77 @@ namespace Wixl {
         return true;
     }
 
+    // the -D defines, which apply to every target
+    string[] global_defines () {
+        string[] defs = {};
+
+        foreach (var d in defines)
+            defs += d;
+
+        return defs;
+    }
+
+    class Target {
+        public string output;
+        public Arch arch;
+        public string[] defines;
+        public WixBuilder builder;
+        public MsiDatabase msi;
+
+        public Target (string output, Arch arch, string[] defines) {
+            this.output = output;
+            this.arch = arch;
+            this.defines = defines;
+        }
+
+        public static Target parse (string spec) throws GLib.Error {
+            var parts = spec.split (",");
+            string[] defs = global_defines ();
+            var a = Wixl.arch;
+
+            for (var i = 1; i < parts.length; i++) {
+                if (parts[i].has_prefix ("arch="))
+                    a = Arch.from_string (parts[i].substring (5));
+                else
+                    defs += parts[i];
+            }
+
+            return new Target (parts[0], a, defs);
+        }
+
+        // defines the variables in the builder, and returns them as a
+        // string that is the same for targets with the same variables
+        public string define_variables () {
+            var vars = new HashTable<string, string> (str_hash, str_equal);
+
+            foreach (var d in defines) {
+                var def = d.split ("=", 2);
+                var name = def[0];
+                var value = def.length == 2 ? def[1] : "1";
+                builder.define_variable (name, value);
+                vars.insert (name, value);
+            }
+
+            var names = vars.get_keys ();
+            names.sort (strcmp);
+            var key = new StringBuilder ();
+            foreach (var name in names)
+                key.append ("%s=%s\n".printf (name, vars.lookup (name)));
+
+            return key.str;
+        }
+    }
+
+    void remove_directory (string path) throws GLib.Error {
+        var dir = File.new_for_path (path);
+        var e = dir.enumerate_children (FileAttribute.STANDARD_NAME, FileQueryInfoFlags.NOFOLLOW_SYMLINKS);
+        FileInfo info;
+
+        while ((info = e.next_file ()) != null)
+            dir.get_child (info.get_name ()).delete ();
+        dir.delete ();
+    }
+
     int main (string[] args) {
         Intl.bindtextdomain (Config.GETTEXT_PACKAGE, Config.LOCALEDIR);
         Intl.bind_textdomain_codeset (Config.GETTEXT_PACKAGE, "UTF-8");
@@ -85,36 +165,96 @@ namespace Wixl {
             }
         }
 
+        Target[] targets = {};
+        targets += new Target (output, arch, global_defines ());
+        if (!preproc)
+            foreach (var spec in opt_targets)
+                try {
+                    targets += Target.parse (spec);
+                } catch (GLib.Error error) {
+                    GLib.stderr.printf (_("Invalid target %s: %s\n"), spec, error.message);
+                    exit (1);
+                }
+
+        string? tmpcache = null;
+
         try {
-            var builder = new WixBuilder (includedirs, arch);
+            // the targets share file hashes and cabinets through the
+            // cache, a temporary one unless one was given
+            BuildCache? cache = null;
+            if (cachedir == null && targets.length > 1) {
+                tmpcache = DirUtils.make_tmp ("wixl-XXXXXX");
+                cache = new BuildCache (tmpcache);
+            } else if (cachedir != null)
+                cache = new BuildCache (cachedir);
 
-            foreach (var d in defines) {
-                var def = d.split ("=", 2);
-                var name = def[0];
-                var value = def.length == 2 ? def[1] : "1";
-                builder.define_variable (name, value);
-            }
+            // and the preprocessed sources, when their variables match
+            var loaded = new HashTable<string, WixBuilder> (str_hash, str_equal);
+
+            foreach (var t in targets) {
+                t.builder = new WixBuilder (includedirs, t.arch);
+                t.builder.cache = cache;
+                t.builder.keep_docs = targets.length > 1;
+
+                var key = t.define_variables ();
+                var same = loaded.lookup (key);
+                if (same != null)
+                    t.builder.load_docs_of (same);
+                else
+                    loaded.insert (key, t.builder);
+
+                foreach (var arg in files) {
+                    var file = File.new_for_commandline_arg (arg);
+                    if (same == null) {
+                        if (verbose)
+                            print (_("Loading %s...\n"), arg);
+                        t.builder.load_file (file, preproc);
+                    }
+                    t.builder.add_path (file.get_parent ().get_path ());
+                }
+
+                if (preproc)
+                    return 0;
 
-            foreach (var arg in files) {
                 if (verbose)
-                    print (_("Loading %s...\n"), arg);
-                var file = File.new_for_commandline_arg (arg);
-                builder.load_file (file, preproc);
-                builder.add_path (file.get_parent ().get_path ());
+                    print (_("Building %s...\n"), t.output);
+                t.msi = t.builder.build ();
             }
 
-            if (preproc)
-                return 0;
+            // the databases have nothing in common any more, and are
+            // written concurrently
+            foreach (var t in targets)
+                t.builder.timings.concurrent = targets.length > 1;
+            parallel_for (targets.length, (i) => {
+                if (verbose)
+                    print (_("Writing %s...\n"), targets[i].output);
+                targets[i].msi.build (targets[i].output, targets[i].builder.timings);
+            });
 
-            if (verbose)
-                print (_("Building %s...\n"), output);
-            var msi = builder.build ();
-            if (verbose)
-                print (_("Writing %s...\n"), output);
-            msi.build (output);
+            if (timings)
+                foreach (var t in targets) {
+                    if (targets.length > 1)
+                        printerr ("%s:\n", t.output);
+                    printerr ("%s", t.builder.timings.to_text ());
+                }
+
+            if (timings_json != null) {
+                string[] reports = {};
+                foreach (var t in targets)
+                    reports += t.builder.timings.to_json ();
+                FileUtils.set_contents (timings_json, targets.length > 1 ?
+                                        "[\n" + string.joinv (",\n", reports) + "]\n" : reports[0]);
+            }
         } catch (GLib.Error error) {
             printerr (error.message + "\n");
             return 1;
+        } finally {
+            if (tmpcache != null)
+                try {
+                    remove_directory (tmpcache);
+                } catch (GLib.Error error) {
+                    warning (error.message);
+                }
         }
 
         return 0;